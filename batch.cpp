@@ -0,0 +1,256 @@
+#include "batch.hpp"
+#include "drc.hpp"
+#include "hier.hpp"
+#include "parser.hpp"
+#include "report.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace fs = std::filesystem;
+
+Box shapeExtent(const ShapeStore& store){
+    long long x1 = LLONG_MAX, y1 = LLONG_MAX, x2 = LLONG_MIN, y2 = LLONG_MIN;
+    for (const auto& L : store.byLayer)
+        for (size_t k = 0; k < L.size(); ++k){
+            x1 = std::min<long long>({x1, L.x1[k], L.x2[k]});
+            y1 = std::min<long long>({y1, L.y1[k], L.y2[k]});
+            x2 = std::max<long long>({x2, L.x1[k], L.x2[k]});
+            y2 = std::max<long long>({y2, L.y1[k], L.y2[k]});
+        }
+    if (x1 > x2) return {0, 0, 0, 0};
+    return {(int)x1, (int)y1, (int)x2, (int)y2};
+}
+
+namespace {
+
+struct Deck {
+    std::string path, name;                  // name = 輸出子目錄（多份 deck 時）
+    std::unique_ptr<const RuleSet> rules;    // 讀不到 = nullptr
+    std::string error;
+};
+
+struct Job {
+    std::string layout, name;                // name = 輸出子目錄，重名時加 _2、_3…
+    const Deck* deck = nullptr;
+    uintmax_t bytes = 0;
+
+    // 跑完才填
+    size_t shapes = 0, parseErrors = 0;
+    Box die{};
+    long long counts[4] = {0, 0, 0, 0};      // 依 cat：WIDTH / SPACING / ENCLOSURE / DENSITY（只算 FAIL）
+    long long passes = 0;
+    double ms = 0;
+    std::string outDir, error;
+};
+
+// 與互動模式挑檔的規則相同（layout*.txt / layout*.bin）：同一個目錄裡的 drc_report.txt 等輸出不會被當成 layout
+bool isLayoutFile(const fs::path& p){
+    const std::string name = p.filename().string(), ext = p.extension().string();
+    return name.rfind("layout", 0) == 0 && (ext == ".txt" || ext == ".bin");
+}
+
+// 目錄展開成裡面的 layout 檔（依檔名排序），檔案原樣保留
+std::vector<std::string> expandLayouts(const std::vector<std::string>& args){
+    std::vector<std::string> out;
+    for (const auto& a : args){
+        std::error_code ec;
+        if (!fs::is_directory(a, ec)) { out.push_back(a); continue; }
+        std::vector<std::string> inDir;
+        for (const auto& e : fs::directory_iterator(a, ec))
+            if (e.is_regular_file(ec) && isLayoutFile(e.path())) inDir.push_back(e.path().string());
+        std::sort(inDir.begin(), inDir.end());
+        out.insert(out.end(), inDir.begin(), inDir.end());
+    }
+    return out;
+}
+
+// 輸出子目錄名：檔名去掉副檔名，空白換成 _，重名加序號
+std::string uniqueName(const std::string& path, std::set<std::string>& used){
+    std::string base = fs::path(path).stem().string();
+    std::replace(base.begin(), base.end(), ' ', '_');
+    if (base.empty()) base = "layout";
+    std::string name = base;
+    for (int n = 2; !used.insert(name).second; ++n) name = base + "_" + std::to_string(n);
+    return name;
+}
+
+void runJob(Job& job, const BatchOptions& opt, int threads){
+    std::error_code ec;
+    if (!fs::is_regular_file(job.layout, ec)) { job.error = "cannot open layout"; return; }
+
+    std::vector<ParseError> errs;
+    const RuleSet& rules = *job.deck->rules;
+    std::vector<Violation> V;
+    if (isHierarchicalLayout(job.layout)) {
+        // 階層 layout：shape 數記展平後的數量，die 取頂層外框
+        HierLayout hier = readHierLayout(job.layout, rules, &errs);
+        job.parseErrors = errs.size();
+        job.shapes = (size_t)hier.flatCount();
+        const Box& top = hier.cells[0].bbox;
+        job.die = opt.fixedDie ? opt.die : top.x1 > top.x2 ? Box{0, 0, 0, 0} : top;
+        V = run_drc_hier(hier, rules, job.die.x1,job.die.y1,job.die.x2,job.die.y2);
+    } else {
+        ShapeStore store = readLayout(job.layout, rules, &errs);
+        job.parseErrors = errs.size();
+        job.shapes = store.count;
+        job.die = opt.fixedDie ? opt.die : shapeExtent(store);
+        V = run_drc(store, rules, job.die.x1,job.die.y1,job.die.x2,job.die.y2, threads);
+    }
+    for (const auto& v : V){
+        if (v.pass) job.passes++;
+        else        job.counts[v.cat]++;
+    }
+
+    fs::create_directories(job.outDir, ec);
+    if (ec) { job.error = "cannot create " + job.outDir; return; }
+    const std::string report = job.outDir + "/drc_report.txt", table = job.outDir + "/drc_fail_table.csv";
+    if (!writeDRCReport(report, V)) job.error = "cannot write " + report;
+    else if (!writeDRCReportTable(table, V)) job.error = "cannot write " + table;
+}
+
+long long fails(const Job& j){ return j.counts[0] + j.counts[1] + j.counts[2] + j.counts[3]; }
+
+void writeSummary(const std::string& outDir, const std::vector<Job>& jobs, double totalMs){
+    std::ofstream csv(outDir + "/summary.csv");
+    if (!csv.is_open()) { std::cerr << "ERROR: cannot write " << outDir << "/summary.csv\n"; return; }
+    csv << "layout,rules,output,shapes,parse_errors,die,width,spacing,enclosure,density,fail,pass,ms,error\n";
+    auto q = [](const std::string& s){               // CSV 欄位：有逗號 / 引號才加引號
+        if (s.find_first_of(",\"\n") == std::string::npos) return s;
+        std::string r = "\"";
+        for (char c : s) { r += c; if (c == '"') r += '"'; }
+        return r + "\"";
+    };
+    json rows = json::array();
+    for (const auto& j : jobs){
+        const std::string die = std::to_string(j.die.x1) + " " + std::to_string(j.die.y1) + " " +
+                                std::to_string(j.die.x2) + " " + std::to_string(j.die.y2);
+        csv << q(j.layout) << "," << q(j.deck->path) << "," << q(j.outDir) << "," << j.shapes << ","
+            << j.parseErrors << "," << die << "," << j.counts[0] << "," << j.counts[1] << ","
+            << j.counts[2] << "," << j.counts[3] << "," << fails(j) << "," << j.passes << ","
+            << j.ms << "," << q(j.error) << "\n";
+        rows.push_back({
+            {"layout", j.layout}, {"rules", j.deck->path}, {"output", j.outDir},
+            {"shapes", j.shapes}, {"parse_errors", j.parseErrors},
+            {"die", {j.die.x1, j.die.y1, j.die.x2, j.die.y2}},
+            {"violations", {{"WIDTH", j.counts[0]}, {"SPACING", j.counts[1]},
+                            {"ENCLOSURE", j.counts[2]}, {"DENSITY", j.counts[3]}}},
+            {"fail", fails(j)}, {"pass", j.passes}, {"ms", j.ms}, {"error", j.error}
+        });
+    }
+    std::ofstream js(outDir + "/summary.json");
+    if (!js.is_open()) { std::cerr << "ERROR: cannot write " << outDir << "/summary.json\n"; return; }
+    js << json{{"jobs", rows}, {"total_ms", totalMs}}.dump(2) << "\n";
+}
+
+} // namespace
+
+
+int runBatch(const BatchOptions& opt){
+    auto t0 = std::chrono::steady_clock::now();
+
+    // 1) 每份 deck 讀一次
+    std::vector<std::string> deckPaths = opt.rulesFiles;
+    if (deckPaths.empty()) deckPaths.push_back("rules.json");
+    std::vector<Deck> decks(deckPaths.size());
+    std::set<std::string> deckNames;
+    for (size_t d = 0; d < deckPaths.size(); ++d){
+        Deck& D = decks[d];
+        D.path = deckPaths[d];
+        D.name = uniqueName(D.path, deckNames);
+        try {
+            D.rules = std::make_unique<const RuleSet>(readRules(D.path));
+        } catch (const std::exception& e) {
+            D.error = e.what();
+            std::cerr << "ERROR: " << D.path << ": " << e.what() << "\n";
+        }
+    }
+
+    // 2) layout × deck 展開成 job
+    const std::vector<std::string> layouts = expandLayouts(opt.layouts);
+    if (layouts.empty()) { std::cerr << "--batch: 沒有 layout\n"; return 1; }
+    std::set<std::string> layoutNames;
+    std::vector<std::string> names;
+    for (const auto& l : layouts) names.push_back(uniqueName(l, layoutNames));
+
+    std::vector<Job> jobs;
+    jobs.reserve(layouts.size() * decks.size());
+    for (const auto& D : decks)
+        for (size_t i = 0; i < layouts.size(); ++i){
+            Job j;
+            j.layout = layouts[i];
+            j.name = names[i];
+            j.deck = &D;
+            j.outDir = decks.size() > 1 ? opt.outDir + "/" + D.name + "/" + j.name : opt.outDir + "/" + j.name;
+            std::error_code ec;
+            j.bytes = fs::file_size(j.layout, ec);
+            if (ec) j.bytes = 0;
+            jobs.push_back(std::move(j));
+        }
+
+    std::error_code ec;
+    fs::create_directories(opt.outDir, ec);
+    if (ec) { std::cerr << "ERROR: cannot create " << opt.outDir << "\n"; return 1; }
+
+    // 3) 大檔先送（最長工作先排，尾端不會剩一個大 layout 單跑）；summary 仍依輸入順序
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return jobs[a].bytes > jobs[b].bytes; });
+
+    const int workers = std::min<int>(ThreadPool::resolveThreads(opt.jobs), (int)jobs.size());
+    std::mutex printM;
+    size_t done = 0;
+    auto finish = [&](Job& j){
+        std::lock_guard<std::mutex> lk(printM);
+        ++done;
+        if (opt.quiet) return;
+        std::cout << "[" << done << "/" << jobs.size() << "] " << j.layout;
+        if (decks.size() > 1) std::cout << " (" << j.deck->path << ")";
+        if (!j.error.empty()) std::cout << ": ERROR " << j.error << "\n";
+        else std::cout << ": " << j.shapes << " shapes, " << fails(j) << " violations, " << (long long)j.ms << " ms\n";
+    };
+    auto run = [&](Job& j){
+        auto j0 = std::chrono::steady_clock::now();
+        if (!j.deck->rules) j.error = "cannot read rules: " + j.deck->error;
+        else {
+            try {
+                runJob(j, opt, opt.threads);
+            } catch (const std::exception& e) {
+                j.error = e.what();
+            }
+        }
+        j.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - j0).count();
+        finish(j);
+    };
+
+    if (workers <= 1) {
+        for (size_t i : order) run(jobs[i]);
+    } else {
+        ThreadPool pool(workers);
+        for (size_t i : order) pool.submit([&, i]{ run(jobs[i]); });
+        pool.wait();
+    }
+
+    const double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    writeSummary(opt.outDir, jobs, totalMs);
+
+    size_t failed = 0;
+    long long total = 0, shapes = 0;
+    for (const auto& j : jobs){
+        failed += !j.error.empty();
+        total += fails(j);
+        shapes += (long long)j.shapes;
+    }
+    std::cout << "Batch: " << jobs.size() << " jobs (" << failed << " failed), " << shapes << " shapes, "
+              << total << " violations in " << (long long)totalMs << " ms; summary saved to "
+              << opt.outDir << "/summary.csv\n";
+    return failed ? 1 : 0;
+}
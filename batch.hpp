@@ -0,0 +1,29 @@
+#pragma once
+#include "common.hpp"
+#include <string>
+#include <vector>
+
+// ---- 批次模式（main --batch）----
+// 不互動、不依賴平台 API：一次吃很多份 layout 與 rule deck，每個 (layout, deck) 組合是一個 job，
+// 最多 jobs 個同時跑。每份 deck 只讀一次，所有 job 共用同一份唯讀的 RuleSet。
+// die 沒指定時取該 layout 所有 shape 的外框；階層式 layout（hier.hpp）改跑 run_drc_hier。
+//   輸出：<out>/<layout 名>/drc_report.txt、drc_fail_table.csv（多份 deck 時是 <out>/<deck 名>/<layout 名>/），
+//   全部跑完再寫 <out>/summary.csv 與 summary.json（每個 job 一列：shape 數、die、各類違規數、耗時、錯誤）。
+// 目錄參數展開成裡面的 layout*.txt / layout*.bin（不遞迴，與互動模式挑檔相同）。
+
+struct BatchOptions {
+    std::vector<std::string> layouts;        // 檔案或目錄
+    std::vector<std::string> rulesFiles;     // 空 = rules.json
+    std::string outDir = "drc_batch";
+    int jobs = 0;                            // 同時跑的 job 數；0 = 全部核心
+    int threads = 1;                         // 每個 job 的 run_drc 執行緒數
+    bool fixedDie = false;
+    Box die{};                               // fixedDie 時所有 layout 共用
+    bool quiet = false;                      // 不逐筆印進度
+};
+
+// 所有 shape 的外框（反向矩形也算進去）；沒有 shape 回傳 {0,0,0,0}
+Box shapeExtent(const ShapeStore& store);
+
+// 全部 job 成功回傳 0；有 layout 讀不到 / rule deck 讀不到回傳 1
+int runBatch(const BatchOptions& opt);
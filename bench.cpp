@@ -0,0 +1,341 @@
+// bench：合成 layout 產生器 + 各階段計時，結果輸出成 JSON
+//   bench [--sizes 1K,10K,100K] [--fill 0.4] [--via-ratio 0.1] [--violations 0.01] [--seed 1]
+//         [--rules rules.json] [--threads N] [--work DIR] [--keep] [--no-parse] [--out FILE]
+// 每個 size 是「每個金屬層的 shape 數」。依 rules.json 產生一份 layout（寫成 layout*.txt 格式），
+// 然後依序計時 parse → index → width → spacing → enclosure → density → report，
+// 最後再用 --threads 跑一次完整的 run_drc，以及 run_drc_fused、run_drc_merged 各一次（單執行緒）。同一組參數 + seed 產生的 layout 逐位相同。
+#include "parser.hpp"
+#include "drc.hpp"
+#include "report.hpp"
+#include "spatial.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct GenParams {
+    long long shapes = 1000;      // 每個金屬層的 shape 數
+    double fill = 0.4;            // 金屬區的目標面積比（太高時退回 min spacing 排滿）
+    double viaRatio = 0.1;        // 每個 via 層的 via 數 = viaRatio × shapes
+    double violationRate = 0.01;  // 每個 shape / via 故意做成違規的機率
+    uint64_t seed = 1;
+};
+
+struct GenResult {
+    Box die{};
+    size_t shapes = 0;
+};
+
+// 不用 std::uniform_int_distribution：各家標準庫的實作不同，同一個 seed 才能到處產生同一份 layout
+struct Rng {
+    std::mt19937_64 g;
+    explicit Rng(uint64_t seed) : g(seed) {}
+    long long below(long long n){ return n <= 1 ? 0 : (long long)(g() % (uint64_t)n); }
+    long long range(long long lo, long long hi){ return lo + below(hi - lo + 1); }   // [lo, hi]
+    bool chance(double p){ return (double)(g() >> 11) * 0x1.0p-53 < p; }
+};
+
+// 依規則產生 layout，每個矩形交給 emit(層名, x1,y1,x2,y2)。
+//   金屬層（有 width / spacing 規則的層）：一排排水平 track，兩邊都在 [min_width, max_width] 內，
+//     track 間距留足 min spacing；違規的 shape 輪流做成太窄（短邊 < min）、太長（長邊 > max）、
+//     或與前一個的間距小於 min spacing。
+//   via 層：放在金屬區上方的 pad 區，每個 via 上下各墊一塊 under / over pad；違規的 via 往左偏，
+//     左側包覆量少於 min_enclose。
+GenResult generateLayout(const RuleSet& rules, const GenParams& P,
+                         const std::function<void(const std::string&, int,int,int,int)>& emit)
+{
+    Rng rng(P.seed);
+    GenResult G;
+    auto put = [&](const std::string& layer, long long x1, long long y1, long long x2, long long y2){
+        emit(layer, (int)x1, (int)y1, (int)x2, (int)y2);
+        G.shapes++;
+    };
+
+    struct Metal { std::string name; long long minW, maxW, S, pitch; bool hasMin, hasMax, hasS; };
+    std::vector<Metal> metals;
+    for (const auto& kv : rules.layer_rules) {
+        const auto& r = kv.second;
+        Metal m;
+        m.name = kv.first;
+        m.hasMin = r.min_width > 0; m.hasMax = r.max_width > 0; m.hasS = r.min_spacing > 0;
+        m.minW = m.hasMin ? r.min_width : 20;
+        m.maxW = m.hasMax ? std::max<long long>(r.max_width, m.minW) : 3 * m.minW;
+        m.S    = m.hasS ? r.min_spacing : m.minW;
+        m.pitch = m.maxW + m.S;
+        metals.push_back(m);
+    }
+    std::sort(metals.begin(), metals.end(), [](const Metal& a, const Metal& b){ return a.name < b.name; });
+
+    // shape 寬 h ∈ [minW, maxW]（y 向）、長 l ∈ [h, maxW]（x 向）；由 fill 反推 track 上的平均間距
+    auto avgLen = [](const Metal& m){ return (m.minW + 3.0 * m.maxW) / 4.0; };
+    auto avgGap = [&](const Metal& m){
+        double h = (m.minW + m.maxW) / 2.0, l = avgLen(m);
+        double gap = P.fill > 0 ? l * (h / m.pitch / P.fill - 1.0) : 0.0;
+        return std::max<double>(gap, (double)m.S);
+    };
+    long long W = 1;                  // die 寬：最佔面積的那層排成接近正方形
+    for (const auto& m : metals) {
+        W = std::max<long long>(W, (long long)std::ceil(std::sqrt((double)P.shapes * (avgLen(m) + avgGap(m)) * m.pitch)));
+        W = std::max<long long>(W, 2 * m.maxW + 1);                  // 一條 track 至少放得下一個 shape
+    }
+
+    long long top = 0;
+    for (const auto& m : metals) {
+        const long long extra = (long long)(avgGap(m) - m.S);
+        long long x = 0, y = 0;
+        for (long long i = 0; i < P.shapes; ++i) {
+            long long h = rng.range(m.minW, m.maxW), l = rng.range(h, m.maxW);
+            long long gap = m.S + rng.range(0, 2 * extra);
+            if (rng.chance(P.violationRate)) {
+                switch (rng.below(3)) {
+                case 0: if (m.hasMin && m.minW > 1) { h = std::max<long long>(1, m.minW - 1 - rng.below(m.minW / 3 + 1)); break; } [[fallthrough]];
+                case 1: if (m.hasMax) { l = m.maxW + 1 + rng.below(m.maxW); break; } [[fallthrough]];
+                default: if (m.hasS && m.S > 1) gap = rng.range(1, m.S - 1); break;
+                }
+            }
+            if (x > 0) x += gap;
+            if (x + l > W) { x = 0; y += m.pitch; }
+            put(m.name, x, y, x + l, y + h);
+            x += l;
+        }
+        top = std::max(top, y + m.pitch);
+    }
+
+    // ---- via 與上下 pad ----
+    struct ViaRule { std::string name; const RuleSet::Encl* e; };
+    std::vector<ViaRule> vias;
+    for (const auto& kv : rules.via_encl_map) vias.push_back({kv.first, &kv.second});
+    std::sort(vias.begin(), vias.end(), [](const ViaRule& a, const ViaRule& b){ return a.name < b.name; });
+
+    auto metalOf = [&](const std::string& name) -> const Metal* {
+        for (const auto& m : metals) if (m.name == name) return &m;
+        return nullptr;
+    };
+    long long maxS = 1;
+    for (const auto& m : metals) maxS = std::max(maxS, m.S);
+
+    const long long vs = 10;                                  // via 邊長
+    const long long nVia = (long long)std::llround(P.viaRatio * (double)P.shapes);
+    long long y = top + maxS;
+    for (const auto& v : vias) {
+        const long long enc = std::max(0, v.e->min_enclose);
+        // pad 邊長 = via + 兩側包覆，再夾進該層的線寬範圍
+        auto padSide = [&](const std::string& layer){
+            long long side = vs + 2 * enc;
+            if (const Metal* m = metalOf(layer)) side = std::min(std::max(side, m->minW), m->maxW);
+            return side;
+        };
+        const long long su = padSide(v.e->under), so = padSide(v.e->over);
+        const long long pitch = std::max(su, so) + maxS;
+        const long long perRow = std::max<long long>(1, W / pitch);
+        for (long long i = 0; i < nVia; ++i) {
+            const long long cx = (i % perRow) * pitch + pitch / 2, cy = y + (i / perRow) * pitch + pitch / 2;
+            long long vx = cx - vs / 2;
+            if (enc > 0 && rng.chance(P.violationRate)) vx -= rng.range(1, enc);
+            put(v.e->under, cx - su / 2, cy - su / 2, cx - su / 2 + su, cy - su / 2 + su);
+            put(v.e->over,  cx - so / 2, cy - so / 2, cx - so / 2 + so, cy - so / 2 + so);
+            put(v.name, vx, cy - vs / 2, vx + vs, cy - vs / 2 + vs);
+        }
+        if (nVia > 0) y += ((nVia - 1) / perRow + 1) * pitch;
+    }
+    G.die = {0, 0, (int)W, (int)std::max(y, top)};
+    return G;
+}
+
+// "100K" / "2M" / "1000"
+bool parseCount(const std::string& s, long long& n){
+    if (s.empty()) return false;
+    size_t pos = 0;
+    double v;
+    try { v = std::stod(s, &pos); } catch (const std::exception&) { return false; }
+    std::string suf = s.substr(pos);
+    if (suf == "K" || suf == "k") v *= 1e3;
+    else if (suf == "M" || suf == "m") v *= 1e6;
+    else if (suf == "G" || suf == "g") v *= 1e9;
+    else if (!suf.empty()) return false;
+    n = (long long)std::llround(v);
+    return n > 0;
+}
+
+double msSince(std::chrono::steady_clock::time_point t0){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+} // namespace
+
+
+int main(int argc, char** argv){
+    GenParams base;
+    std::vector<long long> sizes;
+    std::string rulesFile = "rules.json", workDir = ".", outFile;
+    int threads = 1;
+    bool keep = false, noParse = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) { std::cerr << a << " 需要參數\n"; std::exit(1); }
+            return argv[++i];
+        };
+        try {
+            if (a == "--sizes") {
+                std::string list = next();
+                for (size_t p = 0; p <= list.size();) {
+                    size_t q = std::min(list.find(',', p), list.size());
+                    long long n;
+                    if (!parseCount(list.substr(p, q - p), n)) { std::cerr << "size 格式錯誤: " << list << "\n"; return 1; }
+                    sizes.push_back(n);
+                    p = q + 1;
+                }
+            }
+            else if (a == "--fill")       base.fill = std::stod(next());
+            else if (a == "--via-ratio")  base.viaRatio = std::stod(next());
+            else if (a == "--violations") base.violationRate = std::stod(next());
+            else if (a == "--seed")       base.seed = std::stoull(next());
+            else if (a == "--rules")      rulesFile = next();
+            else if (a == "--threads")    threads = std::stoi(next());
+            else if (a == "--work")       workDir = next();
+            else if (a == "--out")        outFile = next();
+            else if (a == "--keep")       keep = true;
+            else if (a == "--no-parse")   noParse = true;
+            else { std::cerr << "未知參數: " << a << "\n"; return 1; }
+        } catch (const std::exception&) {
+            std::cerr << a << " 的參數格式錯誤\n";
+            return 1;
+        }
+    }
+    if (sizes.empty()) sizes = {1000, 10000, 100000};
+
+    RuleSet rules;
+    try {
+        rules = readRules(rulesFile);
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+
+    json runs = json::array();
+    for (long long n : sizes) {
+        GenParams P = base;
+        P.shapes = n;
+        const std::string stem = workDir + "/bench_" + std::to_string(n);
+        const std::string layoutPath = stem + ".txt", reportPath = stem + "_report.txt",
+                          csvPath = stem + "_fail_table.csv";
+        std::cerr << "bench: " << n << " shapes/layer ...\n";
+
+        json ms = json::object();
+        auto t0 = std::chrono::steady_clock::now();
+
+        // 1) 產生：寫成文字檔再 parse；--no-parse 時直接放進 ShapeStore（省下數 GB 的檔案）
+        ShapeStore store;
+        store.layers = layerTableFor(rules);
+        GenResult G;
+        long long bytes = 0;
+        if (noParse) {
+            G = generateLayout(rules, P, [&](const std::string& layer, int x1,int y1,int x2,int y2){
+                store.add(store.layers.intern(layer), x1, y1, x2, y2);
+            });
+            ms["generate"] = msSince(t0);
+            ms["parse"] = nullptr;
+        } else {
+            {
+                BufferedWriter out(layoutPath);
+                if (!out.ok()) { std::cerr << "ERROR: cannot write " << layoutPath << "\n"; return 1; }
+                G = generateLayout(rules, P, [&](const std::string& layer, int x1,int y1,int x2,int y2){
+                    out.put(layer);
+                    for (int c : {x1, y1, x2, y2}) { out.put(' '); out.putInt(c); }
+                    out.put('\n');
+                });
+            }
+            ms["generate"] = msSince(t0);
+            bytes = (long long)std::ifstream(layoutPath, std::ios::binary | std::ios::ate).tellg();
+
+            t0 = std::chrono::steady_clock::now();
+            std::vector<ParseError> errs;
+            store = readLayout(layoutPath, rules, &errs);
+            ms["parse"] = msSince(t0);
+            if (!errs.empty()) { std::cerr << "ERROR: generated layout has " << errs.size() << " bad lines\n"; return 1; }
+        }
+        const Box& die = G.die;
+
+        // 2) 索引與各項 check（單執行緒，逐項分開計時）
+        t0 = std::chrono::steady_clock::now();
+        const BoundRules bound = bindRules(rules, store.layers);
+        SpacingIndex spacingIndex = buildSpacingIndex(store, bound);
+        EnclosureIndex enclIndex = buildEnclosureIndex(store, bound);
+        ms["index"] = msSince(t0);
+
+        std::vector<Violation> V;
+        json counts = json::object();
+        auto stage = [&](const char* name, const char* type, auto&& fn){
+            size_t before = V.size();
+            auto s0 = std::chrono::steady_clock::now();
+            fn();
+            ms[name] = msSince(s0);
+            counts[type] = V.size() - before;
+        };
+        stage("width",     "WIDTH",     [&]{ check_min_width(store, rules, V); });
+        stage("spacing",   "SPACING",   [&]{ check_min_spacing(store, rules, spacingIndex, V); });
+        stage("enclosure", "ENCLOSURE", [&]{ check_via_enclosure_multi(store, rules, enclIndex, V); });
+        stage("density",   "DENSITY",   [&]{ check_density(store, rules, die.x1,die.y1,die.x2,die.y2, V); });
+        counts["PASS"] = std::count_if(V.begin(), V.end(), [](const Violation& v){ return v.pass; });
+        counts["total"] = V.size();
+
+        // 四項依序串起來就是 run_drc 的排序，報表與主程式逐位相同
+        t0 = std::chrono::steady_clock::now();
+        writeDRCReport(reportPath, V);
+        writeDRCReportTable(csvPath, V);
+        ms["report"] = msSince(t0);
+
+        // 3) 完整的 run_drc（含建索引），用 --threads
+        t0 = std::chrono::steady_clock::now();
+        const size_t total = run_drc(store, rules, die.x1,die.y1,die.x2,die.y2, threads).size();
+        ms["run_drc"] = msSince(t0);
+        if (total != V.size())
+            std::cerr << "WARNING: run_drc found " << total << " violations, stages found " << V.size() << "\n";
+
+        // 4) 融合掃描（每層一趟，含 density）
+        t0 = std::chrono::steady_clock::now();
+        const size_t fusedTotal = run_drc_fused(store, rules, die.x1,die.y1,die.x2,die.y2).size();
+        ms["run_drc_fused"] = msSince(t0);
+        if (fusedTotal != V.size())
+            std::cerr << "WARNING: run_drc_fused found " << fusedTotal << " violations, stages found " << V.size() << "\n";
+
+        // 5) 合併 region 後再查（pad 與線重疊，違規數本來就不同，只記下來）
+        t0 = std::chrono::steady_clock::now();
+        const size_t mergedTotal = run_drc_merged(store, rules, die.x1,die.y1,die.x2,die.y2).size();
+        ms["run_drc_merged"] = msSince(t0);
+
+        const double checkMs = ms["width"].get<double>() + ms["spacing"].get<double>() +
+                               ms["enclosure"].get<double>() + ms["density"].get<double>();
+        runs.push_back({
+            {"shapes_per_layer", n}, {"shapes", store.count}, {"layers", store.numLayers()},
+            {"die", {die.x1, die.y1, die.x2, die.y2}}, {"layout_bytes", bytes},
+            {"violations", counts}, {"merged_violations", mergedTotal}, {"ms", ms},
+            {"shapes_per_sec", checkMs > 0 ? store.count / (checkMs / 1000.0) : 0.0}
+        });
+
+        if (!keep)
+            for (const auto& f : {layoutPath, reportPath, csvPath}) std::remove(f.c_str());
+    }
+
+    json result = {
+        {"tool", "drc-bench"}, {"rules", rulesFile}, {"seed", base.seed}, {"fill", base.fill},
+        {"via_ratio", base.viaRatio}, {"violation_rate", base.violationRate},
+        {"threads", ThreadPool::resolveThreads(threads)}, {"parse", !noParse}, {"runs", runs}
+    };
+    if (outFile.empty()) { std::cout << result.dump(2) << "\n"; return 0; }
+    std::ofstream out(outFile);
+    if (!out.is_open()) { std::cerr << "ERROR: cannot write " << outFile << "\n"; return 1; }
+    out << result.dump(2) << "\n";
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cmath>
 #include <algorithm>
 #include <unordered_map>
@@ -13,16 +14,99 @@
 
 using json = nlohmann::json;
 
-struct Shape { std::string layer; int x1,y1,x2,y2; };
+static constexpr double EPS = 1e-9;   // 浮點比較容忍值（density、spacing 距離）
+
+// ---- 層名 ↔ 小整數 ID ----
+// 一份 deck 的層數很少（幾十層），線性比對比 hash 快，查詢時也不必先配置 std::string。
+// layout 的層名可以直接寫 GDS layer number（layer_mapping 的值，如 "1"）：alias 記下 "1" → "M1"，
+// find / intern 先換成 rules.json 的層名，同一個實體層只會有一個 ID，報表也印正名。
+struct LayerTable {
+    std::vector<std::string> names;
+    std::vector<std::pair<std::string, std::string>> alias;   // 層號 → 層名（layerTableFor 填）
+
+    std::string_view canonical(std::string_view name) const {
+        for (const auto& a : alias)
+            if (a.first == name) return a.second;
+        return name;
+    }
+    int find(std::string_view name) const {
+        name = canonical(name);
+        for (size_t i = 0; i < names.size(); ++i)
+            if (names[i] == name) return (int)i;
+        return -1;
+    }
+    int intern(std::string_view name) {
+        name = canonical(name);
+        int id = find(name);
+        if (id >= 0) return id;
+        names.emplace_back(name);
+        return (int)names.size() - 1;
+    }
+    size_t size() const { return names.size(); }
+};
+
+struct Shape { int layer; int x1,y1,x2,y2; };   // layer = LayerTable 裡的 ID
+
+// ---- Shape 儲存：每層一組 SoA 陣列 ----
+// 同層座標連續存放（x1[]、y1[]、x2[]、y2[]），check 的內層迴圈一路順著陣列掃，
+// 對 cache / 向量化友善；每個 shape 只佔 4 個座標 + 1 個全域 index = 20 bytes。
+struct LayerShapes {
+    std::vector<int> x1, y1, x2, y2;
+    std::vector<int> idx;          // layout 檔中的全域 index（報表、排序用），層內遞增
+
+    size_t size() const { return idx.size(); }
+    Shape at(int layer, size_t k) const { return {layer, x1[k], y1[k], x2[k], y2[k]}; }
+    // 不是依 idx 遞增時（別名把兩層併在一起、二進位檔依層回呼）排回來
+    void sortByIdx(){
+        if (std::is_sorted(idx.begin(), idx.end())) return;
+        std::vector<size_t> ord(size());
+        for (size_t k = 0; k < ord.size(); ++k) ord[k] = k;
+        std::sort(ord.begin(), ord.end(), [&](size_t a, size_t b){ return idx[a] < idx[b]; });
+        for (auto* col : {&x1, &y1, &x2, &y2, &idx}) {
+            std::vector<int> v(ord.size());
+            for (size_t k = 0; k < ord.size(); ++k) v[k] = (*col)[ord[k]];
+            *col = std::move(v);
+        }
+    }
+};
+
+struct ShapeStore {
+    LayerTable layers;
+    std::vector<LayerShapes> byLayer;   // byLayer[layer ID]
+    size_t count = 0;                   // 全部 shape 數
+
+    // idx < 0 代表「下一個」全域 index（依讀入順序）
+    void add(int layer, int x1,int y1,int x2,int y2, long long idx = -1){
+        if ((size_t)layer >= byLayer.size()) byLayer.resize(layer + 1);
+        LayerShapes& L = byLayer[layer];
+        L.x1.push_back(x1); L.y1.push_back(y1);
+        L.x2.push_back(x2); L.y2.push_back(y2);
+        L.idx.push_back((int)(idx < 0 ? (long long)count : idx));
+        ++count;
+    }
+    Shape shape(int layer, size_t k) const { return byLayer[layer].at(layer, k); }
+    const std::string& layerName(int id) const { return layers.names[id]; }
+    // 沒有這層（或這層沒有 shape）回傳 nullptr
+    const LayerShapes* find(std::string_view name) const {
+        int id = layers.find(name);
+        return (id >= 0 && (size_t)id < byLayer.size()) ? &byLayer[id] : nullptr;
+    }
+    int numLayers() const { return (int)byLayer.size(); }
+};
 struct Label { std::string name, layer; int x,y; };
+struct Box   { int x1,y1,x2,y2; };   // die / tile / 查詢範圍
 
 // ---- 規則 ----
 struct RuleSet {
-    int min_spacing_M1, min_spacing_M2;
-    int min_width_M1,   min_width_M2;
-    int max_width_M1,   max_width_M2;
-    int via_enclose;
+    // 單層規則；-1 代表這層沒有這條規則
+    struct LayerRule { int min_width = -1, max_width = -1, min_spacing = -1; };
+
+    std::vector<std::string> layers;                            // "layers"：deck 宣告的層
+    std::unordered_map<std::string, int> layer_mapping;         // "layer_mapping"：層名 → GDS layer number
+    std::unordered_map<std::string, LayerRule> layer_rules;     // min_width / max_width / min_spacing
+
     int density_window;
+    int density_step;       // 滑動視窗步距；預設 = density_window（不重疊的固定切格）
     double min_density;
 
     
@@ -35,13 +119,71 @@ struct RuleSet {
     std::unordered_set<std::string> density_layers;
 };
 
+// 帶 rules 的 layer_mapping 別名的空層表；解析 layout 前先用它當層表。
+// 層號字串本身就是某條規則的層名時不當別名（跟規則直接以它為名的層對上）
+inline LayerTable layerTableFor(const RuleSet& rules){
+    LayerTable t;
+    for (const auto& kv : rules.layer_mapping){
+        std::string num = std::to_string(kv.second);
+        if (rules.layer_rules.count(num) || rules.via_encl_map.count(num) ||
+            rules.conductive_layers.count(num)) continue;
+        t.alias.emplace_back(std::move(num), kv.first);
+    }
+    return t;
+}
+
+// ---- 規則綁到某份 layout 的 layer ID ----
+// 規則表以層名為 key，check 的內層迴圈改查以 layer ID 索引的陣列，不再比對字串。
+// 層號別名在解析時已經換成層名（layerTableFor），這裡只比對層名。
+struct BoundRules {
+    struct Via {
+        int via, under, over, min_enclose, rank;   // ID 為 -1 = layout 沒有這層
+        const std::string* name;                   // 報表用 rules.json 裡的層名
+        const RuleSet::Encl* rule;
+    };
+
+    struct Conn { int via, under, over; };          // via_conn；ID 為 -1 = layout 沒有這層
+
+    std::vector<RuleSet::LayerRule> layer;   // layer[ID]
+    std::vector<char> density;               // density[ID]：是否納入密度計算
+    std::vector<char> conductive;            // conductive[ID]：是否參與連線萃取
+    std::vector<Via> vias;                   // 依 via_encl_map 的走訪順序，rank 即其序號
+    std::vector<Conn> conns;
+};
+
+inline BoundRules bindRules(const RuleSet& rules, const LayerTable& layers){
+    const int n = (int)layers.size();
+    BoundRules b;
+    b.layer.resize(n);
+    b.density.assign(n, 0);
+    b.conductive.assign(n, 0);
+    for (int id = 0; id < n; ++id) {
+        const std::string& name = layers.names[id];
+        auto it = rules.layer_rules.find(name);
+        if (it != rules.layer_rules.end()) b.layer[id] = it->second;
+        b.density[id] = rules.density_layers.count(name) ? 1 : 0;
+        b.conductive[id] = rules.conductive_layers.count(name) ? 1 : 0;
+    }
+    auto lookup = [&](const std::string& name){ return layers.find(name); };
+    int rank = 0;
+    for (const auto& kv : rules.via_encl_map)
+        b.vias.push_back({lookup(kv.first), lookup(kv.second.under), lookup(kv.second.over),
+                          kv.second.min_enclose, rank++, &kv.first, &kv.second});
+    for (const auto& kv : rules.via_conn)
+        b.conns.push_back({lookup(kv.first), lookup(kv.second[0]), lookup(kv.second[1])});
+    return b;
+}
+
 
 // ---- DSU ----
+// find 用迭代的 path halving（上千萬個 shape 串成長鏈也不會爆 stack）；
+// rank 最多 log2(n) 所以用 1 byte，parent 陣列連續存放、每個節點 5 bytes。
 struct DSU{
-    std::vector<int> p, r;
+    std::vector<int> p;
+    std::vector<unsigned char> r;
     DSU(int n=0){ reset(n); }
     void reset(int n){ p.resize(n); r.assign(n,0); for(int i=0;i<n;++i)p[i]=i; }
-    int find(int x){ return p[x]==x?x:p[x]=find(p[x]); }
+    int find(int x){ while(p[x]!=x){ p[x]=p[p[x]]; x=p[x]; } return x; }
     void unite(int a,int b){ a=find(a); b=find(b); if(a==b) return; if(r[a]<r[b]) std::swap(a,b); p[b]=a; if(r[a]==r[b]) r[a]++; }
 };
 
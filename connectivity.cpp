@@ -0,0 +1,97 @@
+#include "connectivity.hpp"
+#include "spatial.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+
+// metal 層中與 s 相接（含邊界）的 shape，逐一呼叫 fn(層內序號)
+template<class F>
+static void forTouching(const ShapeStore& store, const LayerGrid& grid, int metal,
+                        const Shape& s, std::vector<int>& cand, F&& fn){
+    grid.query(std::min(s.x1, s.x2), std::min(s.y1, s.y2),
+               std::max(s.x1, s.x2), std::max(s.y1, s.y2), cand);
+    const LayerShapes& M = store.byLayer[metal];
+    for (int m : cand)
+        if (touchOrOverlap(s, M.at(metal, m))) fn(m);
+}
+
+Netlist extractNets(const ShapeStore& store, const RuleSet& rules,
+                    const std::vector<Label>& labels, ThreadPool* pool)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    const int nl = store.numLayers();
+    auto conductive = [&](int id){ return id >= 0 && id < nl && bound.conductive[id]; };
+
+    Netlist nets;
+    nets.base.assign(nl + 1, 0);
+    for (int id = 0; id < nl; ++id)
+        nets.base[id + 1] = nets.base[id] + store.byLayer[id].size();
+    const size_t N = nets.base[nl];
+
+    // 1) 每個導電層一張網格
+    std::vector<LayerGrid> grids(nl);
+    for (int id = 0; id < nl; ++id){
+        if (!conductive(id) || store.byLayer[id].size() == 0) continue;
+        LayerGrid* g = &grids[id];
+        const LayerShapes* L = &store.byLayer[id];
+        auto build = [g, L]{ *g = LayerGrid(*L, 1); };
+        if (pool) pool->submit(build); else build();
+    }
+    if (pool) pool->wait();
+
+    DSU dsu((int)N);
+    std::vector<int> cand;
+
+    // 2) 同層相接：只和層內序號較大的候選比，每對只看一次
+    for (int id = 0; id < nl; ++id){
+        if (!conductive(id)) continue;
+        const LayerShapes& L = store.byLayer[id];
+        const int b = (int)nets.base[id];
+        for (size_t k = 0; k < L.size(); ++k)
+            forTouching(store, grids[id], id, L.at(id, k), cand, [&](int m){
+                if ((size_t)m > k) dsu.unite(b + (int)k, b + m);
+            });
+    }
+
+    // 3) via 與上下層金屬相接
+    for (const auto& c : bound.conns){
+        if (!conductive(c.via)) continue;
+        const LayerShapes& V = store.byLayer[c.via];
+        const int bv = (int)nets.base[c.via];
+        for (int metal : {c.under, c.over}){
+            if (!conductive(metal)) continue;
+            const int bm = (int)nets.base[metal];
+            for (size_t k = 0; k < V.size(); ++k)
+                forTouching(store, grids[metal], metal, V.at(c.via, k), cand, [&](int m){
+                    dsu.unite(bv + (int)k, bm + m);
+                });
+        }
+    }
+
+    // 4) 依最小節點編號給 net 編號
+    nets.netOf.assign(N, -1);
+    std::vector<int> netOfRoot(N, -1);
+    for (int id = 0; id < nl; ++id){
+        if (!conductive(id)) continue;
+        for (size_t v = nets.base[id]; v < nets.base[id + 1]; ++v){
+            int r = dsu.find((int)v);
+            if (netOfRoot[r] < 0) { netOfRoot[r] = nets.numNets++; nets.netSize.push_back(0); }
+            nets.netOf[v] = netOfRoot[r];
+            nets.netSize[netOfRoot[r]]++;
+        }
+    }
+
+    // 5) label 掛到它所在的 shape 的 net（同點有多個 shape 時它們本來就相接，同一條 net）
+    //    label 的層名跟 layout 一樣可以寫 layer number，經同一份 layer_mapping 換成層名
+    const LayerTable aliases = layerTableFor(rules);
+    nets.labelNet.assign(labels.size(), -1);
+    for (size_t i = 0; i < labels.size(); ++i){
+        const Label& lb = labels[i];
+        int id = store.layers.find(aliases.canonical(lb.layer));
+        if (!conductive(id)) continue;
+        const LayerShapes& L = store.byLayer[id];
+        grids[id].query(lb.x, lb.y, lb.x, lb.y, cand);
+        for (int m : cand)
+            if (contains(L.at(id, m), lb.x, lb.y)) { nets.labelNet[i] = nets.net(id, (size_t)m); break; }
+    }
+    return nets;
+}
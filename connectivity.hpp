@@ -0,0 +1,24 @@
+#pragma once
+#include "common.hpp"
+#include <vector>
+
+// ---- 連線萃取（net extraction）----
+// 只看 conductive_layers：同層相接 / 重疊（含邊界）的 shape 併成同一條 net，
+// via 與 via_conn 指定的 under / over 金屬相接時也併起來；併查集用 common.hpp 的 DSU。
+// 相接的候選用每層一張 LayerGrid 查（與 spacing / enclosure 同一套網格），整體接近線性。
+// label 落在某層 shape 上（含邊界）時掛到那條 net。
+
+struct Netlist {
+    std::vector<size_t> base;    // shape (layer, k) 的節點編號 = base[layer] + k
+    std::vector<int> netOf;      // netOf[節點]；非導電層的 shape = -1
+    int numNets = 0;             // net 依「最小節點編號」遞增編號，結果與執行緒數無關
+    std::vector<int> netSize;    // 每條 net 的 shape 數
+    std::vector<int> labelNet;   // labelNet[第 i 個 label]；沒落在任何導電 shape 上 = -1
+
+    int net(int layer, size_t k) const { return netOf[base[layer] + k]; }
+};
+
+class ThreadPool;
+// 有 pool 時各層網格平行建；併查集本身是單執行緒
+Netlist extractNets(const ShapeStore& store, const RuleSet& rules,
+                    const std::vector<Label>& labels = {}, ThreadPool* pool = nullptr);
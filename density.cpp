@@ -0,0 +1,149 @@
+#include "density.hpp"
+#include <numeric>
+#include <algorithm>
+
+DensityMap::DensityMap(const ShapeStore& store, const RuleSet& rules,
+                       int die_x1,int die_y1,int die_x2,int die_y2, int tile_)
+    : DensityMap(die_x1, die_y1, die_x2, die_y2, tile_)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    for (int id = 0; id < store.numLayers(); ++id){
+        if (!bound.density[id]) continue;
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k) add(L.x1[k], L.y1[k], L.x2[k], L.y2[k]);
+    }
+    finish();
+}
+
+DensityMap::DensityMap(int die_x1,int die_y1,int die_x2,int die_y2, int tile_)
+    : dx1(die_x1), dy1(die_y1), dx2(die_x2), dy2(die_y2), tile(std::max(1, tile_)),
+      nx(0), ny(0)
+{
+    if (dx2 > dx1) nx = (int)(((long long)dx2 - dx1 + tile - 1) / tile);
+    if (dy2 > dy1) ny = (int)(((long long)dy2 - dy1 + tile - 1) / tile);
+    sat.assign((size_t)(nx + 1) * (ny + 1), 0);
+}
+
+DensityMap::DensityMap(std::vector<int> xs_, std::vector<int> ys_)
+    : dx1(xs_.front()), dy1(ys_.front()), dx2(xs_.back()), dy2(ys_.back()), tile(0),
+      nx((int)xs_.size() - 1), ny((int)ys_.size() - 1), xs(std::move(xs_)), ys(std::move(ys_))
+{
+    sat.assign((size_t)(nx + 1) * (ny + 1), 0);
+}
+
+// 光柵化：每個 shape 只碰它覆蓋的 tile，面積先放在 at(i+1, j+1)
+void DensityMap::add(int x1,int y1,int x2,int y2){
+    if (nx == 0 || ny == 0) return;
+    x1 = std::max(x1, dx1); y1 = std::max(y1, dy1);
+    x2 = std::min(x2, dx2); y2 = std::min(y2, dy2);
+    if (x2 <= x1 || y2 <= y1) return;
+
+    auto at = [&](int i, int j) -> long long& { return sat[(size_t)j * (nx + 1) + i]; };
+    auto tx = [&](int i){ return tile ? (int)std::min<long long>((long long)dx1 + (long long)i * tile, dx2) : xs[i]; };
+    auto ty = [&](int j){ return tile ? (int)std::min<long long>((long long)dy1 + (long long)j * tile, dy2) : ys[j]; };
+    int i1 = colOf(x1), i2 = colOf(x2 - 1);
+    int j1 = rowOf(y1), j2 = rowOf(y2 - 1);
+    for (int j = j1; j <= j2; ++j){
+        long long h = (long long)std::min(y2, ty(j + 1)) - std::max(y1, ty(j));
+        for (int i = i1; i <= i2; ++i){
+            long long w = (long long)std::min(x2, tx(i + 1)) - std::max(x1, tx(i));
+            at(i + 1, j + 1) += w * h;
+        }
+    }
+}
+
+// 2D prefix sum
+void DensityMap::finish(){
+    auto at = [&](int i, int j) -> long long& { return sat[(size_t)j * (nx + 1) + i]; };
+    for (int j = 1; j <= ny; ++j)
+        for (int i = 1; i <= nx; ++i)
+            at(i, j) += at(i - 1, j) + at(i, j - 1) - at(i - 1, j - 1);
+}
+
+int DensityMap::colOf(int x) const {
+    if (x >= dx2) return nx;
+    if (!tile) return (int)(std::upper_bound(xs.begin(), xs.end(), x) - xs.begin()) - 1;
+    return (int)(((long long)x - dx1) / tile);
+}
+int DensityMap::rowOf(int y) const {
+    if (y >= dy2) return ny;
+    if (!tile) return (int)(std::upper_bound(ys.begin(), ys.end(), y) - ys.begin()) - 1;
+    return (int)(((long long)y - dy1) / tile);
+}
+
+long long DensityMap::area(int x1,int y1,int x2,int y2) const {
+    int i1 = colOf(x1), i2 = colOf(x2);
+    int j1 = rowOf(y1), j2 = rowOf(y2);
+    auto at = [&](int i, int j){ return sat[(size_t)j * (nx + 1) + i]; };
+    return at(i2, j2) - at(i1, j2) - at(i2, j1) + at(i1, j1);
+}
+
+
+std::vector<DensityWindow> densityWindows(const ShapeStore& store, const RuleSet& rules,
+                                          int die_x1,int die_y1,int die_x2,int die_y2,
+                                          int ox1,int oy1,int ox2,int oy2)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    auto feed = [&](DensityMap& map){
+        for (int id = 0; id < store.numLayers(); ++id){
+            if (!bound.density[id]) continue;
+            const LayerShapes& L = store.byLayer[id];
+            for (size_t k = 0; k < L.size(); ++k) map.add(L.x1[k], L.y1[k], L.x2[k], L.y2[k]);
+        }
+    };
+    return densityWindows(feed, rules, die_x1,die_y1,die_x2,die_y2, ox1,oy1,ox2,oy2);
+}
+
+std::vector<DensityWindow> densityWindows(const std::function<void(DensityMap&)>& feed, const RuleSet& rules,
+                                          int die_x1,int die_y1,int die_x2,int die_y2,
+                                          int ox1,int oy1,int ox2,int oy2)
+{
+    std::vector<DensityWindow> out;
+    const int W = rules.density_window;
+    const int step = rules.density_step > 0 ? rules.density_step : W;
+    if (W <= 0) return out;
+
+    // 格點 die_x1 + k*step 中落在 [o1, min(o2, die2)) 的第一個與最後一個
+    auto span = [&](long long d1, long long d2, long long o1, long long o2,
+                    long long& first, long long& last){
+        long long k = o1 > d1 ? (o1 - d1 + step - 1) / step : 0;
+        first = d1 + k * step;
+        long long end = std::min(o2, d2);
+        if (first >= end) return false;
+        last = first + (end - 1 - first) / step * step;
+        return true;
+    };
+    long long fx, lx, fy, ly;
+    if (!span(die_x1, die_x2, ox1, ox2, fx, lx) || !span(die_y1, die_y2, oy1, oy2, fy, ly)) return out;
+
+    // 第一個 window 的左下角對齊 tile 格點，window 的右/上邊不是 tile 邊界就是 die 邊界
+    const long long ex = std::min<long long>(lx + W, die_x2), ey = std::min<long long>(ly + W, die_y2);
+    const long long tile = std::gcd(W, step);
+    const long long cells = ((ex - fx + tile - 1) / tile) * ((ey - fy + tile - 1) / tile);
+    const long long windows = ((lx - fx) / step + 1) * ((ly - fy) / step + 1);
+    auto edges = [&](long long first, long long last, long long end){
+        std::vector<int> v;
+        for (long long t = first; t <= last; t += step){ v.push_back((int)t); v.push_back((int)std::min(t + W, end)); }
+        v.push_back((int)end);
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+        return v;
+    };
+    DensityMap map = cells <= 16 * windows + 4096
+        ? DensityMap((int)fx, (int)fy, (int)ex, (int)ey, (int)tile)
+        : DensityMap(edges(fx, lx, ex), edges(fy, ly, ey));
+    feed(map);
+    map.finish();
+    for (long long y = fy; y <= ly; y += step){
+        for (long long x = fx; x <= lx; x += step){
+            int win_x2 = (int)std::min<long long>(x + W, die_x2);
+            int win_y2 = (int)std::min<long long>(y + W, die_y2);
+            DensityWindow w{(int)x, (int)y, win_x2, win_y2, 0, 0, 0.0};
+            w.win_area   = (long long)(win_x2 - x) * (win_y2 - y);
+            w.metal_area = map.area(w.x1, w.y1, w.x2, w.y2);
+            w.density    = w.win_area ? (double)w.metal_area / w.win_area : 0.0;
+            out.push_back(w);
+        }
+    }
+    return out;
+}
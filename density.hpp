@@ -0,0 +1,58 @@
+#pragma once
+#include "common.hpp"
+#include <vector>
+#include <climits>
+#include <functional>
+
+// ---- 密度引擎 ----
+// 把 die 切成 tile×tile 的小格（tile = gcd(window, step)），每個 density 層的 shape
+// 只光柵化一次：逐格累加 interArea，再做 2D prefix sum（summed-area table）。
+// 之後任何對齊 tile 邊界的 window 都是 O(1) 查面積。
+// gcd 太小（例如 step 與 window 互質）時小格數會跟 die 的面積走，改用各 window 的左 / 右、下 / 上邊當格線
+// （不等距），格數只跟 window 數成正比。
+// 和原本逐 window 掃 shape 一樣是「各 shape 面積相加」（重疊會重複計），結果逐位相同。
+class DensityMap {
+public:
+    // store 裡所有 density 層的 shape 都加進去並 finish()
+    DensityMap(const ShapeStore& store, const RuleSet& rules,
+               int die_x1,int die_y1,int die_x2,int die_y2, int tile);
+    // 空的 map：呼叫端自己 add() 每個矩形（例如階層 layout 邊展開邊加），最後 finish()
+    DensityMap(int die_x1,int die_y1,int die_x2,int die_y2, int tile);
+    // 不等距格線（各自遞增、不重複，至少兩條；頭尾就是範圍）
+    DensityMap(std::vector<int> xs, std::vector<int> ys);
+
+    void add(int x1,int y1,int x2,int y2);   // 裁到範圍內再光柵化；範圍外的直接略過
+    void finish();                           // 做 2D prefix sum，之後才能 area()
+    Box bounds() const { return {dx1, dy1, dx2, dy2}; }
+
+    // [x1,x2)×[y1,y2) 內的金屬面積；四個邊都必須落在格線或 die 邊界上
+    long long area(int x1,int y1,int x2,int y2) const;
+
+private:
+    int dx1, dy1, dx2, dy2, tile, nx, ny;   // tile = 0：格線不等距，見 xs / ys
+    std::vector<int> xs, ys;
+    std::vector<long long> sat;   // (ny+1)×(nx+1)，sat[j][i] = tile [0,i)×[0,j) 的面積和
+
+    int colOf(int x) const;
+    int rowOf(int y) const;
+};
+
+struct DensityWindow {
+    int x1, y1, x2, y2;
+    long long metal_area;
+    long long win_area;
+    double density;
+};
+
+// 依 rules.density_window / rules.density_step 產生 window（y 外層、x 內層，與舊版順序相同）。
+// window 格點永遠從 die 左下角起算；只回傳左下角落在 [ox1,ox2)×[oy1,oy2) 的那些，
+// 而且 summed-area table 只建在這些 window 涵蓋的範圍（tile 模式不必光柵化整顆 die）。
+std::vector<DensityWindow> densityWindows(const ShapeStore& store, const RuleSet& rules,
+                                          int die_x1,int die_y1,int die_x2,int die_y2,
+                                          int ox1 = INT_MIN, int oy1 = INT_MIN,
+                                          int ox2 = INT_MAX, int oy2 = INT_MAX);
+// 同上，但金屬由 feed(map) 自己 add 進去（不必先有 ShapeStore）；feed 可用 map.bounds() 略過範圍外的部分
+std::vector<DensityWindow> densityWindows(const std::function<void(DensityMap&)>& feed, const RuleSet& rules,
+                                          int die_x1,int die_y1,int die_x2,int die_y2,
+                                          int ox1 = INT_MIN, int oy1 = INT_MIN,
+                                          int ox2 = INT_MAX, int oy2 = INT_MAX);
@@ -1,7 +1,16 @@
 #include "drc.hpp"
+#include "spatial.hpp"
+#include "density.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include "stats.hpp"
+#include "geom.hpp"
 #include <climits>
+#include <memory>
 #include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <unordered_set>
 
 
 
@@ -21,137 +30,1032 @@ int enclosureMargin(const Shape& metal, const Shape& via) {
 }
 
 
+const std::string* internName(std::string_view s){
+    static std::mutex mu;
+    static std::unordered_set<std::string> pool;    // 元素的位址在 rehash 後不變
+    std::lock_guard<std::mutex> lk(mu);
+    return &*pool.emplace(s).first;
+}
+
+const char* violationType(const Violation& v){
+    static const char* const TYPES[] = {"WIDTH", "SPACING", "ENCLOSURE", "DENSITY"};
+    return TYPES[v.cat & 3];
+}
+
+const char* violationStatus(const Violation& v){ return v.pass ? "PASS" : "FAIL"; }
+
+std::string violationObject(const Violation& v){
+    if (v.cat == 0) return "idx=" + std::to_string(v.a);
+    if (v.cat == 1) return "(" + std::to_string(v.a) + "," + std::to_string(v.b) + ")";
+    if (v.cat == 3) return "[" + std::to_string(v.x1) + "," + std::to_string(v.y1) + "]";
+    return v.object ? *v.object : std::string();
+}
+
+std::string violationBBox(const Violation& v){
+    return v.cat == 1 ? std::string("-") : bboxStr({0, v.x1, v.y1, v.x2, v.y2});
+}
+
+std::string violationRule(const Violation& v){
+    if (v.cat == 3) return ">= " + std::to_string(v.threshold);
+    return (v.cat == 0 && v.sub == 1 ? "<= " : ">= ") + std::to_string((int)v.threshold);
+}
+
+static ViolationRecord record(int cat, long long a, long long b, int sub, int ref){
+    ViolationRecord r;
+    r.cat = (unsigned char)cat; r.a = a; r.b = b; r.sub = (unsigned char)sub; r.ref = ref;
+    return r;
+}
+static void setBox(ViolationRecord& r, const Shape& s){
+    r.x1 = s.x1; r.y1 = s.y1; r.x2 = s.x2; r.y2 = s.y2;
+}
+
+RecordContext::RecordContext(const LayerTable& layers, const BoundRules& bound){
+    for (const auto& name : layers.names) layer.push_back(internName(name));
+    for (const auto& cfg : bound.vias){
+        under.push_back(internName("UNDER " + cfg.rule->under));
+        over.push_back(internName("OVER " + cfg.rule->over));
+        via.push_back(internName(*cfg.name));
+    }
+}
+
+Violation toViolation(const ViolationRecord& r, const RecordContext& ctx){
+    static const std::string* const WINDOW = internName("window");
+    Violation v;
+    v.actual = r.actual; v.threshold = r.threshold;
+    v.x1 = r.x1; v.y1 = r.y1; v.x2 = r.x2; v.y2 = r.y2;
+    v.missing = r.missing; v.pass = r.pass;
+    v.cat = r.cat; v.a = r.a; v.b = r.b; v.sub = r.sub;
+    switch (r.cat){
+    case 0:
+        v.layer = ctx.layer[r.ref];
+        v.delta = r.sub == 0 ? r.threshold - r.actual : r.actual - r.threshold;
+        break;
+    case 1:
+        v.layer = ctx.layer[r.ref];
+        v.delta = r.threshold - r.actual;
+        break;
+    case 2:
+        v.layer  = r.sub == 0 ? ctx.under[r.ref] : ctx.over[r.ref];
+        v.object = ctx.via[r.ref];
+        v.delta  = r.missing ? r.threshold : r.threshold - r.actual;
+        break;
+    default:
+        v.layer = WINDOW;
+        v.delta = r.threshold - r.actual;
+        break;
+    }
+    return v;
+}
+
+
 // =================== DRC ===================
+// 每個 check 都拆成「某一層、層內序號 [k0,k1)」的區段版本：單執行緒時整層跑一次，
+// 平行時每段是一個 task。內層迴圈只順著該層的 SoA 陣列掃，不再比對層名字串。
+// 區段版本只產生 ViolationRecord，交給 out.push_back（收進 vector，或直接送進串流 sink）；
+// 違規最後依 (cat,a,b,sub) 排序，輸出順序與怎麼切無關，也和舊版逐 shape 掃的順序相同。
 
-void check_min_width(const std::vector<Shape>& shapes, const RuleSet& rules) {
-    for (size_t i = 0; i < shapes.size(); ++i) {
-        const auto& s = shapes[i];
-        int sw = shortSide(s);                 // 線寬（短邊）
-        int lw = std::max(rectW(s), rectH(s)); // 線長（長邊）
+// 收好的 record 排序後轉成 Violation 接在 out 後面
+static void appendSorted(std::vector<ViolationRecord>& R, const ShapeStore& store,
+                         const BoundRules& bound, std::vector<Violation>& out){
+    const RecordContext ctx(store.layers, bound);
+    std::stable_sort(R.begin(), R.end(), recordLess);
+    out.reserve(out.size() + R.size());
+    for (const auto& r : R) out.push_back(toViolation(r, ctx));
+}
+
+template<class Out>
+static void width_range(const ShapeStore& store, const BoundRules& rules, int layer,
+                        size_t k0, size_t k1, Out& out) {
+    const int minW = rules.layer[layer].min_width;
+    const int maxW = rules.layer[layer].max_width;
+    if (minW < 0 && maxW < 0) return;             // 這層沒有 width 規則
+    const LayerShapes& L = store.byLayer[layer];
+    StatsScope stats("width", store.layerName(layer));
 
-        // ---- 檢查 min_width ----
-        if (s.layer == "M1" && sw < rules.min_width_M1)
-            std::cout << "[WIDTH][M1] idx=" << i << " short=" << sw << " < " << rules.min_width_M1 << "\n";
+    auto push = [&](size_t k, int sub, int actual, int thr){
+        ViolationRecord r = record(0, L.idx[k], 0, sub, layer);
+        setBox(r, L.at(layer, k));
+        r.actual = actual; r.threshold = thr;
+        out.push_back(r);
+        stats.c.found++;
+    };
 
-        if (s.layer == "M2" && sw < rules.min_width_M2)
-            std::cout << "[WIDTH][M2] idx=" << i << " short=" << sw << " < " << rules.min_width_M2 << "\n";
+    // 整段先向量化粗篩，只有違規的 shape 才回來組報表（暫存每個執行緒重複使用，不必每段重新配置）
+    thread_local std::vector<int> hits;
+    widthScreen(L, k0, k1, minW, maxW, hits);
+    stats.c.visited += (long long)(k1 - k0);
+    stats.c.tested += (long long)hits.size();
+    for (int k : hits) {
+        int w = std::abs(L.x2[k] - L.x1[k]), h = std::abs(L.y2[k] - L.y1[k]);
+        int sw = std::min(w, h);               // 線寬（短邊）
+        int lw = std::max(w, h);               // 線長（長邊）
 
-        // ---- 檢查 max_width ----
-        if (s.layer == "M1" && lw > rules.max_width_M1)
-            std::cout << "[WIDTH][M1] idx=" << i << " width=" << lw << " > " << rules.max_width_M1 << "\n";
+        if (minW >= 0 && sw < minW) push(k, 0, sw, minW);   // ---- 檢查 min_width ----
+        if (maxW >= 0 && lw > maxW) push(k, 1, lw, maxW);   // ---- 檢查 max_width ----
+    }
+}
 
-        if (s.layer == "M2" && lw > rules.max_width_M2)
-            std::cout << "[WIDTH][M2] idx=" << i << " width=" << lw << " > " << rules.max_width_M2 << "\n";
+// 同層 shape 第 lo、hi 個（lo < hi）間距不足時記一筆
+template<class Out>
+static bool spacing_pair(const LayerShapes& L, int layer, size_t lo, size_t hi, int S, Out& out){
+    double d = rectSpacing(L.at(layer, lo), L.at(layer, hi));
+    if (d + EPS < S){
+        ViolationRecord r = record(1, L.idx[lo], L.idx[hi], 0, layer);
+        r.actual = d; r.threshold = S;
+        out.push_back(r);
+        return true;
     }
+    return false;
 }
 
+// 候選只取 bbox 外擴 min spacing 的範圍（同層、層內序號較大、遞增）
+template<class Out>
+static void spacing_range(const ShapeStore& store, const SpacingIndex& index, int layer,
+                          size_t k0, size_t k1, Out& out){
+    const LayerShapes& L = store.byLayer[layer];
+    const int S = index.spacing[layer];
+    const bool narrow = index.narrow[layer];
+    StatsScope stats("spacing", store.layerName(layer));
+    stats.c.visited += (long long)(k1 - k0);
+    thread_local std::vector<int> cand, hits;
+    for(size_t k=k0;k<k1;++k){
+        index.candidates(store, layer, k, cand);
+        if (cand.empty()) continue;
+        // 距離平方粗篩（不開根號）；留下來的才算真正的距離
+        spacingScreen(L.at(layer, k), L, cand.data(), cand.size(), S, narrow, hits);
+        stats.c.candidates += (long long)cand.size();
+        stats.c.tested += (long long)hits.size();
+        for(int j : hits) stats.c.found += spacing_pair(L, layer, k, (size_t)j, S, out);
+    }
+}
+
+// 第 k 個 via 的最佳包覆距離（沒有任何金屬接觸 = INT_MIN）→ UNDER / OVER 兩列；
+// cfg.rank = 這條 via 規則在 via_encl_map 的走訪順序
+template<class Out>
+static void enclosure_records(const BoundRules::Via& cfg, const LayerShapes& VL, size_t k,
+                              int best_under, int best_over, StageCounters& stats, Out& out){
+    static const bool SHOW_ALL_ENCLOSURE = false; // 改成 true 會連剛好等於規則（OK exact）的也記下來
+
+    const Shape v = VL.at(cfg.via, k);
+    const int need = cfg.min_enclose;
+
+    auto push_encl = [&](int sub, int best){
+        ViolationRecord e = record(2, cfg.rank, VL.idx[k], sub, cfg.rank);
+        setBox(e, v);
+        e.threshold = need;
+        if (best == INT_MIN) {
+            e.missing = 1;
+            out.push_back(e);
+            stats.found++;
+            return;
+        }
+
+        int diff = best - need;
+        if (!SHOW_ALL_ENCLOSURE && diff == 0) return; // OK，不列出
+
+        e.actual = best;
+        e.pass = diff >= 0;                          // 過包 / 剛好：不算違規
+        out.push_back(e);
+        stats.found += !e.pass;
+    };
+
+    push_encl(0, best_under);   // UNDER
+    push_encl(1, best_over);    // OVER
+}
+
+// 單一個 via（via 層第 k 個）的 UNDER / OVER 兩列
+template<class Out>
+static void enclosure_via(const ShapeStore& store, const EnclosureIndex& index,
+                          const BoundRules::Via& cfg, size_t k,
+                          std::vector<int>& cand, StageCounters& stats, Out& out){
+    const LayerShapes& VL = store.byLayer[cfg.via];
+    const Shape v = VL.at(cfg.via, k);
+
+    // 與 via 接觸（含邊界）的金屬中，最佳包覆距離；沒有任何金屬接觸回傳 INT_MIN
+    auto best_encl = [&](int metalId){
+        int best = INT_MIN;
+        index.candidates(store, cfg.via, k, metalId, cand);
+        if (cand.empty()) return best;
+        stats.candidates += (long long)cand.size();
+        const LayerShapes& M = store.byLayer[metalId];
+        for (int m : cand){
+            if (M.x2[m] < v.x1 || v.x2 < M.x1[m] || M.y2[m] < v.y1 || v.y2 < M.y1[m]) continue;
+            stats.tested++;
+            best = std::max(best, enclosureMargin(M.at(metalId, m), v));
+        }
+        return best;
+    };
+
+    // 找出最佳包覆距離
+    int best_under = best_encl(cfg.under);
+    int best_over  = best_encl(cfg.over);
+    enclosure_records(cfg, VL, k, best_under, best_over, stats, out);
+}
+
+// via 依 Morton 順序的第 [p0,p1) 個
+template<class Out>
+static void enclosure_range(const ShapeStore& store, const EnclosureIndex& index,
+                            const BoundRules::Via& cfg,
+                            size_t p0, size_t p1, Out& out){
+    if (cfg.via < 0) return; // layout 沒這層
+    const std::vector<int>& order = index.order[cfg.via];
+    StatsScope stats("enclosure", *cfg.name);
+    thread_local std::vector<int> cand;
+    for (size_t p = p0; p < p1 && p < order.size(); ++p){
+        enclosure_via(store, index, cfg, (size_t)order[p], cand, stats.c, out);
+        stats.c.visited++;
+    }
+}
 
-void check_min_spacing(const std::vector<Shape>& shapes, const RuleSet& rules){
-    for(size_t i=0;i<shapes.size();++i){
-        for(size_t j=i+1;j<shapes.size();++j){
-            if (shapes[i].layer != shapes[j].layer) continue;
-            double d = rectSpacing(shapes[i], shapes[j]);
-            if (shapes[i].layer=="M1" && d < rules.min_spacing_M1)
-                std::cout << "[SPACING][M1] ("<<i<<","<<j<<") d="<<d<<" < "<<rules.min_spacing_M1<<"\n";
-            if (shapes[i].layer=="M2" && d < rules.min_spacing_M2)
-                std::cout << "[SPACING][M2] ("<<i<<","<<j<<") d="<<d<<" < "<<rules.min_spacing_M2<<"\n";
+// 密度不足的 window 各記一筆
+template<class Out>
+static void density_records(const std::vector<DensityWindow>& windows, const RuleSet& rules,
+                            StageCounters& stats, Out& out)
+{
+    for (const auto& w : windows){
+        stats.visited++;
+        if (w.density + EPS < rules.min_density){
+            stats.found++;
+            ViolationRecord r = record(3, w.y1, w.x1, 0, 0);
+            r.x1 = w.x1; r.y1 = w.y1; r.x2 = w.x2; r.y2 = w.y2;
+            r.actual = w.density; r.threshold = rules.min_density;
+            out.push_back(r);
         }
     }
 }
 
+// 各 density 層只光柵化一次成 summed-area table，每個 window O(1)
+template<class Out>
+static void density_origins(const ShapeStore& store, const RuleSet& rules,
+                            int die_x1,int die_y1,int die_x2,int die_y2,
+                            int ox1,int oy1,int ox2,int oy2, Out& out)
+{
+    StatsScope stats("density");
+    density_records(densityWindows(store, rules, die_x1,die_y1,die_x2,die_y2, ox1,oy1,ox2,oy2),
+                    rules, stats.c, out);
+}
+
+// 建網格也算一個 stage（平行時 CPU time 只計呼叫端，wall time 才是整段）
+static SpacingIndex timedSpacingIndex(const ShapeStore& store, const BoundRules& bound, ThreadPool* pool){
+    StatsScope stats("index", "spacing");
+    return buildSpacingIndex(store, bound, pool);
+}
+
+static EnclosureIndex timedEnclosureIndex(const ShapeStore& store, const BoundRules& bound, ThreadPool* pool){
+    StatsScope stats("index", "enclosure");
+    return buildEnclosureIndex(store, bound, pool);
+}
+
+// 單執行緒依序跑完四項
+template<class Out>
+static void runChecksSerial(const ShapeStore& store, const RuleSet& rules, const BoundRules& bound,
+                            int die_x1,int die_y1,int die_x2,int die_y2, Out& out){
+    for (int id = 0; id < store.numLayers(); ++id)
+        width_range(store, bound, id, 0, store.byLayer[id].size(), out);
+    SpacingIndex index = timedSpacingIndex(store, bound, nullptr);
+    for (int id = 0; id < store.numLayers(); ++id)
+        if (index.spacing[id] >= 0)
+            spacing_range(store, index, id, 0, store.byLayer[id].size(), out);
+    EnclosureIndex enclIndex = timedEnclosureIndex(store, bound, nullptr);
+    for (const auto& via : bound.vias)
+        if (via.via >= 0)
+            enclosure_range(store, enclIndex, via, 0, store.byLayer[via.via].size(), out);
+    density_origins(store, rules, die_x1,die_y1,die_x2,die_y2, INT_MIN, INT_MIN, INT_MAX, INT_MAX, out);
+}
+
+
+void check_min_width(const ShapeStore& store, const RuleSet& rules,
+                     std::vector<Violation>& out) {
+    const BoundRules bound = bindRules(rules, store.layers);
+    std::vector<ViolationRecord> R;
+    for (int id = 0; id < store.numLayers(); ++id)
+        width_range(store, bound, id, 0, store.byLayer[id].size(), R);
+    appendSorted(R, store, bound, out);
+}
+
+void check_min_spacing(const ShapeStore& store, const RuleSet& rules,
+                       std::vector<Violation>& out){
+    // 每層建一次網格
+    check_min_spacing(store, rules, buildSpacingIndex(store, bindRules(rules, store.layers)), out);
+}
+
+void check_min_spacing(const ShapeStore& store, const RuleSet& rules, const SpacingIndex& index,
+                       std::vector<Violation>& out){
+    const BoundRules bound = bindRules(rules, store.layers);
+    std::vector<ViolationRecord> R;
+    for (int id = 0; id < store.numLayers(); ++id)
+        if (index.spacing[id] >= 0)
+            spacing_range(store, index, id, 0, store.byLayer[id].size(), R);
+    appendSorted(R, store, bound, out);
+}
+
 // =================== Enclosure Check ===================
 
-void check_via_enclosure_multi(const std::vector<Shape>& shapes, const RuleSet& rules){
-    static const bool SHOW_ALL_ENCLOSURE = false; // 改成 true 會列出所有 enclosure 狀況（含 OK）
+void check_via_enclosure_multi(const ShapeStore& store, const RuleSet& rules,
+                               std::vector<Violation>& out){
+    check_via_enclosure_multi(store, rules, buildEnclosureIndex(store, bindRules(rules, store.layers)), out);
+}
+
+void check_via_enclosure_multi(const ShapeStore& store, const RuleSet& rules,
+                               const EnclosureIndex& index, std::vector<Violation>& out){
+    const BoundRules bound = bindRules(rules, store.layers);
+    std::vector<ViolationRecord> R;
+    for (const auto& via : bound.vias)
+        if (via.via >= 0)
+            enclosure_range(store, index, via, 0, store.byLayer[via.via].size(), R);
+    appendSorted(R, store, bound, out);
+}
+
+
+void check_density(const ShapeStore& store, const RuleSet& rules,
+                   int die_x1,int die_y1,int die_x2,int die_y2,
+                   std::vector<Violation>& out)
+{
+    check_density_origins(store, rules, die_x1,die_y1,die_x2,die_y2,
+                          INT_MIN, INT_MIN, INT_MAX, INT_MAX, out);
+}
+
+void check_density_origins(const ShapeStore& store, const RuleSet& rules,
+                           int die_x1,int die_y1,int die_x2,int die_y2,
+                           int ox1,int oy1,int ox2,int oy2,
+                           std::vector<Violation>& out)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    std::vector<ViolationRecord> R;
+    density_origins(store, rules, die_x1,die_y1,die_x2,die_y2, ox1,oy1,ox2,oy2, R);
+    appendSorted(R, store, bound, out);
+}
+
+
+// =================== 平行執行 ===================
+// task = rule × layer × 層內區段；outFor() 給每個 task 一個輸出：
+// run_drc 是各自的 slot（全部做完後串起來依 (cat,a,b,sub) 排序，與單執行緒輸出逐位相同），
+// 串流時是共用的 sink。
+
+template<class OutFor>
+static void runChecksParallel(const ShapeStore& store, const RuleSet& rules, const BoundRules& bound,
+                              int die_x1,int die_y1,int die_x2,int die_y2,
+                              ThreadPool& pool, size_t chunk, OutFor outFor)
+{
+    // 逐層切段送進 pool
+    auto forChunks = [&](size_t n, auto&& submitChunk){
+        for (size_t c = 0; c * chunk < n; ++c)
+            submitChunk(outFor(), c * chunk, std::min(n, (c + 1) * chunk));
+    };
+
+    for (int id = 0; id < store.numLayers(); ++id)
+        forChunks(store.byLayer[id].size(), [&](auto* out, size_t k0, size_t k1){
+            pool.submit([&, id, out, k0, k1]{ width_range(store, bound, id, k0, k1, *out); });
+        });
+
+    auto* densityOut = outFor();
+    pool.submit([&, densityOut]{
+        density_origins(store, rules, die_x1,die_y1,die_x2,die_y2,
+                        INT_MIN, INT_MIN, INT_MAX, INT_MAX, *densityOut);
+    });
+
+    // enclosure / spacing 要等網格建好（各層網格本身也是 pool 裡的 task）
+    EnclosureIndex enclIndex = timedEnclosureIndex(store, bound, &pool);
+    SpacingIndex index = timedSpacingIndex(store, bound, &pool);
+    for (const auto& via : bound.vias){
+        if (via.via < 0) continue;
+        const BoundRules::Via* cfg = &via;
+        forChunks(store.byLayer[via.via].size(), [&](auto* out, size_t p0, size_t p1){
+            pool.submit([&, cfg, out, p0, p1]{ enclosure_range(store, enclIndex, *cfg, p0, p1, *out); });
+        });
+    }
+
+    for (int id = 0; id < store.numLayers(); ++id)
+        if (index.spacing[id] >= 0)
+            forChunks(store.byLayer[id].size(), [&](auto* out, size_t k0, size_t k1){
+                pool.submit([&, id, out, k0, k1]{ spacing_range(store, index, id, k0, k1, *out); });
+            });
+    pool.wait();
+}
+
+static size_t chunkSize(const ShapeStore& store, int threads){
+    return std::max<size_t>(2048, store.count / ((size_t)threads * 8) + 1);
+}
+
+std::vector<Violation> run_drc(const ShapeStore& store, const RuleSet& rules,
+                               int die_x1,int die_y1,int die_x2,int die_y2, int threads)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    std::vector<ViolationRecord> R;
+    threads = ThreadPool::resolveThreads(threads);
+    if (threads <= 1){
+        runChecksSerial(store, rules, bound, die_x1,die_y1,die_x2,die_y2, R);
+    } else {
+        ThreadPool pool(threads);
+        const size_t chunk = chunkSize(store, threads);
+        // slots 事先 reserve，push 時不會搬動別的 task 正在寫的 slot
+        std::vector<std::vector<ViolationRecord>> slots;
+        slots.reserve(4 * (store.count / chunk + store.numLayers() + rules.via_encl_map.size()) + 1);
+        runChecksParallel(store, rules, bound, die_x1,die_y1,die_x2,die_y2, pool, chunk,
+                          [&]{ slots.emplace_back(); return &slots.back(); });
+
+        size_t total = 0;
+        for (const auto& s : slots) total += s.size();
+        R.reserve(total);
+        for (const auto& s : slots) R.insert(R.end(), s.begin(), s.end());
+    }
+    std::vector<Violation> V;
+    appendSorted(R, store, bound, V);
+    return V;
+}
+
+namespace {
+struct SinkOut {
+    RecordSink& sink;
+    void push_back(const ViolationRecord& r){ sink.push(r); }
+};
+}
+
+void run_drc_stream(const ShapeStore& store, const RuleSet& rules,
+                    int die_x1,int die_y1,int die_x2,int die_y2, int threads, RecordSink& sink)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    SinkOut out{sink};
+    threads = ThreadPool::resolveThreads(threads);
+    if (threads <= 1){
+        runChecksSerial(store, rules, bound, die_x1,die_y1,die_x2,die_y2, out);
+        return;
+    }
+    ThreadPool pool(threads);
+    runChecksParallel(store, rules, bound, die_x1,die_y1,die_x2,die_y2, pool,
+                      chunkSize(store, threads), [&]{ return &out; });
+}
+
+
+// =================== 融合掃描 ===================
+// 每層一次 plane sweep（依 y1 遞增）：插入一個矩形時就地做 width / max width、對 active set 做 spacing、
+// 把面積加進 density map；引用這層當 under / over 的 via 也依 y1 併進同一趟，
+// 金屬插入時查 active 的 via、via 插入時查 active 的金屬，接觸的配對一定在較晚插入的那一方找到。
+// 每個矩形整份 deck 只讀進來一次（via 最多兩次：under、over 各一趟），不必另外建網格。
+// 反向矩形（x1>x2 或 y1>y2）不進 active set，與 LayerGrid 的 irregular 一樣對整層逐一比對。
 
-    // 依 layer 分桶
-    std::unordered_map<std::string, std::vector<const Shape*>> bucket;
-    for (const auto& s : shapes)
-        bucket[s.layer].push_back(&s);
+namespace {
 
-    for (const auto& kv : rules.via_encl_map){
-        const std::string& viaL = kv.first;
-        const auto& cfg = kv.second; // {under, over, min_enclose}
+// 某層依 y1 遞增（同 y1 依層內序號）的正向矩形，與反向矩形
+struct SweepOrder {
+    std::vector<int> regular, irregular;
+    int xmin = INT_MAX, xmax = INT_MIN;
+    long long sumExt = 0;     // 正向矩形長邊總和（決定桶寬）
 
-        auto vit = bucket.find(viaL);
-        if (vit == bucket.end()) continue; // layout 沒這層
+    explicit SweepOrder(const LayerShapes& L){
+        regular.reserve(L.size());
+        for (size_t k = 0; k < L.size(); ++k){
+            if (L.x1[k] > L.x2[k] || L.y1[k] > L.y2[k]) { irregular.push_back((int)k); continue; }
+            regular.push_back((int)k);
+            xmin = std::min(xmin, L.x1[k]);
+            xmax = std::max(xmax, L.x2[k]);
+            sumExt += std::max((long long)L.x2[k] - L.x1[k], (long long)L.y2[k] - L.y1[k]);
+        }
+        std::sort(regular.begin(), regular.end(), [&](int a, int b){
+            return L.y1[a] != L.y1[b] ? L.y1[a] < L.y1[b] : a < b;
+        });
+    }
+};
+
+// 掃描某金屬層時併進來的一串 via：某條 via 規則的 under（sub 0）或 over（sub 1）
+struct ViaStream {
+    const BoundRules::Via* cfg;
+    int sub;
+    const SweepOrder* order;
+    std::vector<int>* best;   // best[k]：via 層第 k 個目前的最佳包覆（INT_MIN = 還沒有金屬碰到）
+};
+
+} // namespace
+
+static inline bool rectTouches(const LayerShapes& M, size_t m, const LayerShapes& V, size_t v){
+    return !(M.x2[m] < V.x1[v] || V.x2[v] < M.x1[m] || M.y2[m] < V.y1[v] || V.y2[v] < M.y1[m]);
+}
+
+static void fused_layer(const ShapeStore& store, const BoundRules& bound, int layer,
+                        const std::vector<ViaStream>& vias, DensityMap* density,
+                        std::vector<ViolationRecord>& out){
+    const LayerShapes& L = store.byLayer[layer];
+    const int minW = bound.layer[layer].min_width;
+    const int maxW = bound.layer[layer].max_width;
+    const int S = bound.layer[layer].min_spacing;
+    const bool addDensity = density && bound.density[layer];
+    StatsScope stats("fused", store.layerName(layer));
+    stats.c.visited += (long long)L.size();
+
+    auto visit = [&](size_t k){
+        if (addDensity) density->add(L.x1[k], L.y1[k], L.x2[k], L.y2[k]);
+        if (minW < 0 && maxW < 0) return;
+        int w = std::abs(L.x2[k] - L.x1[k]), h = std::abs(L.y2[k] - L.y1[k]);
+        int sw = std::min(w, h), lw = std::max(w, h);
+        auto push = [&](int sub, int actual, int thr){
+            ViolationRecord r = record(0, L.idx[k], 0, sub, layer);
+            setBox(r, L.at(layer, k));
+            r.actual = actual; r.threshold = thr;
+            out.push_back(r);
+            stats.c.found++;
+        };
+        if (minW >= 0 && sw < minW) push(0, sw, minW);
+        if (maxW >= 0 && lw > maxW) push(1, lw, maxW);
+    };
+    auto encl = [&](const ViaStream& s, size_t m, size_t v){
+        const LayerShapes& V = store.byLayer[s.cfg->via];
+        stats.c.tested++;
+        int& best = (*s.best)[v];
+        best = std::max(best, enclosureMargin(L.at(layer, m), V.at(s.cfg->via, v)));
+    };
+
+    // 只有 density / width 要做：不必排序，照層內順序掃過去
+    if (S < 0 && vias.empty()){
+        for (size_t k = 0; k < L.size(); ++k) visit(k);
+        return;
+    }
 
-        for (const Shape* vp : vit->second){
-            const Shape& v = *vp;
+    const SweepOrder order(L);
+    int xmin = order.xmin, xmax = order.xmax;
+    for (const auto& s : vias){
+        xmin = std::min(xmin, s.order->xmin);
+        xmax = std::max(xmax, s.order->xmax);
+    }
+    // 桶寬：至少 spacing，並參考平均長邊（與 LayerGrid 同一個想法）
+    const int width = (int)std::max<long long>(std::max(S, 1),
+                                               order.regular.empty() ? 1 : order.sumExt / (long long)order.regular.size());
+    ActiveBuckets metals(xmin, xmax, width, std::max(S, 0), L.size());
+    std::vector<ActiveBuckets> active;
+    active.reserve(vias.size());
+    for (const auto& s : vias) active.emplace_back(xmin, xmax, width, 0, store.byLayer[s.cfg->via].size());
 
-            // 找出最佳包覆距離
-            int best_under = INT_MIN, best_over = INT_MIN;
+    auto clampInt = [](long long v){ return (int)std::min<long long>(std::max<long long>(v, INT_MIN), INT_MAX); };
+    auto insertMetal = [&](size_t k){
+        const int x1 = L.x1[k], y1 = L.y1[k], x2 = L.x2[k], y2 = L.y2[k];
+        visit(k);
+        if (S >= 0)
+            metals.query(clampInt((long long)x1 - S), clampInt((long long)x2 + S), y1, [&](const ActiveBuckets::Entry& e){
+                stats.c.candidates++;
+                // dx 或 dy >= S 時距離一定 >= S（e.y1 <= y1，所以 y 方向只看 y1 - e.y2）
+                if ((long long)e.x1 - x2 >= S || (long long)x1 - e.x2 >= S || (long long)y1 - e.y2 >= S) return;
+                stats.c.tested++;
+                stats.c.found += spacing_pair(L, layer, std::min<size_t>(e.k, k), std::max<size_t>(e.k, k), S, out);
+            });
+        for (size_t s = 0; s < vias.size(); ++s)
+            active[s].query(x1, x2, y1, [&](const ActiveBuckets::Entry& e){
+                stats.c.candidates++;
+                if (x2 < e.x1 || e.x2 < x1) return;      // 未過期 = e.y2 >= y1，y 方向一定接觸
+                encl(vias[s], k, (size_t)e.k);
+            });
+        metals.insert((int)k, x1, y1, x2, y2);
+    };
+    auto insertVia = [&](size_t s, size_t v){
+        const LayerShapes& V = store.byLayer[vias[s].cfg->via];
+        const int x1 = V.x1[v], y1 = V.y1[v], x2 = V.x2[v], y2 = V.y2[v];
+        metals.query(x1, x2, y1, [&](const ActiveBuckets::Entry& e){
+            stats.c.candidates++;
+            if (x2 < e.x1 || e.x2 < x1 || e.y2 < y1) return;
+            encl(vias[s], (size_t)e.k, v);
+        });
+        active[s].insert((int)v, x1, y1, x2, y2);
+    };
 
-            if (bucket.count(cfg.under)){
-                for (auto p : bucket[cfg.under])
-                    if (touchOrOverlap(*p, v))
-                        best_under = std::max(best_under, enclosureMargin(*p, v));
+    // 金屬與各串 via 依 y1 合併（同 y1 先金屬；兩邊都會查對方，順序不影響結果）
+    size_t pm = 0;
+    std::vector<size_t> pv(vias.size(), 0);
+    for (;;){
+        long long y = pm < order.regular.size() ? L.y1[order.regular[pm]] : LLONG_MAX;
+        int next = -1;
+        for (size_t s = 0; s < vias.size(); ++s){
+            const auto& R = vias[s].order->regular;
+            if (pv[s] < R.size() && store.byLayer[vias[s].cfg->via].y1[R[pv[s]]] < y){
+                y = store.byLayer[vias[s].cfg->via].y1[R[pv[s]]];
+                next = (int)s;
             }
+        }
+        if (y == LLONG_MAX) break;
+        if (next < 0) insertMetal((size_t)order.regular[pm++]);
+        else insertVia((size_t)next, (size_t)vias[next].order->regular[pv[next]++]);
+    }
 
-            if (bucket.count(cfg.over)){
-                for (auto p : bucket[cfg.over])
-                    if (touchOrOverlap(*p, v))
-                        best_over = std::max(best_over, enclosureMargin(*p, v));
+    // 反向矩形：整層逐一比對
+    for (int k : order.irregular){
+        visit((size_t)k);
+        if (S >= 0)
+            for (size_t j = 0; j < L.size(); ++j){
+                const bool jIrregular = L.x1[j] > L.x2[j] || L.y1[j] > L.y2[j];
+                if (j == (size_t)k || (jIrregular && j < (size_t)k)) continue;   // 兩邊都反向的配對只算一次
+                stats.c.tested++;
+                stats.c.found += spacing_pair(L, layer, std::min<size_t>(j, k), std::max<size_t>(j, k), S, out);
             }
+        for (const auto& s : vias){
+            const LayerShapes& V = store.byLayer[s.cfg->via];
+            for (size_t v = 0; v < V.size(); ++v)
+                if (rectTouches(L, (size_t)k, V, v)) encl(s, (size_t)k, v);
+        }
+    }
+    for (const auto& s : vias){
+        const LayerShapes& V = store.byLayer[s.cfg->via];
+        for (int v : s.order->irregular)
+            for (int m : order.regular)
+                if (rectTouches(L, (size_t)m, V, (size_t)v)) encl(s, (size_t)m, (size_t)v);
+    }
+}
 
-            const int need = cfg.min_enclose;
+std::vector<Violation> run_drc_fused(const ShapeStore& store, const RuleSet& rules,
+                                     int die_x1,int die_y1,int die_x2,int die_y2)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    const int n = store.numLayers();
+    std::vector<ViolationRecord> R;
 
-            auto print_encl = [&](const char* pos, const std::string& lay, int best){
-                if (best == INT_MIN) {
-                    std::cout << "[ENCLOSURE][" << pos << " " << lay << "] "
-                              << viaL << " bbox=" << bboxStr(v)
-                              << " missing metal coverage (need +" << need << "nm)\n";
-                    return;
-                }
+    // via 層的掃描順序在 under、over 兩趟之間共用
+    std::vector<std::unique_ptr<SweepOrder>> viaOrder(n);
+    std::vector<std::array<std::vector<int>, 2>> best(bound.vias.size());
+    std::vector<std::vector<ViaStream>> streams(n);
+    for (size_t r = 0; r < bound.vias.size(); ++r){
+        const auto& cfg = bound.vias[r];
+        if (cfg.via < 0) continue;
+        const LayerShapes& V = store.byLayer[cfg.via];
+        for (int sub = 0; sub < 2; ++sub){
+            best[r][sub].assign(V.size(), INT_MIN);
+            const int metal = sub == 0 ? cfg.under : cfg.over;
+            if (metal < 0 || V.size() == 0 || store.byLayer[metal].size() == 0) continue;
+            if (!viaOrder[cfg.via]) viaOrder[cfg.via] = std::make_unique<SweepOrder>(V);
+            streams[metal].push_back({&cfg, sub, viaOrder[cfg.via].get(), &best[r][sub]});
+        }
+    }
 
-                int diff = best - need;
-                if (!SHOW_ALL_ENCLOSURE && std::abs(diff) < 1) return; // OK，不列出
+    auto sweepAll = [&](DensityMap* density){
+        for (int id = 0; id < n; ++id){
+            const auto& rule = bound.layer[id];
+            const bool needed = rule.min_width >= 0 || rule.max_width >= 0 || rule.min_spacing >= 0 ||
+                                !streams[id].empty() || (density && bound.density[id]);
+            if (needed && store.byLayer[id].size())
+                fused_layer(store, bound, id, streams[id], density, R);
+        }
+    };
+    // density map 要在掃描前建好、掃完才取 window；沒有任何 window 時 feed 不會被呼叫
+    bool swept = false;
+    const std::vector<DensityWindow> windows = densityWindows([&](DensityMap& map){ sweepAll(&map); swept = true; },
+                                                              rules, die_x1,die_y1,die_x2,die_y2);
+    if (!swept) sweepAll(nullptr);
 
-                std::cout << "[ENCLOSURE][" << pos << " " << lay << "] "
-                          << viaL << " bbox=" << bboxStr(v) << " ";
+    for (size_t r = 0; r < bound.vias.size(); ++r){
+        const auto& cfg = bound.vias[r];
+        if (cfg.via < 0) continue;
+        StatsScope stats("enclosure", *cfg.name);
+        const LayerShapes& V = store.byLayer[cfg.via];
+        stats.c.visited += (long long)V.size();
+        for (size_t k = 0; k < V.size(); ++k)
+            enclosure_records(cfg, V, k, best[r][0][k], best[r][1][k], stats.c, R);
+    }
+    {
+        StatsScope stats("density");
+        density_records(windows, rules, stats.c, R);
+    }
 
-                if (diff < 0)
-                    std::cout << "need +" << (-diff) << "nm\n";   // 不足
-                else if (diff > 0)
-                    std::cout << "over by " << diff << "nm\n";   // 過包
-                else
-                    std::cout << "OK (exact)\n";
-            };
+    std::vector<Violation> V;
+    appendSorted(R, store, bound, V);
+    return V;
+}
+
+
+// =================== 合併 region 版 ===================
+// via 以外的層先 merge 成 region（geom.hpp），層內改放各 region 的水平最大條帶，
+// idx 換成 region 的編號（所含 shape 最小的 idx）；via 層原封不動。之後的 spacing / density 照常跑在條帶上。
+
+// 一層 merge 成 region：條帶依 region 編號放進 out，width 順便以弦長檢查。
+// region 的水平 / 垂直最大條帶就是它各處的橫向 / 縱向弦：最短的弦 < min_width、最長的弦 > max_width 各記一筆，
+// bbox 是那條弦所在的條帶。單獨一個矩形時兩者就是短邊、長邊，與一般模式相同。
+template<class Out>
+static void merged_layer(const ShapeStore& store, const BoundRules& bound, int layer,
+                         LayerShapes& out, Out& rec){
+    const LayerShapes& L = store.byLayer[layer];
+    StatsScope stats("merge", store.layerName(layer));
+    stats.c.visited += (long long)L.size();
+    auto box = [&](size_t k){
+        return Box{std::min(L.x1[k], L.x2[k]), std::min(L.y1[k], L.y2[k]),
+                   std::max(L.x1[k], L.x2[k]), std::max(L.y1[k], L.y2[k])};
+    };
+
+    // 跟同層誰都沒碰到（含角）的 shape 自己就是一個 region、一條條帶，不必進掃描線
+    std::vector<int> sub;
+    std::vector<Box> rects;
+    {
+        const LayerGrid grid(L, 1);
+        std::vector<int> near;
+        for (size_t k = 0; k < L.size(); ++k){
+            const Box b = box(k);
+            grid.query(b.x1, b.y1, b.x2, b.y2, near);
+            for (int m : near){
+                if ((size_t)m == k) continue;
+                const Box o = box((size_t)m);
+                if (o.x2 < b.x1 || b.x2 < o.x1 || o.y2 < b.y1 || b.y2 < o.y1) continue;
+                sub.push_back((int)k);
+                rects.push_back(b);
+                break;
+            }
+        }
+        stats.c.tested += (long long)sub.size();
+    }
+    const MergedRegions H = mergeRects(rects);
+    // 只有一個矩形的 region，垂直弦就是它的高；垂直掃描只餵多個矩形併成的 region
+    std::vector<int> members(H.numRegions, 0);
+    for (int g : H.rectRegion) if (g >= 0) ++members[g];
+    std::vector<Box> multi;
+    std::vector<int> multiRegion;
+    for (size_t j = 0; j < sub.size(); ++j)
+        if (H.rectRegion[j] >= 0 && members[H.rectRegion[j]] > 1) { multi.push_back(rects[j]); multiRegion.push_back(H.rectRegion[j]); }
+    const MergedRegions V = mergeRects(multi, true);
+
+    // 沒進掃描線的、以及面積 0 的 shape（不占面積）各自當一個 region，自己就是條帶
+    struct Chord { int len; Box at; };
+    struct Region { int name = INT_MAX; Chord lo{INT_MAX, {}}, hi{-1, {}}; };
+    std::vector<Region> reg(H.numRegions);
+    std::vector<int> vToH(V.numRegions, -1);
+    auto chord = [](Region& g, int len, const Box& at){
+        if (len < g.lo.len) g.lo = {len, at};
+        if (len > g.hi.len) g.hi = {len, at};
+    };
+    auto single = [&](size_t k){
+        const Box b = box(k);
+        Region g;
+        g.name = L.idx[k];
+        chord(g, std::min(b.x2 - b.x1, b.y2 - b.y1), b);
+        chord(g, std::max(b.x2 - b.x1, b.y2 - b.y1), b);
+        reg.push_back(g);
+    };
+    for (size_t k = 0, j = 0; k < L.size(); ++k){
+        if (j == sub.size() || sub[j] != (int)k) { single(k); continue; }
+        const int h = H.rectRegion[j++];
+        if (h < 0) { single(k); continue; }
+        reg[h].name = std::min(reg[h].name, L.idx[k]);
+        if (members[h] == 1) chord(reg[h], rects[j - 1].y2 - rects[j - 1].y1, rects[j - 1]);
+    }
+    for (size_t j = 0; j < multi.size(); ++j) vToH[V.rectRegion[j]] = multiRegion[j];
+    for (size_t s = 0; s < H.strips.size(); ++s)
+        chord(reg[H.stripRegion[s]], H.strips[s].x2 - H.strips[s].x1, H.strips[s]);
+    for (size_t s = 0; s < V.strips.size(); ++s)
+        chord(reg[vToH[V.stripRegion[s]]], V.strips[s].y2 - V.strips[s].y1, V.strips[s]);
+
+    const int minW = bound.layer[layer].min_width;
+    const int maxW = bound.layer[layer].max_width;
+    auto push = [&](const Region& g, int sub, const Chord& c, int thr){
+        ViolationRecord r = record(0, g.name, 0, sub, layer);
+        r.x1 = c.at.x1; r.y1 = c.at.y1; r.x2 = c.at.x2; r.y2 = c.at.y2;
+        r.actual = c.len; r.threshold = thr;
+        rec.push_back(r);
+        stats.c.found++;
+    };
+    for (const auto& g : reg){
+        if (minW >= 0 && g.lo.len < minW) push(g, 0, g.lo, minW);
+        if (maxW >= 0 && g.hi.len > maxW) push(g, 1, g.hi, maxW);
+    }
+
+    struct Strip { int name; Box b; };
+    std::vector<Strip> strips;
+    strips.reserve(H.strips.size() + reg.size() - H.numRegions);
+    for (size_t s = 0; s < H.strips.size(); ++s) strips.push_back({reg[H.stripRegion[s]].name, H.strips[s]});
+    for (size_t g = H.numRegions; g < reg.size(); ++g) strips.push_back({reg[g].name, reg[g].lo.at});
+    std::stable_sort(strips.begin(), strips.end(), [](const Strip& l, const Strip& r){ return l.name < r.name; });
+    for (const auto& s : strips){
+        out.x1.push_back(s.b.x1); out.y1.push_back(s.b.y1);
+        out.x2.push_back(s.b.x2); out.y2.push_back(s.b.y2);
+        out.idx.push_back(s.name);
+    }
+}
+
+// 合併後的 enclosure：via 外擴 e 之後仍整個落在金屬聯集裡的最大 e。
+// 條帶互不重疊，「被蓋滿」就是與外擴框相交的面積和等於框的面積；先倍增、再二分。
+// 聯集蓋不滿 via 時退回單一條帶的最佳包覆距離（負值）；沒有任何條帶碰到 via = INT_MIN。
+static int merged_enclosure(const ShapeStore& M, const EnclosureIndex& index, int via, size_t k,
+                            int metal, bool merged, std::vector<int>& cand, StageCounters& stats){
+    const LayerShapes& VL = M.byLayer[via];
+    const Shape v = VL.at(via, k);
+    int best = INT_MIN;
+    index.candidates(M, via, k, metal, cand);
+    if (cand.empty()) return best;
+    stats.candidates += (long long)cand.size();
+    const LayerShapes& S = M.byLayer[metal];
+    for (int m : cand){
+        if (S.x2[m] < v.x1 || v.x2 < S.x1[m] || S.y2[m] < v.y1 || v.y2 < S.y1[m]) continue;
+        stats.tested++;
+        best = std::max(best, enclosureMargin(S.at(metal, m), v));
+    }
+    // via 層也被當成金屬時條帶可能重疊，面積和不能用
+    if (best == INT_MIN || !merged) return best;
+
+    const long long vx1 = std::min(v.x1, v.x2), vy1 = std::min(v.y1, v.y2);
+    const long long vx2 = std::max(v.x1, v.x2), vy2 = std::max(v.y1, v.y2);
+    auto covered = [&](long long e){
+        const long long x1 = vx1 - e, y1 = vy1 - e, x2 = vx2 + e, y2 = vy2 + e;
+        if (x1 == x2 || y1 == y2) return false;
+        if (x1 < INT_MIN || y1 < INT_MIN || x2 > INT_MAX || y2 > INT_MAX) return false;
+        index.grids[metal].query((int)x1, (int)y1, (int)x2, (int)y2, cand);
+        long long area = 0;
+        for (int m : cand){
+            const long long w = std::min<long long>(x2, S.x2[m]) - std::max<long long>(x1, S.x1[m]);
+            const long long h = std::min<long long>(y2, S.y2[m]) - std::max<long long>(y1, S.y1[m]);
+            if (w > 0 && h > 0) area += w * h;
+        }
+        return area == (x2 - x1) * (y2 - y1);
+    };
+    // 面積 0 的 via 外擴 0 量不出面積，改從外擴 1 開始
+    long long lo = std::max(best, 0);
+    if (!covered(lo)) {
+        if (lo > 0 || !covered(1)) return best;
+        lo = 1;
+    }
+    long long hi = lo + 1;
+    while (covered(hi)) { lo = hi; hi = hi * 2 + 1; }
+    while (hi - lo > 1){
+        const long long mid = lo + (hi - lo) / 2;
+        (covered(mid) ? lo : hi) = mid;
+    }
+    return (int)lo;
+}
+
+std::vector<Violation> run_drc_merged(const ShapeStore& store, const RuleSet& rules,
+                                      int die_x1,int die_y1,int die_x2,int die_y2)
+{
+    const BoundRules bound = bindRules(rules, store.layers);
+    const int n = store.numLayers();
+    std::vector<char> isVia(n, 0);
+    for (const auto& cfg : bound.vias) if (cfg.via >= 0) isVia[cfg.via] = 1;
+
+    std::vector<ViolationRecord> R;
+    ShapeStore M;
+    M.layers = store.layers;
+    M.byLayer.resize(n);
+    for (int id = 0; id < n; ++id){
+        const LayerShapes& L = store.byLayer[id];
+        if (isVia[id]) {
+            M.byLayer[id] = L;
+            width_range(store, bound, id, 0, L.size(), R);
+        } else if (L.size()) {
+            merged_layer(store, bound, id, M.byLayer[id], R);
+        }
+        M.count += M.byLayer[id].size();
+    }
+
+    // 同一個 region 的條帶共用 idx，彼此的間距不算；同一對 region 會有好幾對條帶太近，只留最近的一筆
+    {
+        const SpacingIndex index = timedSpacingIndex(M, bound, nullptr);
+        std::vector<ViolationRecord> S;
+        for (int id = 0; id < n; ++id)
+            if (index.spacing[id] >= 0) spacing_range(M, index, id, 0, M.byLayer[id].size(), S);
+        S.erase(std::remove_if(S.begin(), S.end(), [](const ViolationRecord& r){ return r.a == r.b; }), S.end());
+        std::stable_sort(S.begin(), S.end(), [](const ViolationRecord& l, const ViolationRecord& r){
+            return recordLess(l, r) || (!recordLess(r, l) && l.actual < r.actual);
+        });
+        S.erase(std::unique(S.begin(), S.end(), [](const ViolationRecord& l, const ViolationRecord& r){
+            return !recordLess(l, r) && !recordLess(r, l);
+        }), S.end());
+        R.insert(R.end(), S.begin(), S.end());
+    }
 
-            print_encl("UNDER", cfg.under, best_under);
-            print_encl("OVER ", cfg.over , best_over );
+    {
+        const EnclosureIndex index = timedEnclosureIndex(M, bound, nullptr);
+        std::vector<int> cand;
+        for (const auto& cfg : bound.vias){
+            if (cfg.via < 0) continue;
+            StatsScope stats("enclosure", *cfg.name);
+            const LayerShapes& VL = M.byLayer[cfg.via];
+            stats.c.visited += (long long)VL.size();
+            auto best = [&](int metal, size_t k){
+                if (metal < 0) return INT_MIN;
+                return merged_enclosure(M, index, cfg.via, k, metal, !isVia[metal], cand, stats.c);
+            };
+            for (size_t k = 0; k < VL.size(); ++k)
+                enclosure_records(cfg, VL, k, best(cfg.under, k), best(cfg.over, k), stats.c, R);
         }
     }
+
+    density_origins(M, rules, die_x1,die_y1,die_x2,die_y2, INT_MIN,INT_MIN,INT_MAX,INT_MAX, R);
+
+    std::vector<Violation> V;
+    appendSorted(R, M, bound, V);
+    return V;
 }
 
 
+// =================== 增量重算 ===================
 
+void DirtySet::addBox(int x1,int y1,int x2,int y2){
+    boxes.x1.push_back(std::min(x1, x2)); boxes.y1.push_back(std::min(y1, y2));
+    boxes.x2.push_back(std::max(x1, x2)); boxes.y2.push_back(std::max(y1, y2));
+    boxes.idx.push_back((int)boxes.idx.size());
+}
 
+void DirtySet::finalize(){ grid = LayerGrid(boxes, 1); }
 
-void check_density(const std::vector<Shape>& shapes, const RuleSet& rules,
-                   int die_x1,int die_y1,int die_x2,int die_y2)
+bool DirtySet::hits(int x1,int y1,int x2,int y2) const {
+    if (boxes.size() == 0) return false;
+    if (x1 > x2) std::swap(x1, x2);
+    if (y1 > y2) std::swap(y1, y2);
+    thread_local std::vector<int> cand;
+    grid.query(x1, y1, x2, y2, cand);
+    for (int m : cand)
+        if (!(boxes.x2[m] < x1 || x2 < boxes.x1[m] || boxes.y2[m] < y1 || y2 < boxes.y1[m])) return true;
+    return false;
+}
+
+bool DirtySet::hitsWindow(const RuleSet& rules, const Box& die, int x, int y) const {
+    int x2 = (int)std::min<long long>((long long)x + rules.density_window, die.x2);
+    int y2 = (int)std::min<long long>((long long)y + rules.density_window, die.y2);
+    return hits(x, y, x2, y2);
+}
+
+void check_dirty(const ShapeStore& store, const RuleSet& rules, const Box& die,
+                 const DirtySet& dirty, std::vector<Violation>& out)
 {
-    const int W = rules.density_window;
-    for (int y=die_y1; y<die_y2; y+=W){
-        for (int x=die_x1; x<die_x2; x+=W){
-            int win_x2 = std::min(x+W, die_x2);
-            int win_y2 = std::min(y+W, die_y2);
-            int win_area = (win_x2-x)*(win_y2-y);
-            long long metal_area = 0;
-
-            for (const auto& s: shapes){
-                // 只計在 rules.density_layers 裡的層（不含 POLY/VIA）
-                if (rules.density_layers.count(s.layer))
-                    metal_area += interArea(x,y,win_x2,win_y2, s.x1,s.y1,s.x2,s.y2);
-            }
+    const BoundRules bound = bindRules(rules, store.layers);
+    std::vector<ViolationRecord> R;
+    auto isAdded = [&](int layer, size_t k){
+        return layer < (int)dirty.added.size() && dirty.added[layer][k];
+    };
 
-            double dens = win_area? (double)metal_area/win_area : 0.0;
-            if (dens < rules.min_density){
-                std::cout << "[DENSITY] ["<<x<<","<<y<<"]-["<<win_x2<<","<<win_y2<<"] "
-                          << "density="<<dens<<" < "<<rules.min_density<<"\n";
+    // width：新增的 shape
+    for (int id = 0; id < store.numLayers(); ++id)
+        for (size_t k = 0; k < store.byLayer[id].size(); ++k)
+            if (isAdded(id, k)) width_range(store, bound, id, k, k + 1, R);
+
+    // spacing：至少一邊是新增 shape 的配對（兩邊都新增時只從序號大的那邊算一次）
+    std::vector<int> cand;
+    for (int id = 0; id < store.numLayers(); ++id){
+        const int S = bound.layer[id].min_spacing;
+        const LayerShapes& L = store.byLayer[id];
+        if (S < 0 || id >= (int)dirty.added.size()) continue;
+        if (std::find(dirty.added[id].begin(), dirty.added[id].end(), 1) == dirty.added[id].end()) continue;
+        LayerGrid grid(L, S);
+        for (size_t k = 0; k < L.size(); ++k){
+            if (!dirty.added[id][k]) continue;
+            if (L.x1[k] > L.x2[k] || L.y1[k] > L.y2[k])
+                grid.query(INT_MIN, INT_MIN, INT_MAX, INT_MAX, cand);
+            else
+                grid.query((int)std::max<long long>((long long)L.x1[k] - S, INT_MIN),
+                           (int)std::max<long long>((long long)L.y1[k] - S, INT_MIN),
+                           (int)std::min<long long>((long long)L.x2[k] + S, INT_MAX),
+                           (int)std::min<long long>((long long)L.y2[k] + S, INT_MAX), cand);
+            for (int j : cand){
+                if ((size_t)j == k || (dirty.added[id][j] && (size_t)j < k)) continue;
+                spacing_pair(L, id, std::min<size_t>(j, k), std::max<size_t>(j, k), S, R);
             }
         }
     }
-}
 
+    // enclosure：新增的 via，以及 bbox 碰到 dirty 框的 via
+    EnclosureIndex index = buildEnclosureIndex(store, bound, nullptr, false);
+    for (const auto& via : bound.vias){
+        if (via.via < 0) continue;
+        StatsScope stats("enclosure", *via.name);
+        const LayerShapes& V = store.byLayer[via.via];
+        for (size_t k = 0; k < V.size(); ++k)
+            if (isAdded(via.via, k) || dirty.hits(V.x1[k], V.y1[k], V.x2[k], V.y2[k])){
+                enclosure_via(store, index, via, k, cand, stats.c, R);
+                stats.c.visited++;
+            }
+    }
+
+    // density：左下角落在「某個 dirty 框往左下退一個 window」範圍內的 window 逐一重算（同一個只算一次），
+    // 再用 hitsWindow 精確篩；每個 window 的金屬只從網格取它範圍內的 shape，相距很遠的兩處修改不會把中間整片算進來
+    const LayerShapes& B = dirty.boxes;
+    const int W = rules.density_window;
+    if (B.size() > 0 && W > 0){
+        const long long step = rules.density_step > 0 ? rules.density_step : W;
+        auto lattice = [&](long long d1, long long d2, long long lo, long long hi, std::vector<long long>& v){
+            v.clear();
+            lo = std::max(lo, d1);
+            hi = std::min(hi, d2 - 1);
+            if (lo > hi) return;
+            for (long long t = d1 + (lo - d1 + step - 1) / step * step; t <= hi; t += step) v.push_back(t);
+        };
+        std::vector<std::pair<long long, long long>> origins;   // (y, x)
+        std::vector<long long> xs, ys;
+        for (size_t m = 0; m < B.size(); ++m){
+            lattice(die.x1, die.x2, (long long)B.x1[m] - W, B.x2[m], xs);
+            lattice(die.y1, die.y2, (long long)B.y1[m] - W, B.y2[m], ys);
+            for (long long y : ys)
+                for (long long x : xs) origins.push_back({y, x});
+        }
+        std::sort(origins.begin(), origins.end());
+        origins.erase(std::unique(origins.begin(), origins.end()), origins.end());
 
+        std::vector<LayerGrid> grids(store.numLayers());
+        for (int id = 0; id < store.numLayers(); ++id)
+            if (bound.density[id]) grids[id] = LayerGrid(store.byLayer[id], 1);
+        auto feed = [&](DensityMap& map){
+            const Box b = map.bounds();
+            for (int id = 0; id < store.numLayers(); ++id){
+                if (!bound.density[id]) continue;
+                const LayerShapes& L = store.byLayer[id];
+                grids[id].query(b.x1, b.y1, b.x2, b.y2, cand);
+                for (int m : cand) map.add(L.x1[m], L.y1[m], L.x2[m], L.y2[m]);
+            }
+        };
+        StatsScope stats("density");
+        std::vector<DensityWindow> windows;
+        for (const auto& o : origins)
+            for (const auto& w : densityWindows(feed, rules, die.x1,die.y1,die.x2,die.y2,
+                                                (int)o.second, (int)o.first, (int)o.second + 1, (int)o.first + 1))
+                if (dirty.hitsWindow(rules, die, w.x1, w.y1)) windows.push_back(w);
+        density_records(windows, rules, stats.c, R);
+    }
+    appendSorted(R, store, bound, out);
+}
@@ -1,15 +1,155 @@
 #pragma once
 #include "common.hpp"
+#include "spatial.hpp"
 #include <vector>
 #include <string>
 
 
+// ---- 違規清單 ----
+// 四個 check 只跑一次，結果收進同一份 std::vector<Violation>；
+// console / drc_report.txt / CSV / markdown 都只是把這份清單序列化。
+// Violation 本身不帶字串：層名 / via 名稱是 internName 的指標，type / object / bbox / rule / status
+// 都由數值欄位在序列化時才組出來（violationType() 等），一筆違規不做任何 heap 配置。
+struct Violation {
+    const std::string* layer  = nullptr;  // M1 / "UNDER M1" / window（internName）
+    const std::string* object = nullptr;  // ENCLOSURE：via 層名（internName）；其他由 key 產生
+    double actual    = 0.0;
+    double threshold = 0.0;
+    double delta     = 0.0;
+    int x1 = 0, y1 = 0, x2 = 0, y2 = 0;   // bbox：shape / via / density window；SPACING 不用
+    bool missing = false; // ENCLOSURE：via 完全沒有金屬覆蓋
+    bool pass = false;    // 過包的 enclosure 記成 PASS（只在 console 顯示），其餘都是 FAIL
+
+    // 排序 / 去重用的數值 key (cat, a, b, sub)，依它排序就是單機輸出的順序：
+    //   WIDTH     cat=0  a=shape idx        sub=0 min / 1 max
+    //   SPACING   cat=1  a=i  b=j
+    //   ENCLOSURE cat=2  a=via 規則序  b=via 的 shape idx  sub=0 UNDER / 1 OVER
+    //   DENSITY   cat=3  a=window y  b=window x
+    int cat = 0;
+    long long a = 0, b = 0;
+    int sub = 0;
+};
+
+inline bool violationLess(const Violation& l, const Violation& r){
+    if (l.cat != r.cat) return l.cat < r.cat;
+    if (l.a != r.a) return l.a < r.a;
+    if (l.b != r.b) return l.b < r.b;
+    return l.sub < r.sub;
+}
+
+// 程序內共用的字串池：同樣內容回傳同一個指標，指標一直有效（可跨 run、跨執行緒）
+const std::string* internName(std::string_view s);
+
+// 序列化時才組的欄位
+const char* violationType(const Violation& v);     // WIDTH / SPACING / ENCLOSURE / DENSITY
+const char* violationStatus(const Violation& v);   // FAIL / PASS
+std::string violationBBox(const Violation& v);     // "(x1,y1)-(x2,y2)"；SPACING 是 "-"
+std::string violationRule(const Violation& v);     // ">= 30" / "<= 120" ...
+
+// ---- 精簡的違規記錄 ----
+// check 的內層只填這個 POD（沒有字串），要輸出時才依 RecordContext 把層名 / 規則字串補回來：
+// run_drc 先收 record、排好序再轉成 Violation；串流輸出（sink.hpp）則直接格式化 record。
+struct ViolationRecord {
+    long long a = 0, b = 0;           // 同 Violation 的排序 key
+    double actual = 0.0, threshold = 0.0;
+    int x1 = 0, y1 = 0, x2 = 0, y2 = 0;   // bbox：shape / via / density window
+    int ref = 0;                      // WIDTH / SPACING：layer ID；ENCLOSURE：via 規則序；DENSITY 不用
+    unsigned char cat = 0, sub = 0;
+    unsigned char missing = 0;        // ENCLOSURE：via 完全沒有金屬覆蓋
+    unsigned char pass = 0;           // ENCLOSURE：過包（status = PASS）
+};
+
+inline bool recordLess(const ViolationRecord& l, const ViolationRecord& r){
+    if (l.cat != r.cat) return l.cat < r.cat;
+    if (l.a != r.a) return l.a < r.a;
+    if (l.b != r.b) return l.b < r.b;
+    return l.sub < r.sub;
+}
+
+// record 的 ref 換回名稱：建一次（每個名稱 intern 一次），之後每筆 toViolation 只查表
+struct RecordContext {
+    RecordContext(const LayerTable& layers, const BoundRules& bound);
+    std::vector<const std::string*> layer;              // layer ID → 層名
+    std::vector<const std::string*> under, over, via;   // via 規則序 → "UNDER M1" / "OVER M2" / via 層名
+};
+
+Violation toViolation(const ViolationRecord& r, const RecordContext& ctx);
+
+// object 欄：WIDTH "idx=#"、SPACING "(i,j)"、DENSITY "[x,y]" 由 key 產生，ENCLOSURE 是 via 層名
+std::string violationObject(const Violation& v);
+
+std::string bboxStr(const Shape& s);
 int enclosureMargin(const Shape& metal, const Shape& via);
 bool fullyCovers(const Shape& metal, const Shape& via);
 
 
-void check_min_width(const std::vector<Shape>& shapes, const RuleSet& rules);
-void check_min_spacing(const std::vector<Shape>& shapes, const RuleSet& rules);
-void check_via_enclosure_multi(const std::vector<Shape>& shapes, const RuleSet& rules);
-void check_density(const std::vector<Shape>& shapes, const RuleSet& rules,
-                   int die_x1,int die_y1,int die_x2,int die_y2);
+void check_min_width(const ShapeStore& store, const RuleSet& rules,
+                     std::vector<Violation>& out);
+void check_min_spacing(const ShapeStore& store, const RuleSet& rules,
+                       std::vector<Violation>& out);
+void check_via_enclosure_multi(const ShapeStore& store, const RuleSet& rules,
+                               std::vector<Violation>& out);
+// 同上，但沿用呼叫端已建好的網格（bench 要把建索引與 check 分開計時）
+void check_min_spacing(const ShapeStore& store, const RuleSet& rules, const SpacingIndex& index,
+                       std::vector<Violation>& out);
+void check_via_enclosure_multi(const ShapeStore& store, const RuleSet& rules,
+                               const EnclosureIndex& index, std::vector<Violation>& out);
+void check_density(const ShapeStore& store, const RuleSet& rules,
+                   int die_x1,int die_y1,int die_x2,int die_y2,
+                   std::vector<Violation>& out);
+// 只算左下角落在 [ox1,ox2)×[oy1,oy2) 的 window（tile 模式用）
+void check_density_origins(const ShapeStore& store, const RuleSet& rules,
+                           int die_x1,int die_y1,int die_x2,int die_y2,
+                           int ox1,int oy1,int ox2,int oy2,
+                           std::vector<Violation>& out);
+
+// 依序跑 width → spacing → enclosure → density；
+// threads > 1（或 <= 0 = 全部核心）時拆成 task 平行跑，輸出順序與單執行緒完全相同
+std::vector<Violation> run_drc(const ShapeStore& store, const RuleSet& rules,
+                               int die_x1,int die_y1,int die_x2,int die_y2, int threads = 1);
+
+// 融合版（main --fused）：每層只做一次 plane sweep，width / max width / spacing、
+// 這層當 under / over 金屬的 via enclosure 與 density 面積累加都在同一趟完成，不建網格；
+// 每個矩形只讀一次，適合記憶體頻寬吃緊的大 layout。單執行緒，輸出與 run_drc 相同。
+std::vector<Violation> run_drc_fused(const ShapeStore& store, const RuleSet& rules,
+                                     int die_x1,int die_y1,int die_x2,int die_y2);
+
+// 合併版（main --merged）：via 以外各層重疊 / 相接的 shape 先以掃描線 merge 成 region 再檢查。
+// width 量 region 的最短 / 最長弦、spacing 只比不同 region（每對記最近的一筆）、
+// enclosure 看 via 外擴多少仍被金屬聯集蓋滿、density 用聯集面積（重疊不重複算）。
+// region 以所含 shape 最小的 idx 表示；同層沒有相接的 shape 時 width / spacing 與 run_drc 相同。單執行緒。
+std::vector<Violation> run_drc_merged(const ShapeStore& store, const RuleSet& rules,
+                                      int die_x1,int die_y1,int die_x2,int die_y2);
+
+// 串流版：不收集、不排序，每筆 record 一產生就交給 sink（threads > 1 時會從多個執行緒同時呼叫 push），
+// 順序依發現先後；記憶體與違規數無關。
+class RecordSink {
+public:
+    virtual ~RecordSink() = default;
+    virtual void push(const ViolationRecord& r) = 0;
+};
+void run_drc_stream(const ShapeStore& store, const RuleSet& rules,
+                    int die_x1,int die_y1,int die_x2,int die_y2, int threads, RecordSink& sink);
+
+
+// ---- 增量重算 ----
+// 編輯後只需重算的部分：涉及新增 shape 的 width / spacing、bbox 碰到 dirty 框的 via 的 enclosure、
+// 與 dirty 框相交的 density window。其餘違規由呼叫端沿用上一次的結果（見 incremental.hpp），
+// 「沿用」與「重算」用同一組判斷（hits / hitsWindow），保證兩邊不重疊也不遺漏。
+struct DirtySet {
+    std::vector<std::vector<char>> added;   // added[layer ID][k]：這次新出現的 shape
+    LayerShapes boxes;                      // 新增 / 刪除 shape 的 bbox（正規化成 x1<=x2、y1<=y2）
+
+    void addBox(int x1,int y1,int x2,int y2);
+    void finalize();                        // 加完 box 後建索引
+    bool hits(int x1,int y1,int x2,int y2) const;   // 與任一 dirty 框相交（含邊界）
+    bool hitsWindow(const RuleSet& rules, const Box& die, int x, int y) const;  // 左下角 (x,y) 的 density window
+
+private:
+    LayerGrid grid;
+};
+
+// store 不必是整份 layout：只要含新增的 shape 與它 spacing 範圍內的同層 shape、碰到 dirty 框的 via
+// 與接觸它們的金屬、以及 dirty 框外擴一個 window 內的 density 層 shape（增量模式從常駐索引取出）
+void check_dirty(const ShapeStore& store, const RuleSet& rules, const Box& die,
+                 const DirtySet& dirty, std::vector<Violation>& out);
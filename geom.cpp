@@ -0,0 +1,219 @@
+#include "geom.hpp"
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+
+namespace {
+
+struct Event { int y, x1, x2, input, d, set; };
+
+struct SweepResult {
+    std::vector<Box> strips;
+    std::vector<int> parent;       // 條帶的 union-find（track 時）
+    std::vector<int> inputStrip;   // 輸入矩形加進來時左下角所在的條帶（track 時）
+};
+
+int findRoot(std::vector<int>& p, int x){
+    while (p[x] != x) { p[x] = p[p[x]]; x = p[x]; }
+    return x;
+}
+
+// rects 已正規化；前 na 個屬於 a、其餘屬於 b。track 時另外記條帶間的相連關係與輸入矩形所在的條帶
+void sweep(const std::vector<Box>& rects, size_t na, BoolOp op, bool track, SweepResult& out){
+    std::vector<Event> ev;
+    ev.reserve(rects.size() * 2);
+    for (size_t k = 0; k < rects.size(); ++k){
+        const Box& r = rects[k];
+        if (!(r.x1 < r.x2 && r.y1 < r.y2)) continue;
+        const int set = k < na ? 0 : 1;
+        ev.push_back({r.y1, r.x1, r.x2, (int)k, +1, set});
+        ev.push_back({r.y2, r.x1, r.x2, (int)k, -1, set});
+    }
+    std::sort(ev.begin(), ev.end(), [](const Event& l, const Event& r){ return l.y < r.y; });
+
+    // 目前掃描線上的覆蓋數：x → [x, 下一個 key) 的 (a, b) 覆蓋數；第一個 key 之前都是 0。
+    // 只在目前開著的矩形邊界切段，事件的花費與它碰到的段數成正比，不受整層 x 座標多寡影響
+    using Count = std::array<int, 2>;
+    std::map<int, Count> pc;
+    auto split = [&](int x){
+        auto it = pc.lower_bound(x);
+        if (it != pc.end() && it->first == x) return it;
+        const Count c = it == pc.begin() ? Count{0, 0} : std::prev(it)->second;
+        return pc.emplace_hint(it, x, c);
+    };
+    // 真值表以 (a 有覆蓋, b 有覆蓋) 兩個位元查
+    unsigned truth = 0;
+    switch (op) {
+    case BoolOp::OR:  truth = 0b1110; break;
+    case BoolOp::AND: truth = 0b1000; break;
+    case BoolOp::NOT: truth = 0b0010; break;
+    default:          truth = 0b0110; break;
+    }
+    auto on = [&](const Count& c){ return (truth >> ((c[0] > 0) | (c[1] > 0) << 1)) & 1; };
+
+    // 目前開著的最大覆蓋區間：起點 x → (終點 x（不含）, 條帶)
+    struct Open { int end, strip; };
+    std::map<int, Open> open;
+    struct Piece { int s, e, strip; };
+    std::vector<Piece> removed, fresh;
+    std::vector<std::pair<int,int>> dirty;
+    std::vector<int> added;
+    if (track) out.inputStrip.assign(rects.size(), -1);
+
+    for (size_t e0 = 0; e0 < ev.size();){
+        const int y = ev[e0].y;
+        dirty.clear();
+        added.clear();
+        size_t e1 = e0;
+        for (; e1 < ev.size() && ev[e1].y == y; ++e1){
+            const Event& e = ev[e1];
+            const auto last = split(e.x2);
+            for (auto it = split(e.x1); it != last; ++it) it->second[e.set] += e.d;
+            dirty.push_back({e.x1, e.x2});
+            if (track && e.d > 0) added.push_back(e.input);
+        }
+        e0 = e1;
+
+        // 同一個 y 的所有變動一起處理，上下相接、x 區間不變的條帶才接得起來
+        std::sort(dirty.begin(), dirty.end());
+        size_t m = 0;
+        for (size_t k = 1; k < dirty.size(); ++k){
+            if (dirty[k].first <= dirty[m].second) dirty[m].second = std::max(dirty[m].second, dirty[k].second);
+            else dirty[++m] = dirty[k];
+        }
+        if (!dirty.empty()) dirty.resize(m + 1);
+
+        for (const auto& [l, r] : dirty){
+            // 與前一段覆蓋數相同的切點併掉，切點數維持在開著的矩形邊界數以內
+            auto it = pc.lower_bound(l);
+            if (it != pc.begin()) --it;
+            while (it != pc.end() && it->first <= r){
+                const bool same = it == pc.begin() ? it->second == Count{0, 0} : std::prev(it)->second == it->second;
+                it = same ? pc.erase(it) : std::next(it);
+            }
+
+            // 碰到（含相鄰）[l, r) 的區間拿出來；它們在 [l, r) 外的部分覆蓋不變
+            removed.clear();
+            fresh.clear();
+            auto last = open.upper_bound(r), first = last;
+            while (first != open.begin() && std::prev(first)->second.end >= l) --first;
+            for (auto o = first; o != last; ++o) removed.push_back({o->first, o->second.end, o->second.strip});
+            open.erase(first, last);
+
+            const int L = removed.empty() ? l : std::min(l, removed.front().s);
+            const int R = removed.empty() ? r : std::max(r, removed.back().e);
+            bool inRun = L < l;
+            int run = L;
+            auto p = pc.upper_bound(l);
+            bool c = p != pc.begin() && on(std::prev(p)->second);
+            for (int x = l;;){
+                const int nx = (p == pc.end() || p->first >= r) ? r : p->first;
+                if (c) { if (!inRun) { run = x; inRun = true; } }
+                else if (inRun) { fresh.push_back({run, x, -1}); inRun = false; }
+                if (nx >= r) break;
+                x = nx;
+                c = on(p->second);
+                ++p;
+            }
+            if (R > r) fresh.push_back({inRun ? run : r, R, -1});
+            else if (inRun) fresh.push_back({run, r, -1});
+
+            // 區間沒變的沿用原本的條帶；其餘舊的在 y 收尾、新的從 y 開始
+            size_t a = 0;
+            for (auto& f : fresh){
+                while (a < removed.size() && removed[a].s < f.s) ++a;
+                if (a < removed.size() && removed[a].s == f.s && removed[a].e == f.e) f.strip = removed[a].strip;
+            }
+            for (const auto& o : removed){
+                const bool kept = std::any_of(fresh.begin(), fresh.end(), [&](const Piece& f){ return f.strip == o.strip; });
+                if (!kept) out.strips[o.strip].y2 = y;
+            }
+            for (auto& f : fresh){
+                if (f.strip < 0){
+                    f.strip = (int)out.strips.size();
+                    out.strips.push_back({f.s, y, f.e, y});
+                    if (track) out.parent.push_back(f.strip);
+                }
+                open.emplace(f.s, Open{f.e, f.strip});
+            }
+            // 新條帶與在 y 收尾、x 有重疊的舊條帶相連
+            if (track) {
+                size_t i = 0, j = 0;
+                while (i < fresh.size() && j < removed.size()){
+                    if (fresh[i].s < removed[j].e && removed[j].s < fresh[i].e)
+                        out.parent[findRoot(out.parent, fresh[i].strip)] = findRoot(out.parent, removed[j].strip);
+                    if (fresh[i].e < removed[j].e) ++i; else ++j;
+                }
+            }
+        }
+
+        for (int k : added){
+            auto it = open.upper_bound(rects[k].x1);
+            if (it != open.begin()) out.inputStrip[k] = std::prev(it)->second.strip;
+        }
+    }
+
+    // 同一個 y 的兩段變動碰到同一個區間時，前一段開的條帶會在後一段就收掉（高度 0）：丟掉，相連關係保留
+    const size_t n = out.strips.size();
+    std::vector<int> nid(n, -1);
+    int alive = 0;
+    for (size_t i = 0; i < n; ++i) if (out.strips[i].y1 < out.strips[i].y2) nid[i] = alive++;
+    if (alive == (int)n) return;
+    if (track) {
+        std::vector<int> rep(n, -1), parent(alive);
+        for (size_t i = 0; i < n; ++i){
+            if (nid[i] < 0) continue;
+            const int root = findRoot(out.parent, (int)i);
+            if (rep[root] < 0) rep[root] = nid[i];
+            parent[nid[i]] = rep[root];
+        }
+        out.parent.swap(parent);
+        for (auto& s : out.inputStrip) if (s >= 0) s = nid[s];
+    }
+    for (size_t i = 0; i < n; ++i) if (nid[i] >= 0) out.strips[nid[i]] = out.strips[i];
+    out.strips.resize(alive);
+}
+
+Box normalized(const Box& b){
+    return {std::min(b.x1, b.x2), std::min(b.y1, b.y2), std::max(b.x1, b.x2), std::max(b.y1, b.y2)};
+}
+
+Box swapped(const Box& b){ return {b.y1, b.x1, b.y2, b.x2}; }
+
+} // namespace
+
+
+std::vector<Box> booleanOp(const std::vector<Box>& a, const std::vector<Box>& b, BoolOp op){
+    std::vector<Box> in;
+    in.reserve(a.size() + b.size());
+    for (const auto& r : a) in.push_back(normalized(r));
+    for (const auto& r : b) in.push_back(normalized(r));
+    SweepResult s;
+    sweep(in, a.size(), op, false, s);
+    return std::move(s.strips);
+}
+
+MergedRegions mergeRects(const std::vector<Box>& rects, bool vertical){
+    std::vector<Box> in;
+    in.reserve(rects.size());
+    for (const auto& r : rects) in.push_back(vertical ? swapped(normalized(r)) : normalized(r));
+    SweepResult s;
+    sweep(in, in.size(), BoolOp::OR, true, s);
+
+    // region 依第一條條帶出現的順序編號
+    MergedRegions m;
+    std::vector<int> id(s.strips.size(), -1);
+    m.stripRegion.resize(s.strips.size());
+    for (size_t i = 0; i < s.strips.size(); ++i){
+        const int root = findRoot(s.parent, (int)i);
+        if (id[root] < 0) id[root] = m.numRegions++;
+        m.stripRegion[i] = id[root];
+    }
+    m.rectRegion.resize(rects.size());
+    for (size_t k = 0; k < rects.size(); ++k)
+        m.rectRegion[k] = s.inputStrip[k] < 0 ? -1 : m.stripRegion[s.inputStrip[k]];
+    m.strips = std::move(s.strips);
+    if (vertical) for (auto& b : m.strips) b = swapped(b);
+    return m;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "common.hpp"
+#include <vector>
+
+// ---- 直角多邊形的 boolean（掃描線）----
+// 矩形一律當成面積 [x1,x2)×[y1,y2)（反向的先正規化）；面積為 0 的矩形不占面積。
+// 掃描線沿 y 前進，掃描線上的覆蓋數以「只在開著的矩形邊界切段」的分段表示，各段記 a、b 兩組的覆蓋數；
+// 每個事件只重算它 x 範圍內的那幾段，接上左右還沒變的區間，花費與它碰到的段數成正比。
+// 結果以「水平最大條帶」表示：每條帶在 x 方向是最大的覆蓋區間，上下相鄰且 x 區間相同的會接成一條，
+// 條帶互不重疊，面積和就是聯集面積。
+
+enum class BoolOp { OR, AND, NOT, XOR };   // NOT = a 減 b
+
+// op(a, b) 的水平最大條帶（依下緣 y、再依 x 排序）
+std::vector<Box> booleanOp(const std::vector<Box>& a, const std::vector<Box>& b, BoolOp op);
+
+// 單層 merge：重疊或共邊相接的矩形併成同一個 region（只碰到角不算相連）。
+// vertical = true 時換成「垂直最大條帶」（y 方向最大、左右相鄰且 y 區間相同的接起來）；
+// region 編號只在同一次呼叫內有意義。
+struct MergedRegions {
+    std::vector<Box> strips;
+    std::vector<int> stripRegion;   // 條帶 → region
+    std::vector<int> rectRegion;    // 輸入矩形 → region；面積 0 的 = -1
+    int numRegions = 0;
+};
+MergedRegions mergeRects(const std::vector<Box>& rects, bool vertical = false);
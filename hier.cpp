@@ -0,0 +1,687 @@
+#include "hier.hpp"
+#include "density.hpp"
+#include "layoutbin.hpp"
+#include "mmapfile.hpp"
+#include "spatial.hpp"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+// ---- Transform ----
+
+bool Transform::fromName(const std::string& name, Transform& t){
+    static const struct { const char* name; int a, b, c, d; } table[] = {
+        {"R0", 1, 0, 0, 1},  {"R90", 0, -1, 1, 0}, {"R180", -1, 0, 0, -1}, {"R270", 0, 1, -1, 0},
+        {"MX", 1, 0, 0, -1}, {"MY", -1, 0, 0, 1},  {"MXR90", 0, 1, 1, 0},   {"MYR90", 0, -1, -1, 0},
+    };
+    for (const auto& e : table)
+        if (name == e.name) { t.a = e.a; t.b = e.b; t.c = e.c; t.d = e.d; return true; }
+    return false;
+}
+
+Box Transform::apply(const Box& r) const {
+    const long long px1 = (long long)a * r.x1 + (long long)b * r.y1 + dx, py1 = (long long)c * r.x1 + (long long)d * r.y1 + dy;
+    const long long px2 = (long long)a * r.x2 + (long long)b * r.y2 + dx, py2 = (long long)c * r.x2 + (long long)d * r.y2 + dy;
+    // 查詢框反轉回子 cell 座標時可能超出 int（外擴到極值的範圍），夾回來即可
+    auto clampInt = [](long long v){ return (int)std::min<long long>(std::max<long long>(v, INT_MIN), INT_MAX); };
+    return {clampInt(std::min(px1, px2)), clampInt(std::min(py1, py2)), clampInt(std::max(px1, px2)), clampInt(std::max(py1, py2))};
+}
+
+Transform Transform::then(const Transform& o) const {
+    Transform t;
+    t.a = o.a * a + o.b * c;  t.b = o.a * b + o.b * d;
+    t.c = o.c * a + o.d * c;  t.d = o.c * b + o.d * d;
+    t.dx = o.a * dx + o.b * dy + o.dx;
+    t.dy = o.c * dx + o.d * dy + o.dy;
+    return t;
+}
+
+// 旋轉 / 鏡射矩陣都是正交的，反矩陣就是轉置
+Transform Transform::inverse() const {
+    Transform t;
+    t.a = a; t.b = c; t.c = b; t.d = d;
+    t.dx = -(a * dx + c * dy);
+    t.dy = -(b * dx + d * dy);
+    return t;
+}
+
+
+// ---- 小工具 ----
+
+static bool isEmpty(const Box& b){ return b.x1 > b.x2 || b.y1 > b.y2; }
+static bool touches(const Box& p, const Box& q){
+    return p.x1 <= q.x2 && q.x1 <= p.x2 && p.y1 <= q.y2 && q.y1 <= p.y2;
+}
+static void unite(Box& b, const Box& r){
+    if (isEmpty(r)) return;
+    if (isEmpty(b)) { b = r; return; }
+    b = {std::min(b.x1, r.x1), std::min(b.y1, r.y1), std::max(b.x2, r.x2), std::max(b.y2, r.y2)};
+}
+static Box grow(const Box& b, int s){
+    auto clampInt = [](long long v){ return (int)std::min<long long>(std::max<long long>(v, INT_MIN), INT_MAX); };
+    return {clampInt((long long)b.x1 - s), clampInt((long long)b.y1 - s),
+            clampInt((long long)b.x2 + s), clampInt((long long)b.y2 + s)};
+}
+static Box boxAt(const LayerShapes& L, size_t k){ return {L.x1[k], L.y1[k], L.x2[k], L.y2[k]}; }
+static Shape shapeOf(int layer, const Box& b){ return {layer, b.x1, b.y1, b.x2, b.y2}; }
+
+
+// ---- 讀檔 ----
+
+static inline bool isBlank(char c){ return c==' ' || c=='\t' || c=='\r' || c=='\f' || c=='\v'; }
+
+// 該行第一個 token 是 CELL / INST
+static bool hierKeywordAt(const char* begin, const char* end, const char* p){
+    const char* ls = p;
+    while (ls > begin && ls[-1] != '\n') --ls;
+    for (const char* q = ls; q < p; ++q) if (!isBlank(*q)) return false;
+    return p + 4 == end || isBlank(p[4]);
+}
+
+bool hasHierKeyword(const char* data, size_t size){
+    std::string_view text(data, size);
+    for (const char* kw : {"CELL", "INST"})
+        for (size_t p = text.find(kw); p != std::string_view::npos; p = text.find(kw, p + 1))
+            if (hierKeywordAt(data, data + size, data + p)) return true;
+    return false;
+}
+
+bool isHierarchicalLayout(const std::string& file){
+    MappedFile mf(file);
+    if (!mf.ok() || mf.size() == 0 || isBinaryLayout(mf.data(), mf.size())) return false;
+    return hasHierKeyword(mf.data(), mf.size());
+}
+
+size_t HierLayout::uniqueShapes() const {
+    size_t n = 0;
+    for (int c : order) n += cells[c].own.count;
+    return n;
+}
+
+size_t HierLayout::instanceCount() const {
+    size_t n = 0;
+    for (int c : order) n += cells[c].insts.size();
+    return n;
+}
+
+HierLayout readHierLayout(const std::string& file, const RuleSet& rules, std::vector<ParseError>* errors){
+    HierLayout H;
+    H.layers = layerTableFor(rules);
+    H.cells.emplace_back();                              // 頂層
+    std::vector<ParseError> errs;
+    MappedFile mf(file);
+    if (!mf.ok()) {
+        std::cerr << "Error opening " << file << "\n";
+        return H;
+    }
+
+    std::unordered_map<std::string, int> byName;
+    std::vector<char> defined{1};
+    auto cellId = [&](std::string_view name){
+        auto it = byName.find(std::string(name));
+        if (it != byName.end()) return it->second;
+        H.cells.emplace_back();
+        H.cells.back().name = std::string(name);
+        defined.push_back(0);
+        return byName[std::string(name)] = (int)H.cells.size() - 1;
+    };
+
+    // 1) 逐行讀：shape 放進目前 cell 的 own，INST 先記下（offset 等全部讀完再算）
+    const char* p = mf.data();
+    const char* end = p + mf.size();
+    size_t line = 0;
+    int current = 0;              // 目前的 cell；-1 = 重複定義的 cell，略過到 END
+    while (p < end) {
+        ++line;
+        const char* ls = p;
+        const char* le = (const char*)std::memchr(p, '\n', (size_t)(end - p));
+        if (!le) le = end;
+        p = le + 1;
+
+        std::string_view tok[7];
+        size_t col[7], n = 0;
+        for (const char* q = ls; q < le && n < 7;) {
+            while (q < le && isBlank(*q)) ++q;
+            if (q == le) break;
+            const char* ts = q;
+            while (q < le && !isBlank(*q)) ++q;
+            col[n] = (size_t)(ts - ls) + 1;
+            tok[n++] = std::string_view(ts, (size_t)(q - ts));
+        }
+        if (n == 0) continue;
+        auto fail = [&](size_t at, std::string msg){ errs.push_back({line, col[at], std::move(msg)}); };
+        auto toInt = [&](size_t at, int& v){
+            std::string_view t = tok[at];
+            if (!t.empty() && t[0] == '+') t.remove_prefix(1);
+            auto r = std::from_chars(t.data(), t.data() + t.size(), v);
+            if (r.ec == std::errc() && r.ptr == t.data() + t.size()) return true;
+            fail(at, r.ec == std::errc::result_out_of_range ? "coordinate out of int range"
+                                                            : "invalid coordinate '" + std::string(tok[at]) + "'");
+            return false;
+        };
+
+        if (tok[0] == "CELL") {
+            if (n != 2) { fail(0, "expected CELL <name>"); continue; }
+            if (current != 0) { fail(0, "CELL inside another CELL (missing END)"); continue; }
+            int id = cellId(tok[1]);
+            if (defined[id]) { fail(1, "cell '" + std::string(tok[1]) + "' defined twice"); current = -1; continue; }
+            defined[id] = 1;
+            current = id;
+            continue;
+        }
+        if (tok[0] == "END") {
+            if (n != 1) { fail(1, "unexpected trailing text"); continue; }
+            if (current == 0) { fail(0, "END without CELL"); continue; }
+            current = 0;
+            continue;
+        }
+        if (current < 0) continue;
+
+        if (tok[0] == "INST") {
+            if (n < 4 || n > 5) { fail(0, "expected INST <cell> <x> <y> [orient]"); continue; }
+            HierInstance I{};
+            int x, y;
+            if (!toInt(2, x) || !toInt(3, y)) continue;
+            if (n == 5 && !Transform::fromName(std::string(tok[4]), I.t)) {
+                fail(4, "unknown orientation '" + std::string(tok[4]) + "'");
+                continue;
+            }
+            I.t.dx = x; I.t.dy = y;
+            I.cell = cellId(tok[1]);          // 可能新增 cell，之後才取 cells[current] 的參考
+            I.line = line;
+            HierCell& C = H.cells[current];
+            C.items.push_back({1, -1, (int)C.insts.size()});
+            C.insts.push_back(I);
+            continue;
+        }
+
+        if (n != 5) { fail(n < 5 ? 0 : 5, n < 5 ? "expected 4 coordinates, got " + std::to_string(n - 1)
+                                                : "unexpected trailing text"); continue; }
+        int c[4];
+        if (!toInt(1, c[0]) || !toInt(2, c[1]) || !toInt(3, c[2]) || !toInt(4, c[3])) continue;
+        HierCell& C = H.cells[current];
+        const int id = H.layers.intern(tok[0]);
+        const int k = (int)(id < C.own.numLayers() ? C.own.byLayer[id].size() : 0);
+        C.own.add(id, std::min(c[0], c[2]), std::min(c[1], c[3]), std::max(c[0], c[2]), std::max(c[1], c[3]),
+                  (long long)C.own.count);
+        C.items.push_back({0, id, k});
+    }
+    if (current > 0) errs.push_back({line, 1, "missing END for cell '" + H.cells[current].name + "'"});
+
+    // 2) 找不到的 cell、遞迴引用：那一筆 INST 當壞行略過
+    for (auto& C : H.cells)
+        for (auto& I : C.insts)
+            if (!defined[I.cell]) {
+                errs.push_back({I.line, 1, "undefined cell '" + H.cells[I.cell].name + "'"});
+                I.cell = -1;
+            }
+    std::vector<char> state(H.cells.size(), 0);          // 0 未訪、1 走訪中、2 完成
+    std::function<void(int)> visit = [&](int c){
+        state[c] = 1;
+        for (auto& I : H.cells[c].insts) {
+            if (I.cell < 0) continue;
+            if (state[I.cell] == 1) {
+                errs.push_back({I.line, 1, "recursive instance of cell '" + H.cells[I.cell].name + "'"});
+                I.cell = -1;
+                continue;
+            }
+            if (state[I.cell] == 0) visit(I.cell);
+        }
+        state[c] = 2;
+        H.order.push_back(c);
+    };
+    visit(0);
+
+    // 3) 由下而上：展平順序的 offset、各層外框
+    const int nL = (int)H.layers.size();
+    for (int c : H.order) {
+        HierCell& C = H.cells[c];
+        C.own.layers = H.layers;
+        C.own.byLayer.resize(nL);
+        C.ownFlat.assign(nL, {});
+        C.layerBox.assign(nL, Box{1, 1, 0, 0});
+
+        std::vector<HierInstance> insts;
+        std::vector<HierCell::Item> items;
+        long long f = 0;
+        for (const auto& it : C.items) {
+            if (it.kind == 0) {
+                C.ownFlat[it.layer].push_back(f++);
+                unite(C.layerBox[it.layer], boxAt(C.own.byLayer[it.layer], it.k));
+                items.push_back(it);
+                continue;
+            }
+            HierInstance I = C.insts[it.k];
+            if (I.cell < 0) continue;
+            const HierCell& child = H.cells[I.cell];
+            I.offset = f;
+            f += child.flatCount;
+            I.bbox = isEmpty(child.bbox) ? child.bbox : I.t.apply(child.bbox);
+            for (int l = 0; l < nL; ++l)
+                if (!isEmpty(child.layerBox[l])) unite(C.layerBox[l], I.t.apply(child.layerBox[l]));
+            items.push_back({1, -1, (int)insts.size()});
+            insts.push_back(I);
+        }
+        C.insts = std::move(insts);
+        C.items = std::move(items);
+        C.flatCount = f;
+        C.bbox = Box{1, 1, 0, 0};
+        for (const auto& b : C.layerBox) unite(C.bbox, b);
+    }
+
+    // 第 2 步的錯誤是事後補的，依行號排回檔案順序
+    std::stable_sort(errs.begin(), errs.end(), [](const ParseError& l, const ParseError& r){ return l.line < r.line; });
+    reportParseErrors(file, errs, errors);
+    return H;
+}
+
+
+ShapeStore flattenHier(const HierLayout& H){
+    if (H.flatCount() > INT_MAX) throw std::runtime_error("layout too large to flatten");
+    ShapeStore store;
+    store.layers = H.layers;
+    store.byLayer.resize(H.layers.size());
+    std::function<void(int, const Transform&)> emit = [&](int c, const Transform& T){
+        const HierCell& C = H.cells[c];
+        for (const auto& it : C.items) {
+            if (it.kind == 0) {
+                Box r = T.apply(boxAt(C.own.byLayer[it.layer], it.k));
+                store.add(it.layer, r.x1, r.y1, r.x2, r.y2);
+            } else {
+                const HierInstance& I = C.insts[it.k];
+                emit(I.cell, I.t.then(T));
+            }
+        }
+    };
+    if (!H.cells.empty()) emit(0, Transform{});
+    return store;
+}
+
+
+// ---- 階層 DRC ----
+
+namespace {
+
+struct Encl { int under = INT_MIN, over = INT_MIN; };   // INT_MIN = 沒有任何金屬碰到 via
+using Overrides = std::vector<std::pair<long long, Encl>>;   // (展平 index, 值)，依 index 遞增
+
+struct CellData {
+    std::vector<LayerGrid> grids;                // [layer]：直屬矩形
+    LayerGrid instGrid;                          // instance 外框
+    std::vector<int> gridInst;                   // instGrid 的序號 → insts 的序號（空 cell 不進網格）
+    std::vector<ViolationRecord> records;        // 本 cell 新增的 width / spacing（本地座標、本地 index）
+    std::vector<std::vector<Encl>> viaVal;       // [via 規則][k]：直屬 via 在本 cell 內的最佳包覆
+    std::vector<std::vector<int>> badVias;       // [via 規則]：viaVal 會產生 record 的 k（遞增）
+    std::vector<Overrides> overrides;            // [via 規則]：子 instance 裡、被本 cell 其他金屬改變的 via
+    bool hasOutput = false;                      // 整棵子樹（不計祖先的 override）有沒有任何 record
+};
+
+using ShapeFn = std::function<void(const Box&, long long)>;
+
+class HierChecker {
+public:
+    HierChecker(const HierLayout& H, const RuleSet& rules)
+        : H(H), rules(rules), bound(bindRules(rules, H.layers)), data(H.cells.size()) {}
+
+    std::vector<Violation> run(const Box& die){
+        for (int c : H.order) analyze(c);
+        std::vector<ViolationRecord> R;
+        if (!H.cells.empty()) emit(0, Transform{}, 0, std::vector<Overrides>(bound.vias.size()), R);
+        density(die, R);
+
+        const RecordContext ctx(H.layers, bound);
+        std::stable_sort(R.begin(), R.end(), recordLess);
+        std::vector<Violation> out;
+        out.reserve(R.size());
+        for (const auto& r : R) out.push_back(toViolation(r, ctx));
+        return out;
+    }
+
+private:
+    const HierLayout& H;
+    const RuleSet& rules;
+    const BoundRules bound;
+    std::vector<CellData> data;
+
+    // cell c 展平後第 layer 層、碰到 region（c 的座標）的矩形，回傳 c 座標下的框與 c 內的展平 index
+    void collect(int c, const Box& region, int layer, const ShapeFn& fn) const {
+        const HierCell& C = H.cells[c];
+        if (layer < 0 || isEmpty(C.layerBox[layer]) || !touches(C.layerBox[layer], region)) return;
+        const CellData& D = data[c];
+        const LayerShapes& L = C.own.byLayer[layer];
+        std::vector<int> hits;
+        if (L.size()) {
+            D.grids[layer].query(region.x1, region.y1, region.x2, region.y2, hits);
+            for (int k : hits) {
+                const Box r = boxAt(L, k);
+                if (touches(r, region)) fn(r, C.ownFlat[layer][k]);
+            }
+        }
+        if (D.gridInst.empty()) return;
+        D.instGrid.query(region.x1, region.y1, region.x2, region.y2, hits);
+        for (int g : hits) {
+            const HierInstance& I = C.insts[D.gridInst[g]];
+            if (!touches(I.bbox, region)) continue;
+            collect(I.cell, I.t.inverse().apply(region), layer,
+                    [&](const Box& r, long long f){ fn(I.t.apply(r), I.offset + f); });
+        }
+    }
+
+    // c 的其他部分（直屬矩形 + 第 skip 個以外的 instance；onlyAfter 時只算序號比 skip 大的）碰到 region 的矩形
+    void collectOthers(int c, size_t skip, bool onlyAfter, const Box& region, int layer, const ShapeFn& fn) const {
+        const HierCell& C = H.cells[c];
+        const CellData& D = data[c];
+        const LayerShapes& L = C.own.byLayer[layer];
+        std::vector<int> hits;
+        if (L.size()) {
+            D.grids[layer].query(region.x1, region.y1, region.x2, region.y2, hits);
+            for (int k : hits) {
+                const Box r = boxAt(L, k);
+                if (touches(r, region)) fn(r, C.ownFlat[layer][k]);
+            }
+        }
+        if (D.gridInst.empty()) return;
+        D.instGrid.query(region.x1, region.y1, region.x2, region.y2, hits);
+        for (int g : hits) {
+            const size_t j = (size_t)D.gridInst[g];
+            if (j == skip || (onlyAfter && j < skip)) continue;
+            const HierInstance& J = C.insts[j];
+            if (!touches(J.bbox, region)) continue;
+            collect(J.cell, J.t.inverse().apply(region), layer,
+                    [&](const Box& r, long long f){ fn(J.t.apply(r), J.offset + f); });
+        }
+    }
+
+    // cell c 內展平 index f 的 via 在 c 裡的最終包覆值
+    Encl finalEncl(int c, long long f, size_t rule) const {
+        const HierCell& C = H.cells[c];
+        const CellData& D = data[c];
+        const Overrides& ov = D.overrides[rule];
+        auto it = std::lower_bound(ov.begin(), ov.end(), f, [](const auto& e, long long v){ return e.first < v; });
+        if (it != ov.end() && it->first == f) return it->second;
+        const auto& own = C.ownFlat[bound.vias[rule].via];
+        auto k = std::lower_bound(own.begin(), own.end(), f);
+        if (k != own.end() && *k == f) return D.viaVal[rule][k - own.begin()];
+        auto I = std::upper_bound(C.insts.begin(), C.insts.end(), f,
+                                  [](long long v, const HierInstance& x){ return v < x.offset; });
+        if (I == C.insts.begin()) return {};
+        --I;
+        return finalEncl(I->cell, f - I->offset, rule);
+    }
+
+    bool enclBad(const Encl& e, int need) const {
+        return e.under == INT_MIN || e.under != need || e.over == INT_MIN || e.over != need;
+    }
+
+    // 與 drc.cpp 的 enclosure_via 相同：沒金屬 = missing；剛好 = 不列；過包 = PASS
+    void pushEncl(const BoundRules::Via& cfg, const Encl& e, const Box& via, long long idx,
+                  std::vector<ViolationRecord>& out) const {
+        for (int sub = 0; sub < 2; ++sub) {
+            const int best = sub == 0 ? e.under : e.over;
+            ViolationRecord r;
+            r.cat = 2; r.a = cfg.rank; r.b = idx; r.sub = (unsigned char)sub; r.ref = cfg.rank;
+            r.x1 = via.x1; r.y1 = via.y1; r.x2 = via.x2; r.y2 = via.y2;
+            r.threshold = cfg.min_enclose;
+            if (best == INT_MIN) { r.missing = 1; out.push_back(r); continue; }
+            const int diff = best - cfg.min_enclose;
+            if (diff == 0) continue;
+            r.actual = best;
+            r.pass = diff >= 0;
+            out.push_back(r);
+        }
+    }
+
+    void analyze(int c){
+        const HierCell& C = H.cells[c];
+        CellData& D = data[c];
+        const int nL = (int)H.layers.size();
+
+        // 網格：直屬矩形每層一張、instance 外框一張
+        D.grids.resize(nL);
+        for (int l = 0; l < nL; ++l)
+            if (C.own.byLayer[l].size())
+                D.grids[l] = LayerGrid(C.own.byLayer[l], std::max(1, bound.layer[l].min_spacing));
+        LayerShapes boxes;
+        for (size_t i = 0; i < C.insts.size(); ++i) {
+            const Box& b = C.insts[i].bbox;
+            if (isEmpty(b)) continue;
+            boxes.x1.push_back(b.x1); boxes.y1.push_back(b.y1);
+            boxes.x2.push_back(b.x2); boxes.y2.push_back(b.y2);
+            boxes.idx.push_back((int)D.gridInst.size());
+            D.gridInst.push_back((int)i);
+        }
+        if (!D.gridInst.empty()) D.instGrid = LayerGrid(boxes, 1);
+
+        // width：只看直屬矩形（轉向不影響長短邊）
+        for (int l = 0; l < nL; ++l) {
+            const int minW = bound.layer[l].min_width, maxW = bound.layer[l].max_width;
+            if (minW < 0 && maxW < 0) continue;
+            const LayerShapes& L = C.own.byLayer[l];
+            for (size_t k = 0; k < L.size(); ++k) {
+                const int w = L.x2[k] - L.x1[k], h = L.y2[k] - L.y1[k];
+                const int sw = std::min(w, h), lw = std::max(w, h);
+                auto push = [&](int sub, int actual, int thr){
+                    ViolationRecord r;
+                    r.cat = 0; r.a = C.ownFlat[l][k]; r.sub = (unsigned char)sub; r.ref = l;
+                    r.x1 = L.x1[k]; r.y1 = L.y1[k]; r.x2 = L.x2[k]; r.y2 = L.y2[k];
+                    r.actual = actual; r.threshold = thr;
+                    D.records.push_back(r);
+                };
+                if (minW >= 0 && sw < minW) push(0, sw, minW);
+                if (maxW >= 0 && lw > maxW) push(1, lw, maxW);
+            }
+        }
+
+        // spacing：直屬 × 直屬，再來是每個 instance × (直屬 + 後面的 instance)；instance 自己內部由子 cell 負責
+        auto pushSpacing = [&](int l, long long f1, long long f2, double d, int S){
+            ViolationRecord r;
+            r.cat = 1; r.a = std::min(f1, f2); r.b = std::max(f1, f2); r.ref = l;
+            r.actual = d; r.threshold = S;
+            D.records.push_back(r);
+        };
+        std::vector<int> hits;
+        for (int l = 0; l < nL; ++l) {
+            const int S = bound.layer[l].min_spacing;
+            if (S < 0) continue;
+            const LayerShapes& L = C.own.byLayer[l];
+            for (size_t k = 0; k < L.size(); ++k) {
+                const Box a = boxAt(L, k), q = grow(a, S);
+                D.grids[l].query(q.x1, q.y1, q.x2, q.y2, hits);
+                for (int j : hits) {
+                    if ((size_t)j <= k) continue;
+                    const double d = rectSpacing(shapeOf(l, a), shapeOf(l, boxAt(L, j)));
+                    if (d + EPS < S) pushSpacing(l, C.ownFlat[l][k], C.ownFlat[l][j], d, S);
+                }
+            }
+            for (size_t i = 0; i < C.insts.size(); ++i) {
+                const HierInstance& I = C.insts[i];
+                const Box& cb = H.cells[I.cell].layerBox[l];
+                if (isEmpty(cb)) continue;
+                const Box ri = I.t.apply(cb);
+                const Transform inv = I.t.inverse();
+                collectOthers(c, i, true, grow(ri, S), l, [&](const Box& e, long long fe){
+                    const Box q = grow(e, S);
+                    if (!touches(q, ri)) return;
+                    collect(I.cell, inv.apply(q), l, [&](const Box& sl, long long fs){
+                        const double d = rectSpacing(shapeOf(l, e), shapeOf(l, I.t.apply(sl)));
+                        if (d + EPS < S) pushSpacing(l, fe, I.offset + fs, d, S);
+                    });
+                });
+            }
+        }
+
+        // enclosure：直屬 via 對本 cell 展平後的金屬；子 instance 的 via 只在外面的金屬碰到它們時重算
+        const size_t nV = bound.vias.size();
+        D.viaVal.assign(nV, {});
+        D.badVias.assign(nV, {});
+        D.overrides.assign(nV, {});
+        for (size_t r = 0; r < nV; ++r) {
+            const auto& cfg = bound.vias[r];
+            if (cfg.via < 0) continue;
+            const LayerShapes& V = C.own.byLayer[cfg.via];
+            D.viaVal[r].resize(V.size());
+            for (size_t k = 0; k < V.size(); ++k) {
+                const Box v = boxAt(V, k);
+                Encl& e = D.viaVal[r][k];
+                for (int sub = 0; sub < 2; ++sub) {
+                    int& best = sub == 0 ? e.under : e.over;
+                    collect(c, v, sub == 0 ? cfg.under : cfg.over, [&](const Box& m, long long){
+                        best = std::max(best, enclosureMargin(shapeOf(0, m), shapeOf(0, v)));
+                    });
+                }
+                if (enclBad(e, cfg.min_enclose)) D.badVias[r].push_back((int)k);
+            }
+
+            std::unordered_map<long long, std::pair<Encl, Encl>> ov;   // via → (子 cell 裡的值, 加上外面金屬後)
+            for (size_t i = 0; i < C.insts.size(); ++i) {
+                const HierInstance& I = C.insts[i];
+                const Box& vb = H.cells[I.cell].layerBox[cfg.via];
+                if (isEmpty(vb)) continue;
+                const Box rv = I.t.apply(vb);
+                const Transform inv = I.t.inverse();
+                for (int sub = 0; sub < 2; ++sub) {
+                    const int metal = sub == 0 ? cfg.under : cfg.over;
+                    if (metal < 0) continue;
+                    collectOthers(c, i, false, rv, metal, [&](const Box& m, long long){
+                        collect(I.cell, inv.apply(m), cfg.via, [&](const Box& vl, long long fv){
+                            const long long key = I.offset + fv;
+                            auto it = ov.find(key);
+                            if (it == ov.end()) {
+                                const Encl e = finalEncl(I.cell, fv, r);
+                                it = ov.emplace(key, std::make_pair(e, e)).first;
+                            }
+                            int& best = sub == 0 ? it->second.second.under : it->second.second.over;
+                            best = std::max(best, enclosureMargin(shapeOf(0, m), shapeOf(0, I.t.apply(vl))));
+                        });
+                    });
+                }
+            }
+            // 外面的金屬沒有包得更好的 via 不必記（祖先查 finalEncl 會自己落到子 cell）
+            for (const auto& [key, v] : ov)
+                if (v.first.under != v.second.under || v.first.over != v.second.over)
+                    D.overrides[r].push_back({key, v.second});
+            std::sort(D.overrides[r].begin(), D.overrides[r].end(),
+                      [](const auto& x, const auto& y){ return x.first < y.first; });
+        }
+
+        D.hasOutput = !D.records.empty();
+        for (size_t r = 0; r < nV; ++r) D.hasOutput |= !D.badVias[r].empty() || !D.overrides[r].empty();
+        for (const auto& I : C.insts) D.hasOutput |= data[I.cell].hasOutput;
+    }
+
+    // 由上而下展開有 record 的子樹；active = 祖先的 override（全域 index，已裁到本 instance 的範圍），祖先優先
+    void emit(int c, const Transform& T, long long base, const std::vector<Overrides>& active,
+              std::vector<ViolationRecord>& out) const {
+        const HierCell& C = H.cells[c];
+        const CellData& D = data[c];
+        bool anyActive = false;
+        for (const auto& a : active) anyActive |= !a.empty();
+        if (!D.hasOutput && !anyActive) return;
+
+        for (ViolationRecord r : D.records) {
+            r.a += base;
+            if (r.cat == 1) r.b += base;
+            else {
+                const Box g = T.apply(Box{r.x1, r.y1, r.x2, r.y2});
+                r.x1 = g.x1; r.y1 = g.y1; r.x2 = g.x2; r.y2 = g.y2;
+            }
+            out.push_back(r);
+        }
+
+        const size_t nV = bound.vias.size();
+        std::vector<Overrides> merged(nV);
+        for (size_t r = 0; r < nV; ++r) {
+            const auto& cfg = bound.vias[r];
+            if (cfg.via < 0) continue;
+            // 祖先的 override 與本 cell 的合併（同一個 via 以祖先為準：祖先看得到的金屬比較多）
+            const Overrides& up = active[r];
+            Overrides& m = merged[r];
+            size_t i = 0;
+            for (const auto& [f, e] : D.overrides[r]) {
+                const long long key = base + f;
+                while (i < up.size() && up[i].first < key) m.push_back(up[i++]);
+                if (i < up.size() && up[i].first == key) m.push_back(up[i++]);
+                else m.push_back({key, e});
+            }
+            m.insert(m.end(), up.begin() + i, up.end());
+
+            // 直屬 via：有 override 的用 override，其餘用 badVias
+            const LayerShapes& V = C.own.byLayer[cfg.via];
+            const auto& own = C.ownFlat[cfg.via];
+            std::vector<int> overridden;
+            for (const auto& [key, e] : m) {
+                auto k = std::lower_bound(own.begin(), own.end(), key - base);
+                if (k == own.end() || *k != key - base) continue;
+                const int kk = (int)(k - own.begin());
+                overridden.push_back(kk);
+                pushEncl(cfg, e, T.apply(boxAt(V, kk)), key, out);
+            }
+            size_t o = 0;
+            for (int k : D.badVias[r]) {
+                while (o < overridden.size() && overridden[o] < k) ++o;
+                if (o < overridden.size() && overridden[o] == k) continue;
+                pushEncl(cfg, D.viaVal[r][k], T.apply(boxAt(V, k)), base + own[k], out);
+            }
+        }
+
+        std::vector<Overrides> slice(nV);
+        for (const auto& I : C.insts) {
+            const long long lo = base + I.offset, hi = lo + H.cells[I.cell].flatCount;
+            bool any = false;
+            for (size_t r = 0; r < nV; ++r) {
+                const Overrides& m = merged[r];
+                auto key = [](const auto& e, long long v){ return e.first < v; };
+                auto b = std::lower_bound(m.begin(), m.end(), lo, key), e = std::lower_bound(m.begin(), m.end(), hi, key);
+                slice[r].assign(b, e);
+                any |= b != e;
+            }
+            if (!any && !data[I.cell].hasOutput) continue;
+            emit(I.cell, I.t.then(T), lo, slice, out);
+        }
+    }
+
+    // density 要各 window 的面積總和：把落在 map 範圍內的 density 層矩形逐一展開加進去
+    void density(const Box& die, std::vector<ViolationRecord>& out) const {
+        if (H.cells.empty()) return;
+        auto feed = [&](DensityMap& map){
+            const Box bounds = map.bounds();
+            std::function<void(int, const Transform&)> add = [&](int c, const Transform& T){
+                const HierCell& C = H.cells[c];
+                const CellData& D = data[c];
+                const Box local = T.inverse().apply(bounds);
+                std::vector<int> hits;
+                for (int l = 0; l < (int)H.layers.size(); ++l) {
+                    if (!bound.density[l] || !C.own.byLayer[l].size()) continue;
+                    D.grids[l].query(local.x1, local.y1, local.x2, local.y2, hits);
+                    for (int k : hits) {
+                        const Box r = T.apply(boxAt(C.own.byLayer[l], k));
+                        map.add(r.x1, r.y1, r.x2, r.y2);
+                    }
+                }
+                for (const auto& I : C.insts)
+                    if (!isEmpty(I.bbox) && touches(T.apply(I.bbox), bounds)) add(I.cell, I.t.then(T));
+            };
+            add(0, Transform{});
+        };
+        for (const auto& w : densityWindows(feed, rules, die.x1, die.y1, die.x2, die.y2)) {
+            if (w.density + EPS < rules.min_density) {
+                ViolationRecord r;
+                r.cat = 3; r.a = w.y1; r.b = w.x1;
+                r.x1 = w.x1; r.y1 = w.y1; r.x2 = w.x2; r.y2 = w.y2;
+                r.actual = w.density; r.threshold = rules.min_density;
+                out.push_back(r);
+            }
+        }
+    }
+};
+
+} // namespace
+
+std::vector<Violation> run_drc_hier(const HierLayout& layout, const RuleSet& rules,
+                                    int die_x1,int die_y1,int die_x2,int die_y2){
+    return HierChecker(layout, rules).run({die_x1, die_y1, die_x2, die_y2});
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "common.hpp"
+#include "drc.hpp"
+#include "parser.hpp"
+#include <string>
+#include <vector>
+
+// ---- 階層式 layout ----
+// 文字格式與平面的 layout*.txt 相容，多了三種行：
+//   CELL <name>                    開始定義一個 cell
+//   <layer> x1 y1 x2 y2            矩形；在 CELL … END 之外就屬於頂層
+//   INST <cell> <x> <y> [orient]   放一個 instance：先依 orient 轉，再平移 (x,y)
+//                                  orient = R0（預設）R90 R180 R270 MX MY MXR90 MYR90（MX = 對 x 軸鏡射）
+//   END                            結束目前的 cell
+// cell 可以先用後定義；不可以直接或間接引用自己。
+// 展平後的全域 shape index 依檔案順序、INST 就地展開，報表的 idx 就是這個 index：
+// 把同一份 layout 展平成平面檔再跑，報表逐位相同（矩形一律正規化成 x1<=x2、y1<=y2）。
+
+// 8 種 Manhattan 方向 + 平移：x' = a·x + b·y + dx，y' = c·x + d·y + dy
+struct Transform {
+    int a = 1, b = 0, c = 0, d = 1;
+    long long dx = 0, dy = 0;
+
+    static bool fromName(const std::string& name, Transform& t);   // "R90" → 旋轉部分
+    Box apply(const Box& r) const;                      // 轉完再正規化
+    Transform then(const Transform& outer) const;       // 先套自己、再套 outer
+    Transform inverse() const;
+};
+
+struct HierInstance {
+    int cell;
+    Transform t;
+    long long offset;    // 在父 cell 展平順序中的起點
+    Box bbox;            // 父 cell 座標下的外框
+    size_t line;         // 檔案行號（錯誤訊息用）
+};
+
+struct HierCell {
+    std::string name;
+    ShapeStore own;                                // 直屬的矩形；layers = HierLayout::layers，idx = 直屬序號
+    std::vector<std::vector<long long>> ownFlat;   // ownFlat[layer][k]：在本 cell 展平順序中的 index（遞增）
+    std::vector<HierInstance> insts;               // 依檔案順序，offset 遞增
+    long long flatCount = 0;                       // 展平後的 shape 數
+    std::vector<Box> layerBox;                     // 各層展平後的外框；沒有 shape 時 x1 > x2
+    Box bbox{1, 1, 0, 0};                          // 所有層的外框
+
+    // 檔案中的出現順序（ownFlat / offset 由它算出）：kind 0 = 直屬矩形 (layer, k)，1 = insts[k]
+    struct Item { int kind, layer, k; };
+    std::vector<Item> items;
+};
+
+struct HierLayout {
+    LayerTable layers;
+    std::vector<HierCell> cells;   // cells[0] = 頂層
+    std::vector<int> order;        // 由下而上（子 cell 在前）的拓撲順序
+
+    long long flatCount() const { return cells.empty() ? 0 : cells[0].flatCount; }
+    size_t uniqueShapes() const;   // 所有 cell 直屬矩形的總數
+    size_t instanceCount() const;  // 所有 cell 裡 INST 的總數（不展開）
+};
+
+// 檔案裡有 CELL / INST 行就是階層式
+bool isHierarchicalLayout(const std::string& file);
+// 同上，只看記憶體裡的一段文字（完整的行）；邊讀邊查、不想先掃整份檔案時用
+bool hasHierKeyword(const char* data, size_t size);
+// 壞行（格式錯誤、找不到 cell、遞迴引用）記下來後略過，規則同 readLayout；層名依 rules 的 layer_mapping 換成正名
+HierLayout readHierLayout(const std::string& file, const RuleSet& rules, std::vector<ParseError>* errors = nullptr);
+// 展平成一般的 ShapeStore（連線萃取等還沒有階層版的功能用）；超過 int 能表示的 shape 數會丟例外
+ShapeStore flattenHier(const HierLayout& layout);
+
+// 階層 DRC：每個 cell 的內部只查一次，instance 之間（與父 cell 的矩形）只在外框互相靠近的區域補查；
+// via enclosure 只在外面的金屬碰到 instance 時才重新計算那些 via。
+// 結果與 run_drc(flattenHier(layout), ...) 相同（同樣依 (cat,a,b,sub) 排序）。
+// density 需要各 window 的面積總和，仍然逐一展開落在 die 內的 density 層矩形（不保留展平結果）。
+std::vector<Violation> run_drc_hier(const HierLayout& layout, const RuleSet& rules,
+                                    int die_x1,int die_y1,int die_x2,int die_y2);
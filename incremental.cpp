@@ -0,0 +1,713 @@
+#include "incremental.hpp"
+#include "layoutbin.hpp"
+#include "mmapfile.hpp"
+#include "parser.hpp"
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+
+// =================== LiveLayout ===================
+
+LiveLayout::LiveLayout(const ShapeStore& store, long long gapAt, long long gapSize) : table(store.layers) {
+    gapSize = std::max(0LL, gapSize);
+    const size_t n = store.count + (size_t)gapSize;
+    layerOf.assign(n, -1);
+    x1.assign(n, 0); y1.assign(n, 0); x2.assign(n, 0); y2.assign(n, 0);
+    for (int id = 0; id < store.numLayers(); ++id){
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k){
+            long long s = L.idx[k];
+            if (s >= gapAt) s += gapSize;
+            layerOf[s] = id;
+            x1[s] = L.x1[k]; y1[s] = L.y1[k]; x2[s] = L.x2[k]; y2[s] = L.y2[k];
+        }
+    }
+    live = store.count;
+    growBit(n);
+    rebuildIndex();
+}
+
+void LiveLayout::growBit(size_t need){
+    size_t cap = bit.empty() ? 0 : bit.size() - 1;
+    if (need <= cap && !bit.empty()) return;
+    cap = std::max<size_t>(cap, 1024);
+    while (cap < need) cap *= 2;
+    // 線性建樹：每個節點把自己加到父節點
+    bit.assign(cap + 1, 0);
+    for (size_t i = 1; i <= cap; ++i){
+        if (i - 1 < layerOf.size() && layerOf[i - 1] >= 0) bit[i] += 1;
+        size_t j = i + (i & (~i + 1));
+        if (j <= cap) bit[j] += bit[i];
+    }
+}
+
+void LiveLayout::bitAdd(int slot, int d){
+    const size_t cap = bit.size() - 1;
+    for (size_t i = (size_t)slot + 1; i <= cap; i += i & (~i + 1)) bit[i] += d;
+}
+
+long long LiveLayout::idxOf(int slot) const {
+    long long s = 0;
+    for (size_t i = (size_t)slot; i > 0; i -= i & (~i + 1)) s += bit[i];
+    return s;
+}
+
+int LiveLayout::slotOf(long long idx) const {
+    const size_t cap = bit.size() - 1;
+    size_t pos = 0;
+    long long rem = idx + 1;
+    for (size_t step = cap; step > 0; step >>= 1)
+        if (pos + step <= cap && bit[pos + step] < rem){
+            pos += step;
+            rem -= bit[pos];
+        }
+    return (int)pos;   // 1 起算的 pos + 1 就是目標，換回 0 起算的 slot 剛好是 pos
+}
+
+// 格子大小與 LayerGrid 同樣的取法（minCell = 1）；網格之外的 shape 夾到邊上的格子
+void LiveLayout::rebuildIndex(){
+    grids.assign(table.size(), Grid{});
+    std::vector<std::vector<int>> regular(table.size());
+    std::vector<long long> bx1(table.size(), LLONG_MAX), by1(table.size(), LLONG_MAX),
+                           bx2(table.size(), LLONG_MIN), by2(table.size(), LLONG_MIN), ext(table.size(), 0);
+    for (int s = 0; s < slots(); ++s){
+        const int id = layerOf[s];
+        if (id < 0) continue;
+        if (x1[s] > x2[s] || y1[s] > y2[s]){ grids[id].irregular.push_back(s); continue; }
+        regular[id].push_back(s);
+        bx1[id] = std::min<long long>(bx1[id], x1[s]); by1[id] = std::min<long long>(by1[id], y1[s]);
+        bx2[id] = std::max<long long>(bx2[id], x2[s]); by2[id] = std::max<long long>(by2[id], y2[s]);
+        ext[id] += std::max(x2[s] - x1[s], y2[s] - y1[s]);
+    }
+    for (size_t id = 0; id < table.size(); ++id){
+        const std::vector<int>& R = regular[id];
+        if (R.empty()) continue;
+        Grid& g = grids[id];
+        long long c = std::max<long long>(1, ext[id] / (long long)R.size());
+        const long long cap = 4LL * (long long)R.size() + 64;
+        while (((bx2[id] - bx1[id]) / c + 1) * ((by2[id] - by1[id]) / c + 1) > cap) c *= 2;
+        g.x0 = bx1[id]; g.y0 = by1[id]; g.cell = c;
+        g.nx = (int)((bx2[id] - bx1[id]) / c + 1);
+        g.ny = (int)((by2[id] - by1[id]) / c + 1);
+        g.start.assign((size_t)g.nx * g.ny + 1, 0);
+        auto forCells = [&](int s, auto&& fn){
+            for (long long cy = (y1[s] - g.y0) / c; cy <= (y2[s] - g.y0) / c; ++cy)
+                for (long long cx = (x1[s] - g.x0) / c; cx <= (x2[s] - g.x0) / c; ++cx)
+                    fn((size_t)cy * g.nx + (size_t)cx);
+        };
+        for (int s : R) forCells(s, [&](size_t k){ ++g.start[k + 1]; });
+        for (size_t k = 1; k < g.start.size(); ++k) g.start[k] += g.start[k - 1];
+        g.items.resize(g.start.back());
+        std::vector<int> fill(g.start.begin(), g.start.end() - 1);
+        for (int s : R) forCells(s, [&](size_t k){ g.items[fill[k]++] = s; });
+    }
+    built = live;
+    changes = 0;
+}
+
+void LiveLayout::indexSlot(int s){
+    const int id = layerOf[s];
+    if ((size_t)id >= grids.size()) grids.resize(table.size());
+    Grid& g = grids[id];
+    if (g.nx == 0 || x1[s] > x2[s] || y1[s] > y2[s]){ g.irregular.push_back(s); return; }   // 這層建網格時還沒有 shape 也先放這裡
+    auto cellX = [&](long long v){ return (int)std::min<long long>(std::max<long long>((v - g.x0) / g.cell, 0), g.nx - 1); };
+    auto cellY = [&](long long v){ return (int)std::min<long long>(std::max<long long>((v - g.y0) / g.cell, 0), g.ny - 1); };
+    for (int cy = cellY(y1[s]); cy <= cellY(y2[s]); ++cy)
+        for (int cx = cellX(x1[s]); cx <= cellX(x2[s]); ++cx)
+            g.extra[(size_t)cy * g.nx + cx].push_back(s);
+}
+
+void LiveLayout::place(int slot, const Shape& s){
+    if (slot == slots()){
+        layerOf.push_back(-1);
+        x1.push_back(0); y1.push_back(0); x2.push_back(0); y2.push_back(0);
+        growBit(layerOf.size());
+    }
+    layerOf[slot] = s.layer;
+    x1[slot] = s.x1; y1[slot] = s.y1; x2[slot] = s.x2; y2[slot] = s.y2;
+    bitAdd(slot, 1);
+    ++live;
+    indexSlot(slot);
+    if (++changes > built / 2 + 1024) rebuildIndex();
+}
+
+void LiveLayout::remove(int slot){
+    if (layerOf[slot] < 0) return;
+    layerOf[slot] = -1;           // 網格裡的項目留著，查詢時濾掉
+    bitAdd(slot, -1);
+    --live;
+    if (++changes > built / 2 + 1024) rebuildIndex();
+}
+
+void LiveLayout::query(int layer, int qx1,int qy1,int qx2,int qy2, std::vector<int>& out) const {
+    if (layer < 0 || (size_t)layer >= grids.size()) return;
+    const Grid& g = grids[layer];
+    for (int s : g.irregular) if (layerOf[s] >= 0) out.push_back(s);
+    if (g.nx == 0) return;
+    auto hit = [&](int s){
+        return layerOf[s] >= 0 && !(x2[s] < qx1 || qx2 < x1[s] || y2[s] < qy1 || qy2 < y1[s]);
+    };
+    auto cellX = [&](long long v){ return (int)std::min<long long>(std::max<long long>((v - g.x0) / g.cell, 0), g.nx - 1); };
+    auto cellY = [&](long long v){ return (int)std::min<long long>(std::max<long long>((v - g.y0) / g.cell, 0), g.ny - 1); };
+    for (int cy = cellY(qy1); cy <= cellY(qy2); ++cy)
+        for (int cx = cellX(qx1); cx <= cellX(qx2); ++cx){
+            const size_t k = (size_t)cy * g.nx + cx;
+            for (int p = g.start[k]; p < g.start[k + 1]; ++p)
+                if (hit(g.items[p])) out.push_back(g.items[p]);
+            if (g.extra.empty()) continue;
+            auto it = g.extra.find(k);
+            if (it == g.extra.end()) continue;
+            for (int s : it->second) if (hit(s)) out.push_back(s);
+        }
+}
+
+ShapeStore LiveLayout::toStore() const {
+    ShapeStore store;
+    store.layers = table;
+    store.byLayer.resize(table.size());
+    for (int s = 0; s < slots(); ++s)
+        if (layerOf[s] >= 0) store.add(layerOf[s], x1[s], y1[s], x2[s], y2[s]);
+    return store;
+}
+
+ShapeStore LiveLayout::subset(std::vector<int>& pick) const {
+    std::sort(pick.begin(), pick.end());
+    pick.erase(std::unique(pick.begin(), pick.end()), pick.end());
+    ShapeStore store;
+    store.layers = table;
+    store.byLayer.resize(table.size());
+    for (int s : pick)
+        if (layerOf[s] >= 0) store.add(layerOf[s], x1[s], y1[s], x2[s], y2[s], s);
+    return store;
+}
+
+std::vector<int> LiveLayout::compact(){
+    std::vector<int> map(layerOf.size(), -1);
+    int n = 0;
+    for (int s = 0; s < slots(); ++s){
+        if (layerOf[s] < 0) continue;
+        map[s] = n;
+        layerOf[n] = layerOf[s];
+        x1[n] = x1[s]; y1[n] = y1[s]; x2[n] = x2[s]; y2[n] = y2[s];
+        ++n;
+    }
+    for (auto* col : {&layerOf, &x1, &y1, &x2, &y2}) col->resize((size_t)n);
+    bit.clear();
+    growBit((size_t)n);
+    rebuildIndex();
+    return map;
+}
+
+
+// =================== 增量 DRC ===================
+
+namespace {
+
+void clearPending(IncrementalState& st){
+    st.dirty.clear();
+    st.added.clear();
+    st.moved.clear();
+    st.numAdded = st.numRemoved = 0;
+}
+
+void markDirty(IncrementalState& st, const Shape& s){
+    st.dirty.push_back({std::min(s.x1, s.x2), std::min(s.y1, s.y2), std::max(s.x1, s.x2), std::max(s.y1, s.y2)});
+}
+
+int clampInt(long long v){ return (int)std::min<long long>(std::max<long long>(v, INT_MIN), INT_MAX); }
+
+// 違規裡記 shape 的欄位：WIDTH 的 a、SPACING 的 a / b、ENCLOSURE 的 b
+template<class F>
+void forShapeFields(Violation& v, F&& fn){
+    if (v.cat == 0 || v.cat == 1) fn(v.a);
+    if (v.cat == 1 || v.cat == 2) fn(v.b);
+}
+
+} // namespace
+
+void removeShapes(IncrementalState& st, const std::vector<long long>& idx){
+    std::vector<int> slots;
+    slots.reserve(idx.size());
+    for (long long i : idx) slots.push_back(st.layout.slotOf(i));   // 先全部換成 slot，刪除後 idx 會變
+    for (int s : slots){
+        if (!st.layout.alive(s)) continue;
+        markDirty(st, st.layout.shape(s));
+        st.layout.remove(s);
+        st.numRemoved++;
+    }
+}
+
+void appendShape(IncrementalState& st, std::string_view layer, int x1, int y1, int x2, int y2){
+    const Shape s{st.layout.intern(layer), x1, y1, x2, y2};
+    const int slot = st.layout.slots();
+    st.layout.place(slot, s);
+    st.added.push_back(slot);
+    markDirty(st, s);
+    st.numAdded++;
+}
+
+std::vector<Violation> updateIncremental(IncrementalState& st, const RuleSet& rules,
+                                         const std::string& rulesKey, const Box& die,
+                                         int threads, IncrementalStats* stats)
+{
+    IncrementalStats local;
+    IncrementalStats& S = stats ? *stats : local;
+    S = IncrementalStats{};
+    LiveLayout& lay = st.layout;
+
+    const bool sameSetup = st.valid && st.rulesKey == rulesKey &&
+                           st.die.x1 == die.x1 && st.die.y1 == die.y1 &&
+                           st.die.x2 == die.x2 && st.die.y2 == die.y2;
+    if (!sameSetup) {
+        S.full = true;
+        lay.compact();                       // slot 重新編成 idx，違規直接沿用 run_drc 的編號
+        const ShapeStore store = lay.toStore();
+        st.violations = run_drc(store, rules, die.x1,die.y1,die.x2,die.y2, threads);
+        st.rulesKey = rulesKey;
+        st.die = die;
+        st.valid = true;
+        clearPending(st);
+        S.added = store.count;
+        S.recomputed = st.violations.size();
+        return st.violations;
+    }
+    S.added = st.numAdded;
+    S.removed = st.numRemoved;
+
+    // 1) 只換了位置的 shape 把舊 slot 換成新的，再丟掉涉及已刪 shape、或落在 dirty 框裡要重算的舊違規
+    std::sort(st.moved.begin(), st.moved.end());
+    auto moveSlot = [&](long long& s){
+        auto it = std::lower_bound(st.moved.begin(), st.moved.end(), std::make_pair((int)s, INT_MIN));
+        if (it != st.moved.end() && it->first == s) s = it->second;
+    };
+    DirtySet dirty;
+    for (const Box& b : st.dirty) dirty.addBox(b.x1, b.y1, b.x2, b.y2);
+    dirty.finalize();
+
+    std::vector<Violation> V;
+    V.reserve(st.violations.size());
+    for (const auto& v0 : st.violations){
+        Violation v = v0;
+        bool dead = false;
+        forShapeFields(v, [&](long long& s){ moveSlot(s); dead |= !lay.alive((int)s); });
+        if (dead) continue;
+        if (v.cat == 2){
+            const Shape via = lay.shape((int)v.b);
+            if (dirty.hits(via.x1, via.y1, via.x2, via.y2)) continue;
+        } else if (v.cat == 3){
+            if (dirty.hitsWindow(rules, die, (int)v.b, (int)v.a)) continue;
+        }
+        V.push_back(v);
+    }
+    S.kept = V.size();
+
+    // 2) 從索引取出重算需要的 shape（check_dirty 的註解列了需要哪些）
+    const BoundRules bound = bindRules(rules, lay.layers());
+    std::vector<int>& added = st.added;
+    std::sort(added.begin(), added.end());
+    added.erase(std::unique(added.begin(), added.end()), added.end());
+    added.erase(std::remove_if(added.begin(), added.end(), [&](int s){ return !lay.alive(s); }), added.end());
+    auto isAdded = [&](int s){ return std::binary_search(added.begin(), added.end(), s); };
+    const LayerShapes& B = dirty.boxes;
+
+    std::vector<int> pick(added.begin(), added.end()), cand;
+    for (int s : added){
+        const Shape sh = lay.shape(s);
+        const int sp = bound.layer[sh.layer].min_spacing;
+        if (sp < 0) continue;
+        if (sh.x1 > sh.x2 || sh.y1 > sh.y2)
+            lay.query(sh.layer, INT_MIN, INT_MIN, INT_MAX, INT_MAX, pick);
+        else
+            lay.query(sh.layer, clampInt((long long)sh.x1 - sp), clampInt((long long)sh.y1 - sp),
+                      clampInt((long long)sh.x2 + sp), clampInt((long long)sh.y2 + sp), pick);
+    }
+    for (const auto& cfg : bound.vias){
+        if (cfg.via < 0) continue;
+        cand.clear();
+        for (size_t m = 0; m < B.size(); ++m) lay.query(cfg.via, B.x1[m], B.y1[m], B.x2[m], B.y2[m], cand);
+        for (int s : added) if (lay.shape(s).layer == cfg.via) cand.push_back(s);
+        std::sort(cand.begin(), cand.end());
+        cand.erase(std::unique(cand.begin(), cand.end()), cand.end());
+        for (int s : cand){
+            const Shape v = lay.shape(s);
+            if (!isAdded(s) && !dirty.hits(v.x1, v.y1, v.x2, v.y2)) continue;
+            pick.push_back(s);
+            const int vx1 = std::min(v.x1, v.x2), vy1 = std::min(v.y1, v.y2);
+            const int vx2 = std::max(v.x1, v.x2), vy2 = std::max(v.y1, v.y2);
+            for (int metal : {cfg.under, cfg.over})
+                if (metal >= 0) lay.query(metal, vx1, vy1, vx2, vy2, pick);
+        }
+    }
+    const int W = rules.density_window;
+    if (W > 0)
+        for (int id = 0; id < (int)bound.density.size(); ++id){
+            if (!bound.density[id]) continue;
+            for (size_t m = 0; m < B.size(); ++m)
+                lay.query(id, clampInt((long long)B.x1[m] - W), clampInt((long long)B.y1[m] - W),
+                          clampInt((long long)B.x2[m] + W), clampInt((long long)B.y2[m] + W), pick);
+        }
+
+    // 3) 局部 store 的 idx 就是 slot，重算出來的違規直接是 slot 編號
+    const ShapeStore part = lay.subset(pick);
+    dirty.added.resize(part.numLayers());
+    for (int id = 0; id < part.numLayers(); ++id){
+        const LayerShapes& L = part.byLayer[id];
+        dirty.added[id].assign(L.size(), 0);
+        for (size_t k = 0; k < L.size(); ++k) dirty.added[id][k] = isAdded(L.idx[k]);
+    }
+    std::vector<Violation> fresh;
+    check_dirty(part, rules, die, dirty, fresh);
+    S.recomputed = fresh.size();
+    const size_t mid = V.size();
+    V.insert(V.end(), std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+    if (st.moved.empty()) {   // 沿用的那段本來就排好了，新的排好後合併就好
+        std::sort(V.begin() + mid, V.end(), violationLess);
+        std::inplace_merge(V.begin(), V.begin() + mid, V.end(), violationLess);
+    } else {
+        std::stable_sort(V.begin(), V.end(), violationLess);
+    }
+    st.violations = std::move(V);
+    clearPending(st);
+
+    // 空位太多時重新編號（slot 的先後不變，違規不必重排）
+    if ((size_t)lay.slots() > 2 * lay.count() + 4096){
+        const std::vector<int> map = lay.compact();
+        for (auto& v : st.violations) forShapeFields(v, [&](long long& s){ s = map[(size_t)s]; });
+    }
+
+    std::vector<Violation> out = st.violations;
+    if ((size_t)lay.slots() != lay.count())
+        for (auto& v : out) forShapeFields(v, [&](long long& s){ s = lay.idxOf((int)s); });
+    return out;
+}
+
+
+// =================== CLI 快取檔 ===================
+
+namespace {
+
+struct ShapeKey {
+    int layer, x1, y1, x2, y2;
+    bool operator==(const ShapeKey& o) const {
+        return layer == o.layer && x1 == o.x1 && y1 == o.y1 && x2 == o.x2 && y2 == o.y2;
+    }
+};
+struct ShapeKeyHash {
+    size_t operator()(const ShapeKey& k) const {
+        uint64_t h = (uint64_t)(uint32_t)k.layer;
+        for (int v : {k.x1, k.y1, k.x2, k.y2}) h = (h ^ (uint32_t)v) * 0x100000001b3ULL;
+        return (size_t)(h ^ (h >> 29));
+    }
+};
+
+// ---- 違規的二進位檔（.vio）----
+// 上百萬筆違規用 JSON lines 存 / 讀比重算本身還慢，快取改存定長記錄：
+//   "MDRCVIO\0"、uint32 版本、uint32 名稱數、uint64 筆數，名稱表（uint32 長度 + 內容），再接 VioRecord[筆數]
+struct VioRecord {
+    int64_t a, b;
+    double actual, threshold, delta;
+    int32_t x1, y1, x2, y2;
+    int32_t layer, object;              // 名稱表的序號，-1 = nullptr
+    uint8_t cat, sub, missing, pass;
+    uint32_t pad;
+};
+static_assert(sizeof(VioRecord) == 72, "VioRecord layout");
+constexpr char VIO_MAGIC[8] = {'M','D','R','C','V','I','O','\0'};
+
+void writeViolationsBin(const std::string& path, const std::vector<Violation>& V,
+                        const std::function<long long(long long)>& toIdx){
+    std::vector<const std::string*> names;
+    std::unordered_map<const std::string*, int32_t> id;
+    auto nameId = [&](const std::string* n) -> int32_t {
+        if (!n) return -1;
+        auto it = id.emplace(n, (int32_t)names.size());
+        if (it.second) names.push_back(n);
+        return it.first->second;
+    };
+    std::vector<VioRecord> R(V.size());
+    for (size_t i = 0; i < V.size(); ++i){
+        Violation v = V[i];
+        forShapeFields(v, [&](long long& s){ s = toIdx(s); });
+        VioRecord& r = R[i];
+        r = VioRecord{};
+        r.a = v.a; r.b = v.b;
+        r.actual = v.actual; r.threshold = v.threshold; r.delta = v.delta;
+        r.x1 = v.x1; r.y1 = v.y1; r.x2 = v.x2; r.y2 = v.y2;
+        r.layer = nameId(v.layer); r.object = nameId(v.object);
+        r.cat = (uint8_t)v.cat; r.sub = (uint8_t)v.sub; r.missing = v.missing; r.pass = v.pass;
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Cannot write " + path);
+    const uint32_t version = 1, numNames = (uint32_t)names.size();
+    const uint64_t count = R.size();
+    out.write(VIO_MAGIC, 8);
+    out.write((const char*)&version, 4);
+    out.write((const char*)&numNames, 4);
+    out.write((const char*)&count, 8);
+    for (const std::string* n : names){
+        const uint32_t len = (uint32_t)n->size();
+        out.write((const char*)&len, 4);
+        out.write(n->data(), len);
+    }
+    out.write((const char*)R.data(), (std::streamsize)(R.size() * sizeof(VioRecord)));
+    if (!out) throw std::runtime_error("Cannot write " + path);
+}
+
+bool readViolationsBin(const std::string& path, std::vector<Violation>& V){
+    MappedFile mf(path);
+    if (!mf.ok() || mf.size() < 24 || std::memcmp(mf.data(), VIO_MAGIC, 8) != 0) return false;
+    const char* p = mf.data() + 8;
+    const char* end = mf.data() + mf.size();
+    uint32_t version, numNames;
+    uint64_t count;
+    std::memcpy(&version, p, 4); std::memcpy(&numNames, p + 4, 4); std::memcpy(&count, p + 8, 8);
+    p += 16;
+    if (version != 1) return false;
+    std::vector<const std::string*> names(numNames);
+    for (auto& n : names){
+        uint32_t len;
+        if (end - p < 4) return false;
+        std::memcpy(&len, p, 4);
+        p += 4;
+        if ((size_t)(end - p) < len) return false;
+        n = internName(std::string_view(p, len));
+        p += len;
+    }
+    if ((uint64_t)(end - p) != count * sizeof(VioRecord)) return false;
+    V.resize((size_t)count);
+    for (size_t i = 0; i < V.size(); ++i, p += sizeof(VioRecord)){
+        VioRecord r;
+        std::memcpy(&r, p, sizeof r);
+        if (r.layer >= (int32_t)numNames || r.object >= (int32_t)numNames) return false;
+        Violation& v = V[i];
+        v.a = r.a; v.b = r.b;
+        v.actual = r.actual; v.threshold = r.threshold; v.delta = r.delta;
+        v.x1 = r.x1; v.y1 = r.y1; v.x2 = r.x2; v.y2 = r.y2;
+        v.layer = r.layer >= 0 ? names[r.layer] : nullptr;
+        v.object = r.object >= 0 ? names[r.object] : nullptr;
+        v.cat = r.cat; v.sub = r.sub; v.missing = r.missing; v.pass = r.pass;
+    }
+    return true;
+}
+
+// 上一次的狀態；讀不到或格式不符回傳 false
+struct Cache {
+    ShapeStore store;
+    std::vector<Violation> violations;
+    std::string rulesKey;
+    Box die{};
+    std::vector<uint64_t> lineAt;   // 空 = 沒有 .src / .off 可比對
+    long long srcSize = -1;
+};
+
+bool readCache(const std::string& base, const RuleSet& rules, Cache& c){
+    std::ifstream meta(base + ".json");
+    if (!meta.is_open()) return false;
+    try {
+        json j;
+        meta >> j;
+        if (j.at("version").get<int>() != 3) return false;
+        c.rulesKey = j.at("rules").get<std::string>();
+        const auto& d = j.at("die");
+        c.die = {d.at(0), d.at(1), d.at(2), d.at(3)};
+        c.srcSize = j.value("src", -1LL);
+
+        MappedFile bin(base + ".bin");
+        std::string err;
+        c.store.layers = layerTableFor(rules);   // 層名依這次的 rules 換成正名（rules 不同時反正整批重跑）
+        if (!bin.ok() || !decodeBinaryLayout(bin.data(), bin.size(), c.store, err)) return false;
+        if (!readViolationsBin(base + ".vio", c.violations)) return false;
+
+        if (c.srcSize >= 0){
+            std::ifstream off(base + ".off", std::ios::binary);
+            c.lineAt.resize(c.store.count);
+            if (!off.read((char*)c.lineAt.data(), (std::streamsize)(c.lineAt.size() * sizeof(uint64_t)))) {
+                c.lineAt.clear();
+                c.srcSize = -1;
+            }
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// 新舊檔案頭尾相同的部分原封不動（shape 的 idx 只是整段平移），中間那段的舊 shape [p,q) 全刪、
+// 新解析出來的放進 [q, q+新段數) 的空位；內容相同的 shape 依層保持先後配對成「換位置」，其餘才是加 / 刪
+bool loadIncremental(const std::string& base, const std::string& layoutFile, const RuleSet& rules,
+                     IncrementalState& st, std::vector<ParseError>* errors)
+{
+    st = IncrementalState{};
+    MappedFile mf(layoutFile);
+    if (!mf.ok()) {
+        std::cerr << "Error opening " << layoutFile << "\n";
+        return false;
+    }
+    const char* data = mf.data();
+    const size_t size = mf.size();
+    const bool binary = isBinaryLayout(data, size);
+
+    Cache c;
+    const bool cached = readCache(base, rules, c);
+    if (!cached) c = Cache{}, c.store.layers = layerTableFor(rules);
+    const long long N = (long long)c.store.count;
+
+    // 1) 要重讀的範圍：新檔 [lp, lsNew) 對應舊檔 [lp, lsOld)、舊 shape [p, q)
+    size_t lp = 0, lsNew = size;
+    long long p = 0, q = N;
+    bool diffed = false;
+    uint64_t shift = 0;             // 改過那段之後的內容整段平移多少 byte
+    std::unique_ptr<MappedFile> src;
+    if (!binary && cached && c.srcSize >= 0) src = std::make_unique<MappedFile>(base + ".src");
+    if (src && src->ok() && (long long)src->size() == c.srcSize){
+        const char* old = src->data();
+        const size_t oldSize = src->size(), common = std::min(oldSize, size);
+        size_t pre = 0;
+        while (pre < common && old[pre] == data[pre]) ++pre;
+        size_t suf = 0;
+        while (suf < common - pre && old[oldSize - 1 - suf] == data[size - 1 - suf]) ++suf;
+
+        lp = pre;                      // pre 所在那一行的行首
+        while (lp > 0 && data[lp - 1] != '\n') --lp;
+        const size_t endOld = oldSize - suf;
+        const void* nl = endOld < oldSize ? std::memchr(old + endOld, '\n', oldSize - endOld) : nullptr;
+        const size_t lsOld = nl ? (size_t)((const char*)nl - old) + 1 : oldSize;
+        lsNew = lsOld + size - oldSize;
+        p = std::lower_bound(c.lineAt.begin(), c.lineAt.end(), (uint64_t)lp) - c.lineAt.begin();
+        q = std::lower_bound(c.lineAt.begin(), c.lineAt.end(), (uint64_t)lsOld) - c.lineAt.begin();
+        diffed = true;
+        shift = (uint64_t)size - (uint64_t)oldSize;   // 模 2^64，加回去就對
+    }
+
+    // 2) 解析新的那一段；層表沿用舊的，同名的層 ID 不變
+    LayerTable table = c.store.layers;
+    std::vector<Shape> fresh;
+    std::vector<uint64_t> freshAt;
+    std::vector<ParseError> errs;
+    if (binary) {
+        ShapeStore nb;
+        nb.layers.alias = table.alias;
+        std::string err;
+        if (decodeBinaryLayout(data, size, nb, err)) {
+            fresh.resize(nb.count);
+            for (int id = 0; id < nb.numLayers(); ++id){
+                const int gid = table.intern(nb.layerName(id));
+                const LayerShapes& L = nb.byLayer[id];
+                for (size_t k = 0; k < L.size(); ++k) fresh[L.idx[k]] = Shape{gid, L.x1[k], L.y1[k], L.x2[k], L.y2[k]};
+            }
+        } else {
+            errs.push_back({0, 0, "bad binary layout: " + err});
+        }
+    } else {
+        const size_t firstLine = 1 + (size_t)std::count(data, data + lp, '\n');
+        parseLayoutText(data + lp, lsNew - lp, table,
+                        [&](const Shape& s, size_t at){ fresh.push_back(s); freshAt.push_back(lp + at); },
+                        errs, firstLine);
+    }
+    reportParseErrors(layoutFile, errs, errors);
+
+    const long long a = (long long)fresh.size();
+    c.store.layers = std::move(table);
+    st.layout = LiveLayout(c.store, q, a);
+    if (cached) {
+        st.violations = std::move(c.violations);
+        for (auto& v : st.violations) forShapeFields(v, [&](long long& s){ if (s >= q) s += a; });
+        st.rulesKey = std::move(c.rulesKey);
+        st.die = c.die;
+        st.valid = true;
+    }
+
+    // 3) 舊段與新段配對
+    LiveLayout& lay = st.layout;
+    std::unordered_map<ShapeKey, std::vector<int>, ShapeKeyHash> byKey;   // key → 舊 slot（遞增）
+    std::unordered_map<ShapeKey, size_t, ShapeKeyHash> cursor;
+    byKey.reserve((size_t)(q - p));
+    for (long long s = p; s < q; ++s){
+        const Shape sh = lay.shape((int)s);
+        byKey[{sh.layer, sh.x1, sh.y1, sh.x2, sh.y2}].push_back((int)s);
+    }
+    std::vector<char> matched((size_t)(q - p), 0);
+    std::vector<int> lastOld(lay.layers().size(), -1);   // 同層配對必須保持舊的先後（spacing 的 (i,j) 方向才不會反過來）
+    for (long long j = 0; j < a; ++j){
+        const Shape& sh = fresh[(size_t)j];
+        const int slot = (int)(q + j);
+        lay.place(slot, sh);
+        bool hit = false;
+        const ShapeKey key{sh.layer, sh.x1, sh.y1, sh.x2, sh.y2};
+        auto it = byKey.find(key);
+        if (it != byKey.end()){
+            size_t& k = cursor[key];
+            while (k < it->second.size() && it->second[k] <= lastOld[sh.layer]) ++k;
+            if (k < it->second.size()){
+                const int o = it->second[k++];
+                lastOld[sh.layer] = o;
+                matched[(size_t)(o - p)] = 1;
+                st.moved.push_back({o, slot});
+                hit = true;
+            }
+        }
+        if (!hit){
+            st.added.push_back(slot);
+            markDirty(st, sh);
+            st.numAdded++;
+        }
+    }
+    for (long long s = p; s < q; ++s){
+        if (!matched[(size_t)(s - p)]){
+            markDirty(st, lay.shape((int)s));
+            st.numRemoved++;
+        }
+        lay.remove((int)s);
+    }
+
+    // 4) 各 shape 的行首位移（下次比對用）
+    if (diffed){
+        st.lineAt.reserve((size_t)(N - (q - p) + a));
+        st.lineAt.insert(st.lineAt.end(), c.lineAt.begin(), c.lineAt.begin() + p);
+        st.lineAt.insert(st.lineAt.end(), freshAt.begin(), freshAt.end());
+        for (long long i = q; i < N; ++i) st.lineAt.push_back(c.lineAt[(size_t)i] + shift);
+    } else {
+        st.lineAt = std::move(freshAt);   // 整份重讀（二進位 layout 為空）
+    }
+    return true;
+}
+
+void saveIncrementalCache(const std::string& base, const std::string& layoutFile, const IncrementalState& st){
+    writeBinaryLayout(base + ".bin", st.layout.toStore());
+    const bool dense = (size_t)st.layout.slots() == st.layout.count();
+    writeViolationsBin(base + ".vio", st.violations,
+                       [&](long long s){ return dense ? s : st.layout.idxOf((int)s); });
+    std::remove((base + ".jsonl").c_str());   // 舊版快取
+
+    json meta{{"version", 3}, {"rules", st.rulesKey},
+              {"die", {st.die.x1, st.die.y1, st.die.x2, st.die.y2}}};
+    if (st.lineAt.size() == st.layout.count() && st.layout.count() > 0) {
+        // 文字 layout：留一份這次的原檔與行首位移，下次只重讀改過的那段
+        MappedFile mf(layoutFile);
+        std::ofstream srcOut(base + ".src", std::ios::binary), offOut(base + ".off", std::ios::binary);
+        if (!mf.ok() || !srcOut.is_open() || !offOut.is_open()) throw std::runtime_error("Cannot write " + base + ".src");
+        srcOut.write(mf.data(), (std::streamsize)mf.size());
+        offOut.write((const char*)st.lineAt.data(), (std::streamsize)(st.lineAt.size() * sizeof(uint64_t)));
+        if (!srcOut || !offOut) throw std::runtime_error("Cannot write " + base + ".src");
+        meta["src"] = (long long)mf.size();
+    } else {
+        std::remove((base + ".src").c_str());
+        std::remove((base + ".off").c_str());
+    }
+    std::ofstream out(base + ".json");
+    if (!out.is_open()) throw std::runtime_error("Cannot write " + base + ".json");
+    out << meta.dump() << "\n";
+}
+
+std::string readFileText(const std::string& path){
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) return {};
+    std::ostringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
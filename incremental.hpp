@@ -0,0 +1,114 @@
+#pragma once
+#include "common.hpp"
+#include "drc.hpp"
+#include "parser.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ---- 常駐 layout ----
+// shape 放在 slot 裡：slot 只往後加、刪掉的留空位，所以 slot 的先後就是 idx 的先後；
+// 目前的全域 idx = 前面活著的 slot 數（Fenwick tree，O(log n)）。
+// 每層一張均勻網格：建的時候是 CSR，之後新增的 shape 掛在各格的額外清單、刪掉的查詢時濾掉；
+// 改動累積到建網格時 shape 數的一半才整個重建，所以加刪一個 shape 平攤 O(log n)。
+class LiveLayout {
+public:
+    LiveLayout() : LiveLayout(ShapeStore{}) {}
+    // store 的第 i 個 shape 放在 slot i；gapSize > 0 時 idx >= gapAt 的往後挪，空出 [gapAt, gapAt+gapSize) 給 place
+    explicit LiveLayout(const ShapeStore& store, long long gapAt = 0, long long gapSize = 0);
+
+    size_t count() const { return live; }
+    int slots() const { return (int)layerOf.size(); }          // 下一個接在最後的 slot
+    const LayerTable& layers() const { return table; }
+    int intern(std::string_view name) { return table.intern(name); }
+
+    bool alive(int slot) const { return layerOf[slot] >= 0; }
+    Shape shape(int slot) const { return {layerOf[slot], x1[slot], y1[slot], x2[slot], y2[slot]}; }
+    long long idxOf(int slot) const;        // 前面活著的 slot 數
+    int slotOf(long long idx) const;        // 第 idx 個（從 0 起）活著的 slot
+
+    void place(int slot, const Shape& s);   // slot 必須是沒用過的空位；slot == slots() 時接在最後
+    void remove(int slot);
+
+    // 第 layer 層 bbox 與 [qx1,qx2]×[qy1,qy2] 相交（含邊界）的活 slot 接到 out 後面（可能重複、可能多給）；
+    // 反向矩形一律回傳
+    void query(int layer, int qx1,int qy1,int qx2,int qy2, std::vector<int>& out) const;
+
+    // 依 idx 排好的 store（idx 是目前的全域 idx）：整份，或只取 slots 裡的（會排序去重）
+    ShapeStore toStore() const;
+    ShapeStore subset(std::vector<int>& slots) const;
+
+    // 丟掉空位重新編 slot（= 目前的 idx）並重建索引；回傳舊 slot → 新 slot（空位 = -1）
+    std::vector<int> compact();
+
+private:
+    struct Grid {
+        long long x0 = 0, y0 = 0, cell = 1;
+        int nx = 0, ny = 0;
+        std::vector<int> start, items;                          // 建的時候的 CSR
+        std::unordered_map<size_t, std::vector<int>> extra;     // 之後 place 的
+        std::vector<int> irregular;                             // 反向矩形；建網格時這層還沒有 shape 的也先放這裡
+    };
+
+    LayerTable table;
+    std::vector<int> layerOf, x1, y1, x2, y2;   // 依 slot；layerOf = -1 是空位
+    std::vector<int> bit;                       // Fenwick（1 起算），大小是 2 的冪次
+    std::vector<Grid> grids;                    // grids[layer ID]
+    size_t live = 0, built = 0, changes = 0;
+
+    void bitAdd(int slot, int d);
+    void growBit(size_t need);
+    void rebuildIndex();
+    void indexSlot(int slot);
+};
+
+// ---- 增量 DRC ----
+// 保留上一次 check 的違規與常駐 layout；layout 的修改（removeShapes / appendShape，或 CLI 的
+// loadIncremental）只改 layout 與索引、記下 dirty 框，下一次 updateIncremental 才只重算受影響的部分
+// （從索引取出 dirty 框附近的 shape 跑 check_dirty），其餘違規沿用。成本跟改動的範圍走，與 layout 大小無關。
+// 規則或 die 不同、或還沒 check 過時整批重跑。結果與完整重跑逐位相同。
+
+struct IncrementalState {
+    LiveLayout layout;
+    std::vector<Violation> violations;   // 上一次 check 的結果，依 slot 排序；WIDTH / SPACING / ENCLOSURE 的 shape 欄記 slot
+    std::string rulesKey;                // rules 檔內容（或載入序號）
+    Box die{};
+    bool valid = false;                  // violations 對應 rulesKey / die
+
+    // 上一次 check 之後的修改
+    std::vector<Box> dirty;                   // 加 / 刪的 shape 的 bbox
+    std::vector<int> added;                   // 新放進來的 slot
+    std::vector<std::pair<int, int>> moved;   // 內容沒變、只換了位置的 shape：舊 slot → 新 slot
+    size_t numAdded = 0, numRemoved = 0;
+
+    std::vector<uint64_t> lineAt;        // CLI：每個 shape（依 idx）在 layout 文字檔中的行首位移；二進位 layout 為空
+};
+
+struct IncrementalStats {
+    size_t added = 0, removed = 0;     // shape 數
+    size_t kept = 0, recomputed = 0;   // 違規數：沿用 / 重算
+    bool full = false;                 // 整批重跑
+};
+
+// 刪掉目前 idx 為 idx 的 shape（都是刪之前的編號；呼叫端先檢查範圍與重複）
+void removeShapes(IncrementalState& st, const std::vector<long long>& idx);
+// 接在最後（與加在 layout 檔尾相同）
+void appendShape(IncrementalState& st, std::string_view layer, int x1, int y1, int x2, int y2);
+
+// 依目前的 layout 回傳新的違規清單
+std::vector<Violation> updateIncremental(IncrementalState& st, const RuleSet& rules,
+                                         const std::string& rulesKey, const Box& die,
+                                         int threads = 1, IncrementalStats* stats = nullptr);
+
+// CLI 的快取檔：<base>.bin（上次的 shape，二進位 layout 格式）、<base>.vio（違規，定長的二進位記錄）、<base>.json（規則與 die）、
+// 文字 layout 另有 <base>.src（上次的 layout 檔）與 <base>.off（各 shape 的行首位移）。
+// loadIncremental 讀快取後把 layoutFile 跟 .src 逐位元組比對，只重新解析頭尾相同部分以外的那一段；
+// 沒有可用的快取時整份讀進來（st.valid = false）。layout 讀不到回傳 false
+bool loadIncremental(const std::string& base, const std::string& layoutFile, const RuleSet& rules,
+                     IncrementalState& st, std::vector<ParseError>* errors = nullptr);
+void saveIncrementalCache(const std::string& base, const std::string& layoutFile, const IncrementalState& st);
+
+std::string readFileText(const std::string& path);   // 讀不到回傳空字串
@@ -0,0 +1,40 @@
+// layout2bin：把 layout*.txt 轉成二進位 layout（格式見 layoutbin.hpp）
+//   layout2bin [--delta] <layout.txt> <layout.bin>
+// 之後 main / tile worker 直接讀 .bin，省掉每次的文字解析。
+#include "parser.hpp"
+#include "layoutbin.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv){
+    bool delta = false;
+    std::string in, out;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--delta") delta = true;
+        else if (in.empty())  in = a;
+        else if (out.empty()) out = a;
+        else { std::cerr << "未知參數: " << a << "\n"; return 1; }
+    }
+    if (in.empty() || out.empty()) {
+        std::cerr << "usage: layout2bin [--delta] <layout.txt> <layout.bin>\n";
+        return 1;
+    }
+
+    std::vector<ParseError> errs;
+    ShapeStore store = readLayout(in, &errs);
+    for (const auto& e : errs)
+        std::cerr << in << ":" << e.line << ":" << e.col << ": error: " << e.msg << " (line skipped)\n";
+    if (store.count == 0 && !std::ifstream(in)) return 1;   // 開檔失敗，readLayout 已經報過
+
+    try {
+        writeBinaryLayout(out, store, delta);
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    std::cout << out << ": " << store.count << " shapes, " << store.numLayers() << " layers"
+              << (delta ? ", delta-encoded" : "") << "\n";
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include "layoutbin.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static size_t pad4(size_t n){ return (n + 3) & ~(size_t)3; }
+
+// ---- zigzag varint ----
+static void putVarint(std::string& out, int64_t v){
+    uint64_t z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    while (z >= 0x80) { out.push_back((char)(z | 0x80)); z >>= 7; }
+    out.push_back((char)z);
+}
+
+static bool getVarint(const unsigned char*& p, const unsigned char* end, int64_t& v){
+    uint64_t z = 0;
+    for (int shift = 0; shift < 64; shift += 7){
+        if (p == end) return false;
+        unsigned char b = *p++;
+        z |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { v = (int64_t)(z >> 1) ^ -(int64_t)(z & 1); return true; }
+    }
+    return false;
+}
+
+bool isBinaryLayout(const char* data, size_t size){
+    return size >= sizeof(BinHeader) && std::memcmp(data, BIN_MAGIC, sizeof(BIN_MAGIC)) == 0;
+}
+
+
+// ---- 載入 ----
+
+namespace {
+
+struct BinLayer {
+    std::string_view name;
+    uint64_t n, bytes;
+    const unsigned char* payload;
+};
+
+// 檔頭與層表：只看結構，不碰 payload 內容
+bool readLayerTable(const char* data, size_t size, BinHeader& h, std::vector<BinLayer>& layers, std::string& err){
+    if (!isBinaryLayout(data, size)) { err = "not a binary layout"; return false; }
+    std::memcpy(&h, data, sizeof h);
+    if (h.version != BIN_VERSION) { err = "unsupported version " + std::to_string(h.version); return false; }
+    if (h.flags & ~BIN_DELTA)     { err = "unknown flags " + std::to_string(h.flags); return false; }
+
+    const char* p = data + sizeof h;
+    const char* end = data + size;
+    auto take = [&](void* dst, size_t n){
+        if ((size_t)(end - p) < n) return false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    };
+
+    const bool delta = h.flags & BIN_DELTA;
+    LayerTable names;
+    uint64_t total = 0;
+    layers.clear();
+    for (uint32_t id = 0; id < h.numLayers; ++id){
+        const size_t at = (size_t)(p - data);
+        uint32_t nameLen;
+        if (!take(&nameLen, 4) || (size_t)(end - p) < pad4(nameLen)) { err = "truncated layer table"; return false; }
+        std::string_view name(p, nameLen);
+        p += pad4(nameLen);
+        if (names.intern(name) != (int)id) { err = "duplicate layer '" + std::string(name) + "'"; return false; }
+
+        uint64_t n, bytes;
+        if (!take(&n, 8) || !take(&bytes, 8) || bytes > (uint64_t)(end - p) || (size_t)(end - p) < pad4(bytes)) {
+            err = "truncated layer " + std::string(name) + " at byte " + std::to_string(at);
+            return false;
+        }
+        // delta 每筆至少五個位元組，n 因此也受檔案大小限制
+        if (n > INT32_MAX || (!delta && bytes != n * 5 * sizeof(int32_t)) || (delta && bytes < n * 5)) {
+            err = "bad size for layer " + std::string(name);
+            return false;
+        }
+        layers.push_back({name, n, bytes, (const unsigned char*)p});
+        p += pad4(bytes);
+        total += n;
+    }
+    if (total != h.count) { err = "shape count mismatch"; return false; }
+    return true;
+}
+
+// 一層逐筆 fn(x1, y1, x2, y2, idx)，不另外配置整層的陣列。
+// 五段 varint 各自一個游標同步前進：x2/y2 是相對同筆 x1/y1 的寬高，其餘是與前一筆的差
+template<class Fn>
+bool forEachShape(const BinLayer& L, bool delta, Fn&& fn){
+    const size_t n = (size_t)L.n;
+    if (!delta) {
+        const unsigned char* col[5];
+        for (int c = 0; c < 5; ++c) col[c] = L.payload + (size_t)c * n * sizeof(int32_t);
+        for (size_t k = 0; k < n; ++k){
+            int32_t v[5];
+            for (int c = 0; c < 5; ++c) std::memcpy(&v[c], col[c] + k * sizeof(int32_t), sizeof(int32_t));
+            if (!fn(v[0], v[1], v[2], v[3], v[4])) return false;
+        }
+        return true;
+    }
+    const unsigned char* end = L.payload + L.bytes;
+    const unsigned char* cur[5];
+    const unsigned char* stop[5];
+    cur[0] = L.payload;
+    for (int c = 0; c < 4; ++c){
+        const unsigned char* q = cur[c];
+        for (size_t k = 0; k < n; ++k){
+            int64_t d;
+            if (!getVarint(q, end, d)) return false;
+        }
+        stop[c] = cur[c + 1] = q;
+    }
+    stop[4] = end;
+    int64_t prev[5] = {0, 0, 0, 0, 0};
+    for (size_t k = 0; k < n; ++k){
+        int64_t v[5];
+        for (int c = 0; c < 5; ++c){
+            int64_t d;
+            if (!getVarint(cur[c], stop[c], d)) return false;
+            v[c] = (c == 2) ? v[0] + d : (c == 3) ? v[1] + d : prev[c] + d;
+            if (v[c] < INT32_MIN || v[c] > INT32_MAX) return false;
+            prev[c] = v[c];
+        }
+        if (!fn((int)v[0], (int)v[1], (int)v[2], (int)v[3], (int)v[4])) return false;
+    }
+    return cur[4] == end;
+}
+
+// idx 是全域 shape 編號：必須落在 [0, count) 且不重複
+struct IdxCheck {
+    uint64_t count;
+    std::vector<uint64_t> seen;
+    explicit IdxCheck(uint64_t n) : count(n), seen((size_t)((n + 63) / 64), 0) {}
+    bool add(int idx){
+        if (idx < 0 || (uint64_t)idx >= count) return false;
+        uint64_t& w = seen[(size_t)idx / 64];
+        const uint64_t bit = 1ull << (idx % 64);
+        if (w & bit) return false;
+        w |= bit;
+        return true;
+    }
+};
+
+std::string badIdx(const BinLayer& L){ return "bad shape index in layer " + std::string(L.name); }
+
+} // namespace
+
+bool decodeBinaryLayout(const char* data, size_t size, ShapeStore& store, std::string& err){
+    BinHeader h;
+    std::vector<BinLayer> layers;
+    if (!readLayerTable(data, size, h, layers, err)) return false;
+    const bool delta = h.flags & BIN_DELTA;
+
+    // 層表保留呼叫端給的別名（layerTableFor）；別名讓檔內兩層落在同一個 ID 時接在後面，最後再依 idx 排回
+    LayerTable table;
+    table.alias = std::move(store.layers.alias);
+    store = ShapeStore{};
+    store.layers = std::move(table);
+    store.byLayer.reserve(layers.size());
+    IdxCheck check(h.count);
+    for (const BinLayer& B : layers){
+        const int id = store.layers.intern(B.name);
+        if ((size_t)id >= store.byLayer.size()) store.byLayer.resize(id + 1);
+        LayerShapes& L = store.byLayer[id];
+        const size_t base = L.size(), n = (size_t)B.n;
+        if (delta) {
+            for (auto* col : {&L.x1, &L.y1, &L.x2, &L.y2, &L.idx}) col->reserve(base + n);
+            const bool ok = forEachShape(B, true, [&](int x1, int y1, int x2, int y2, int idx){
+                L.x1.push_back(x1); L.y1.push_back(y1); L.x2.push_back(x2); L.y2.push_back(y2); L.idx.push_back(idx);
+                return true;
+            });
+            if (!ok) { err = "corrupt delta payload in layer " + std::string(B.name); return false; }
+        } else {
+            // 每層整塊複製
+            const unsigned char* q = B.payload;
+            for (auto* col : {&L.x1, &L.y1, &L.x2, &L.y2, &L.idx}) {
+                col->resize(base + n);
+                std::memcpy(col->data() + base, q, n * sizeof(int32_t));
+                q += n * sizeof(int32_t);
+            }
+        }
+        for (size_t k = base; k < L.size(); ++k)
+            if (!check.add(L.idx[k])) { err = badIdx(B); return false; }
+    }
+    for (auto& L : store.byLayer) L.sortByIdx();
+    store.count = (size_t)h.count;
+    return true;
+}
+
+bool scanBinaryLayout(const char* data, size_t size,
+                      const std::function<void(std::string_view name)>& onLayer,
+                      const std::function<void(int x1, int y1, int x2, int y2, int idx)>& onShape,
+                      std::string& err){
+    BinHeader h;
+    std::vector<BinLayer> layers;
+    if (!readLayerTable(data, size, h, layers, err)) return false;
+    const bool delta = h.flags & BIN_DELTA;
+
+    // 第一趟只驗證（payload 整個走一次、不留資料），全部沒問題才開始回呼
+    IdxCheck check(h.count);
+    for (const auto& B : layers){
+        bool idxOk = true;
+        const bool ok = forEachShape(B, delta, [&](int, int, int, int, int idx){ return idxOk = check.add(idx); });
+        if (!ok) { err = idxOk ? "corrupt delta payload in layer " + std::string(B.name) : badIdx(B); return false; }
+    }
+    for (const auto& B : layers){
+        onLayer(B.name);
+        forEachShape(B, delta, [&](int x1, int y1, int x2, int y2, int idx){ onShape(x1, y1, x2, y2, idx); return true; });
+    }
+    return true;
+}
+
+
+// ---- 寫出 ----
+
+void writeBinaryLayout(const std::string& path, const ShapeStore& store, bool delta){
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Cannot write " + path);
+
+    BinHeader h{};
+    std::memcpy(h.magic, BIN_MAGIC, sizeof h.magic);
+    h.version   = BIN_VERSION;
+    h.flags     = delta ? BIN_DELTA : 0;
+    h.numLayers = (uint32_t)store.numLayers();
+    h.count     = store.count;
+    out.write((const char*)&h, sizeof h);
+
+    static const char zeros[4] = {0, 0, 0, 0};
+    auto padTo4 = [&](size_t n){ out.write(zeros, (std::streamsize)(pad4(n) - n)); };
+
+    std::string buf;
+    for (int id = 0; id < store.numLayers(); ++id){
+        const std::string& name = store.layerName(id);
+        const LayerShapes& L = store.byLayer[id];
+        uint32_t nameLen = (uint32_t)name.size();
+        out.write((const char*)&nameLen, 4);
+        out.write(name.data(), nameLen);
+        padTo4(nameLen);
+
+        const std::vector<int>* cols[5] = {&L.x1, &L.y1, &L.x2, &L.y2, &L.idx};
+        uint64_t n = L.size(), bytes;
+        if (delta) {
+            buf.clear();
+            for (int c = 0; c < 5; ++c){
+                int64_t prev = 0;
+                for (size_t k = 0; k < n; ++k){
+                    int64_t v = (*cols[c])[k];
+                    if      (c == 2) putVarint(buf, v - L.x1[k]);
+                    else if (c == 3) putVarint(buf, v - L.y1[k]);
+                    else             putVarint(buf, v - prev);
+                    prev = v;
+                }
+            }
+            bytes = buf.size();
+        } else {
+            bytes = n * 5 * sizeof(int32_t);
+        }
+        out.write((const char*)&n, 8);
+        out.write((const char*)&bytes, 8);
+        if (delta) out.write(buf.data(), (std::streamsize)bytes);
+        else for (auto* col : cols) out.write((const char*)col->data(), (std::streamsize)(n * sizeof(int32_t)));
+        padTo4(bytes);
+    }
+    if (!out) throw std::runtime_error("Write failed: " + path);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "common.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// ---- 二進位 layout 格式（.bin）----
+// 省掉文字解析：載入時整檔 mmap，每層的座標陣列直接整塊 memcpy 進 ShapeStore。
+// 所有整數皆為 little-endian（x86 / ARM 主機原生順序），檔案配置：
+//
+//   BinHeader                              32 bytes
+//   重複 numLayers 次：
+//     uint32 nameLen, char name[nameLen]   補 0 到 4 的倍數
+//     uint64 n, uint64 payloadBytes
+//     payload                              補 0 到 4 的倍數
+//
+// payload 預設是五個 int32[n] 陣列：x1, y1, x2, y2, idx（idx = 文字檔中的全域行序）。
+// flags 有 BIN_DELTA 時改成五段 zigzag varint：x1/y1/idx 存與前一筆的差、x2/y2 存寬高，
+// 檔案小很多但載入要多一趟解碼。
+static constexpr char     BIN_MAGIC[8]  = {'M','D','R','C','B','I','N','\0'};
+static constexpr uint32_t BIN_VERSION   = 1;
+static constexpr uint32_t BIN_DELTA     = 1u << 0;
+
+struct BinHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t numLayers;
+    uint32_t reserved;
+    uint64_t count;        // 全部 shape 數
+};
+static_assert(sizeof(BinHeader) == 32, "BinHeader layout");
+
+// buffer 開頭是否為二進位 layout
+bool isBinaryLayout(const char* data, size_t size);
+
+// 解碼整個 buffer 到 store；格式錯誤、或 idx 不在 [0, count) / 有重複時回傳 false 並填 err（store 內容不保證）
+// store.layers 原有的別名保留並套用到檔內層名，其餘內容覆寫
+bool decodeBinaryLayout(const char* data, size_t size, ShapeStore& store, std::string& err);
+
+// 不建 store、逐筆回呼：每層先 onLayer(name)，再對該層每個 shape 呼叫 onShape。
+// 開始回呼前先把整個檔案（含 idx）驗證過一次；有錯回傳 false 並填 err，不會呼叫任何回呼
+bool scanBinaryLayout(const char* data, size_t size,
+                      const std::function<void(std::string_view name)>& onLayer,
+                      const std::function<void(int x1, int y1, int x2, int y2, int idx)>& onShape,
+                      std::string& err);
+
+// 寫出 store；失敗丟 std::runtime_error
+void writeBinaryLayout(const std::string& path, const ShapeStore& store, bool delta = false);
@@ -0,0 +1,131 @@
+#include "lvs.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+
+static uint64_t mix64(uint64_t x){            // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// pin 集合的 signature：各 pin hash 相加（與順序無關）再混入個數；
+// 相同 signature 仍會逐一比對集合，碰撞只影響速度不影響結果
+static uint64_t signature(const std::vector<std::string>& pins){
+    uint64_t h = 0;
+    for (const auto& p : pins) h += mix64(std::hash<std::string>{}(p));
+    return mix64(h ^ mix64(pins.size()));
+}
+
+static void sortUnique(std::vector<std::string>& v){
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+LvsReport compareNets(const Netlist& nets, const std::vector<Label>& labels, const Schematic& sch)
+{
+    LvsReport R;
+    R.schematicNets = sch.size();
+
+    // schematic 端：pin → net，以及每條 net 排序去重後的 pin 集合。
+    // 同一個 pin 列在好幾條 net 下是 schematic 本身的錯：報出來，pin → net 取名稱最小的那條
+    std::unordered_map<std::string, std::vector<const std::string*>> pinNets;
+    std::vector<std::pair<const std::string*, std::vector<std::string>>> schNets;
+    schNets.reserve(sch.size());
+    for (const auto& kv : sch){
+        schNets.push_back({&kv.first, kv.second});
+        sortUnique(schNets.back().second);
+        for (const auto& p : schNets.back().second) pinNets[p].push_back(&kv.first);
+    }
+    std::unordered_map<std::string, const std::string*> pinNet;
+    pinNet.reserve(pinNets.size());
+    for (auto& kv : pinNets){
+        auto& v = kv.second;
+        std::sort(v.begin(), v.end(), [](const std::string* a, const std::string* b){ return *a < *b; });
+        pinNet.emplace(kv.first, v[0]);
+        if (v.size() > 1){
+            LvsDuplicate d{kv.first, {}};
+            for (const std::string* n : v) d.nets.push_back(*n);
+            R.duplicatePins.push_back(std::move(d));
+        }
+    }
+
+    // layout 端：每條 net 上的 label；同名 label 可能落在不同 net（那就是 open）
+    std::vector<std::vector<std::string>> layPins(nets.numNets);
+    std::unordered_map<std::string, std::vector<int>> pinLay;
+    std::unordered_set<std::string> extra;
+    for (size_t i = 0; i < labels.size(); ++i){
+        const std::string& name = labels[i].name;
+        if (!pinNet.count(name)) { extra.insert(name); continue; }
+        int n = nets.labelNet[i];
+        if (n < 0) continue;                         // 浮空 label，下面當作 missing
+        layPins[n].push_back(name);
+        pinLay[name].push_back(n);
+    }
+    for (auto& pins : layPins){
+        sortUnique(pins);
+        if (!pins.empty()) R.layoutNets++;
+    }
+    for (auto& kv : pinLay) { std::sort(kv.second.begin(), kv.second.end());
+                              kv.second.erase(std::unique(kv.second.begin(), kv.second.end()), kv.second.end()); }
+
+    // 1) signature 配對：pin 集合完全相同的 net 直接算 match。
+    //    有 pin 同時落在別的 layout net 上的不算（集合相同也是 open），留給 2) 分組
+    std::unordered_map<uint64_t, std::vector<size_t>> bySig;
+    bySig.reserve(schNets.size());
+    for (size_t i = 0; i < schNets.size(); ++i) bySig[signature(schNets[i].second)].push_back(i);
+
+    std::vector<char> schMatched(schNets.size(), 0), layMatched(nets.numNets, 0);
+    for (int n = 0; n < nets.numNets; ++n){
+        if (layPins[n].empty()) continue;
+        if (std::any_of(layPins[n].begin(), layPins[n].end(),
+                        [&](const std::string& p){ return pinLay[p].size() > 1; })) continue;
+        auto it = bySig.find(signature(layPins[n]));
+        if (it == bySig.end()) continue;
+        for (size_t i : it->second)
+            if (!schMatched[i] && schNets[i].second == layPins[n]){
+                schMatched[i] = layMatched[n] = 1;
+                R.matched++;
+                break;
+            }
+    }
+
+    // 2) 沒配上的 schematic net：pin 依所在 layout net 分組，多於一組就是 open
+    for (size_t i = 0; i < schNets.size(); ++i){
+        if (schMatched[i]) continue;
+        const std::string& net = *schNets[i].first;
+        std::unordered_map<int, std::vector<std::string>> groups;
+        for (const auto& p : schNets[i].second){
+            auto it = pinLay.find(p);
+            if (it == pinLay.end()) { R.missingPins.push_back(p + " (net " + net + ")"); continue; }
+            for (int n : it->second) groups[n].push_back(p);
+        }
+        if (groups.size() > 1){
+            LvsOpen o{net, {}};
+            std::vector<int> order;
+            for (const auto& g : groups) order.push_back(g.first);
+            std::sort(order.begin(), order.end());
+            for (int n : order) o.pieces.push_back(groups[n]);
+            R.opens.push_back(std::move(o));
+        }
+    }
+
+    // 3) 沒配上的 layout net：上面的 pin 屬於多條 schematic net 就是 short
+    for (int n = 0; n < nets.numNets; ++n){
+        if (layMatched[n] || layPins[n].empty()) continue;
+        std::vector<std::string> hit;
+        for (const auto& p : layPins[n]) hit.push_back(*pinNet[p]);
+        sortUnique(hit);
+        if (hit.size() > 1) R.shorts.push_back({n, std::move(hit)});
+    }
+
+    R.extraLabels.assign(extra.begin(), extra.end());
+    std::sort(R.extraLabels.begin(), R.extraLabels.end());
+    std::sort(R.missingPins.begin(), R.missingPins.end());
+    std::sort(R.opens.begin(), R.opens.end(),
+              [](const LvsOpen& a, const LvsOpen& b){ return a.net < b.net; });
+    std::sort(R.duplicatePins.begin(), R.duplicatePins.end(),
+              [](const LvsDuplicate& a, const LvsDuplicate& b){ return a.pin < b.pin; });
+    return R;
+}
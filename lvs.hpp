@@ -0,0 +1,42 @@
+#pragma once
+#include "common.hpp"
+#include "connectivity.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ---- LVS-lite：萃取出的 net 與 schematic 比對 ----
+// 兩邊的 net 都化成「pin 名稱集合」：layout 端是落在該 net 上的 label，schematic 端是 net → pin 清單。
+// 每個集合算一個與順序無關的 64-bit signature，用 hash 表一次配對，整體線性時間；
+// 只有沒配上的 net 才透過 pin → net 對照表找出 open / short。
+
+using Schematic = std::unordered_map<std::string, std::vector<std::string>>;
+
+struct LvsOpen {                       // 一條 schematic net 的 pin 分散在好幾條 layout net
+    std::string net;
+    std::vector<std::vector<std::string>> pieces;   // 每片 = 同一條 layout net 上的 pin
+};
+struct LvsShort {                      // 一條 layout net 接到好幾條 schematic net
+    int layoutNet;
+    std::vector<std::string> nets;
+};
+
+struct LvsDuplicate {                  // schematic 錯誤：同一個 pin 列在好幾條 net 下
+    std::string pin;
+    std::vector<std::string> nets;     // 依名稱排序
+};
+
+struct LvsReport {
+    size_t schematicNets = 0, layoutNets = 0, matched = 0;
+    std::vector<LvsOpen>  opens;
+    std::vector<LvsShort> shorts;
+    std::vector<std::string> missingPins;   // schematic 有、layout 沒有（或 label 沒落在導電 shape 上）
+    std::vector<std::string> extraLabels;   // layout 有 label、schematic 沒有這個 pin
+    std::vector<LvsDuplicate> duplicatePins;
+
+    bool clean() const { return opens.empty() && shorts.empty() && missingPins.empty() && extraLabels.empty() &&
+                                duplicatePins.empty(); }
+};
+
+// 結果依名稱 / net 編號排序，與 unordered_map 的走訪順序無關
+LvsReport compareNets(const Netlist& nets, const std::vector<Label>& labels, const Schematic& sch);
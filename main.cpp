@@ -1,27 +1,38 @@
 #include "parser.hpp"
 #include "drc.hpp"
 #include "report.hpp"
-#include <windows.h>
+#include "tile.hpp"
+#include "connectivity.hpp"
+#include "lvs.hpp"
+#include "incremental.hpp"
+#include "server.hpp"
+#include "sink.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
+#include "batch.hpp"
+#include "hier.hpp"
+#include "pipeline.hpp"
+#include "regionindex.hpp"
 #include <algorithm>
 #include <cctype>
+#include <filesystem>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cstdlib>
 
 
 
 
+// 目前目錄下的 layout*.txt / layout*.bin（.bin 由 layout2bin 轉出）
 static std::vector<std::string> find_layouts() {
+    namespace fs = std::filesystem;
     std::vector<std::string> files;
-    WIN32_FIND_DATAA data;
-    HANDLE h = FindFirstFileA("layout*.txt", &data);
-    if (h != INVALID_HANDLE_VALUE) {
-        do {
-            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-                files.push_back(data.cFileName);
-            }
-        } while (FindNextFileA(h, &data));
-        FindClose(h);
+    std::error_code ec;
+    for (const auto& e : fs::directory_iterator(".", ec)) {
+        if (!e.is_regular_file(ec)) continue;
+        const std::string name = e.path().filename().string(), ext = e.path().extension().string();
+        if (name.rfind("layout", 0) == 0 && (ext == ".txt" || ext == ".bin")) files.push_back(name);
     }
     std::sort(files.begin(), files.end());
     return files;
@@ -53,28 +64,363 @@ static std::string choose_layout() {
 }
 
 
-int main(){
-    
+// tile worker：--tile-worker <layout> <rules> <die> <tile> <out.jsonl> [--threads N]
+// 由 tile 模式的 launcher 啟動，不互動、只把這塊 tile 擁有的違規寫成 JSON lines
+static int run_tile_worker(int argc, char** argv){
+    if (argc < 7) { std::cerr << "--tile-worker 參數不足\n"; return 2; }
+    int threads = 1;
+    if (argc >= 9 && std::string(argv[7]) == "--threads") threads = std::atoi(argv[8]);
+    Box die{}, core{};
+    if (!parseBox(argv[4], die) || !parseBox(argv[5], core)) { std::cerr << "box 格式錯誤\n"; return 2; }
+    try {
+        RuleSet rules = readRules(argv[3]);
+        saveViolations(argv[6], runTile(argv[2], rules, die, core, threads));
+    } catch (const std::exception& e) {
+        std::cerr << "tile worker: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+// 批次模式：--batch [--rules FILE]... [--out DIR] [--jobs P] [--threads N] [--die x1,y1,x2,y2] [--quiet] LAYOUT|DIR...
+// 不互動；見 batch.hpp
+static int run_batch(int argc, char** argv){
+    BatchOptions opt;
+    for (int i = 2; i < argc; ++i) {
+        std::string a = argv[i];
+        const bool hasArg = i + 1 < argc;
+        if (a == "--rules" && hasArg) opt.rulesFiles.push_back(argv[++i]);
+        else if (a == "--out" && hasArg) opt.outDir = argv[++i];
+        else if (a == "--jobs" && hasArg) opt.jobs = std::atoi(argv[++i]);
+        else if (a == "--threads" && hasArg) opt.threads = std::atoi(argv[++i]);
+        else if (a == "--die" && hasArg) {
+            if (!parseBox(argv[++i], opt.die)) { std::cerr << "box 格式錯誤: " << argv[i] << "\n"; return 2; }
+            opt.fixedDie = true;
+        }
+        else if (a == "--quiet") opt.quiet = true;
+        else if (a.rfind("--", 0) == 0) { std::cerr << "未知參數: " << a << "\n"; return 2; }
+        else opt.layouts.push_back(a);
+    }
+    if (opt.layouts.empty()) {
+        std::cerr << "usage: --batch [--rules FILE]... [--out DIR] [--jobs P] [--threads N] "
+                     "[--die x1,y1,x2,y2] [--quiet] LAYOUT|DIR...\n";
+        return 2;
+    }
+    return runBatch(opt);
+}
+
+
+int main(int argc, char** argv){
+
+    if (argc > 1 && std::string(argv[1]) == "--tile-worker") return run_tile_worker(argc, argv);
+    // 常駐模式：--serve SOCKET [--threads N]，協定見 server.hpp
+    if (argc > 2 && std::string(argv[1]) == "--serve") {
+        ServerOptions opt;
+        opt.socketPath = argv[2];
+        if (argc >= 5 && std::string(argv[3]) == "--threads") opt.threads = std::atoi(argv[4]);
+        return runServer(opt);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch") return run_batch(argc, argv);
+
+    // 0) 命令列參數：
+    //    --threads N   每個行程的執行緒數（預設 1；0 = 全部核心）
+    //    --tiles NX[,NY] --jobs P   tile 模式：die 切塊、每塊一個子行程、最多 P 個同時跑
+    //    --labels FILE   另外做連線萃取，把 label 所在的 net 寫到 net_report.txt
+    //    --schematic FILE  再與 schematic 比對（LVS-lite），結果寫到 lvs_report.txt（需要 --labels）
+    //    --incremental   沿用 <layout>.drccache.* 裡上一次的結果，只重算改過的區域
+    //    --stream        違規邊找邊寫進 drc_report.txt / drc_fail_table.csv，不留在記憶體、不印 console
+    //    --max-per-rule N  （--stream）每條規則最多寫 N 筆
+    //    --fused         每層一次 plane sweep 做完所有 check（單執行緒，結果相同）
+    //    --merged        via 以外各層重疊 / 相接的 shape 先 merge 成 region 再檢查（單執行緒）
+    //    --pipeline      邊讀 layout 邊查：die 切成橫帶，讀過的帶交給 worker，報表依帶寫出、不印 console
+    //    --bands N       （--pipeline）橫帶數，預設 64
+    //    --region x1,y1,x2,y2  只查這個區域擁有的違規：從 <layout>.ridx 只讀碰得到的格子（索引不在或過期先重建）
+    //    --die x1,y1,x2,y2     改用這個 die（預設 0,0,200,100）
+    //    --stats         各階段 / 各 check 的時間、記憶體、計數器寫到 drc_stats.json / drc_stats.csv
+    //    --trace FILE    （隱含 --stats）另外寫 Chrome trace-event 檔
+    int threads = 1, tilesX = 0, tilesY = 0, jobs = 1, bands = 64;
+    long long maxPerRule = 0;
+    std::string labelsFile, schematicFile, traceFile;
+    Box region{}, die{0, 0, 200, 100};
+    bool hasRegion = false;
+    bool incremental = false, stream = false, stats = false, fused = false, pipeline = false;
+    bool merged = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--threads" && i + 1 < argc) threads = std::atoi(argv[++i]);
+        else if (a.rfind("--threads=", 0) == 0) threads = std::atoi(a.c_str() + 10);
+        else if (a == "--tiles" && i + 1 < argc) {
+            std::string t = argv[++i];
+            auto comma = t.find(',');
+            tilesX = std::atoi(t.c_str());
+            tilesY = comma == std::string::npos ? tilesX : std::atoi(t.c_str() + comma + 1);
+        }
+        else if (a == "--jobs" && i + 1 < argc) jobs = std::atoi(argv[++i]);
+        else if (a == "--labels" && i + 1 < argc) labelsFile = argv[++i];
+        else if (a == "--schematic" && i + 1 < argc) schematicFile = argv[++i];
+        else if (a == "--incremental") incremental = true;
+        else if (a == "--stream") stream = true;
+        else if (a == "--fused") fused = true;
+        else if (a == "--merged") merged = true;
+        else if (a == "--pipeline") pipeline = true;
+        else if (a == "--bands" && i + 1 < argc) bands = std::atoi(argv[++i]);
+        else if (a == "--region" && i + 1 < argc) {
+            if (!parseBox(argv[++i], region)) { std::cerr << "--region 格式: x1,y1,x2,y2\n"; return 1; }
+            hasRegion = true;
+        }
+        else if (a == "--die" && i + 1 < argc) {
+            if (!parseBox(argv[++i], die)) { std::cerr << "--die 格式: x1,y1,x2,y2\n"; return 1; }
+        }
+        else if (a == "--max-per-rule" && i + 1 < argc) maxPerRule = std::atoll(argv[++i]);
+        else if (a == "--stats") stats = true;
+        else if (a == "--trace" && i + 1 < argc) { traceFile = argv[++i]; stats = true; }
+        else { std::cerr << "未知參數: " << a << "\n"; return 1; }
+    }
+    if (tilesX > 0 && (incremental || !labelsFile.empty() || !schematicFile.empty())) {
+        std::cerr << "--tiles 不能與 --incremental / --labels / --schematic 同時使用\n";
+        return 1;
+    }
+    if (stream && (incremental || tilesX > 0)) {
+        std::cerr << "--stream 不能與 --incremental / --tiles 同時使用\n";
+        return 1;
+    }
+    if (fused && (stream || incremental || tilesX > 0)) {
+        std::cerr << "--fused 不能與 --stream / --incremental / --tiles 同時使用\n";
+        return 1;
+    }
+    if (pipeline && (fused || stream || incremental || tilesX > 0)) {
+        std::cerr << "--pipeline 不能與 --fused / --stream / --incremental / --tiles 同時使用\n";
+        return 1;
+    }
+    if (merged && (fused || pipeline || hasRegion || stream || incremental || tilesX > 0)) {
+        std::cerr << "--merged 不能與 --fused / --pipeline / --region / --stream / --incremental / --tiles 同時使用\n";
+        return 1;
+    }
+    if (hasRegion && (pipeline || fused || stream || incremental || tilesX > 0 || !labelsFile.empty())) {
+        std::cerr << "--region 不能與 --pipeline / --fused / --stream / --incremental / --tiles / --labels 同時使用\n";
+        return 1;
+    }
+
+    enableStats(stats);
+    // 最後一步：寫出 --stats / --trace（tile 模式只有主行程這邊的階段）
+    auto finishStats = [&]{
+        if (!stats) return;
+        writeStats("drc_stats", ThreadPool::resolveThreads(threads));
+        std::cout << "Stats saved to drc_stats.json / drc_stats.csv\n";
+        if (!traceFile.empty()) {
+            writeStatsTrace(traceFile);
+            std::cout << "Trace saved to " << traceFile << "\n";
+        }
+    };
+
     // 1) 先選 layout 檔
     std::string layoutFile = choose_layout();
     std::cout << "使用檔案: " << layoutFile << "\n";
 
-    // 2) 讀 layout / rules
-    auto shapes = readLayout(layoutFile);
-    RuleSet rules = readRules("rules.json");
-    std::cout << "Loaded " << shapes.size() << " shapes\n";
+    const std::string rulesFile = "rules.json";
+    RuleSet rules = readRules(rulesFile);
 
-    // 4) DRC
-    check_min_width(shapes, rules);
-    check_min_spacing(shapes, rules);
-    check_via_enclosure_multi(shapes, rules);
-    check_density(shapes, rules, 0,0, 200,100);
-    writeDRCReport("drc_report.txt", shapes, rules, 0,0,200,100);
-    std::cout << "DRC results saved to drc_report.txt\n";
+    // 連線萃取（與 LVS）：平面 layout 直接用讀進來的 store，階層 layout 先展平
+    auto runConnectivity = [&](const ShapeStore& store){
+        StatsScope scope("connectivity");
+        auto labels = readLabels(labelsFile);
+        Netlist nets = extractNets(store, rules, labels);
+        writeNetReport("net_report.txt", nets, labels);
+        std::cout << "Extracted " << nets.numNets << " nets, net report saved to net_report.txt\n";
 
-    // 5) 表格化 (CSV by print_table )
-    writeDRCReportTable("drc_fail_table.csv", shapes, rules, 0,0,200,100);
-    std::cout << "DRC table saved to drc_fail_table.csv\n";
+        if (!schematicFile.empty()) {
+            try {
+                LvsReport lvs = compareNets(nets, labels, readSchematic(schematicFile));
+                std::ofstream out("lvs_report.txt");
+                writeLvsReport(out, lvs);
+                std::cout << "LVS " << (lvs.clean() ? "CLEAN" : "MISMATCH") << ": "
+                          << lvs.opens.size() << " opens, " << lvs.shorts.size() << " shorts"
+                          << ", saved to lvs_report.txt\n";
+            } catch (const std::exception& e) {
+                std::cerr << "ERROR: " << e.what() << "\n";
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // 2)~4) DRC：四個 check 只跑一次，console / 文字報告 / CSV 都序列化同一份清單
+    std::vector<Violation> violations;
+    // 判斷階層要掃整份檔案：--pipeline 改在讀到 CELL / INST 時才停，--region 看索引表頭記的 flag，都不先把整份讀進來
+    const bool hierarchical = !pipeline && !hasRegion && isHierarchicalLayout(layoutFile);
+    if (hierarchical && (tilesX > 0 || stream || incremental || fused || merged)) {
+        std::cerr << "階層式 layout 不支援 --tiles / --stream / --incremental / --fused / --pipeline / --region / --merged\n";
+        return 1;
+    }
+    if (hierarchical) {
+        // 階層 layout：每個 cell 只查一次，instance 之間只補查交界（見 hier.hpp）
+        HierLayout hier;
+        {
+            StatsScope scope("parse", "hier");
+            hier = readHierLayout(layoutFile, rules);
+            scope.c.visited = (long long)hier.uniqueShapes();
+        }
+        std::cout << "Loaded hierarchical layout: " << hier.order.size() << " cells, "
+                  << hier.instanceCount() << " instances, " << hier.uniqueShapes() << " unique shapes ("
+                  << hier.flatCount() << " flattened)\n";
+        {
+            StatsScope scope("drc", "hier");
+            violations = run_drc_hier(hier, rules, die.x1,die.y1,die.x2,die.y2);
+        }
+        if (!labelsFile.empty()) {
+            try {
+                if (!runConnectivity(flattenHier(hier))) return 1;
+            } catch (const std::exception& e) {
+                std::cerr << "ERROR: " << e.what() << "\n";
+                return 1;
+            }
+        }
+    } else if (tilesX > 0) {
+        // tile 模式：主行程不讀 layout，全部交給 worker
+        std::cout << "Tiled run: " << tilesX << "x" << tilesY << " tiles, "
+                  << jobs << " jobs, halo " << ruleHalo(rules) << "\n";
+        try {
+            StatsScope scope("drc", "tiles");
+            violations = runTiledDRC(argv[0], layoutFile, rulesFile, die, tilesX, tilesY, jobs, threads);
+        } catch (const std::exception& e) {
+            std::cerr << "ERROR: " << e.what() << "\n";
+            return 1;
+        }
+    } else if (hasRegion) {
+        // 區域模式：不讀整份 layout，只從磁碟索引載入 region 需要的格子（見 regionindex.hpp）
+        const std::string index = regionIndexPath(layoutFile);
+        try {
+            if (!regionIndexFresh(layoutFile, index)) {
+                StatsScope scope("index", "build");
+                buildRegionIndex(layoutFile, index);
+                std::cout << "Built region index " << index << "\n";
+            }
+            ShapeStore store;
+            RegionLoadStats st;
+            {
+                StatsScope scope("parse", "region");
+                std::string err;
+                if (!loadRegion(index, rules, die, region, store, err, &st))
+                    throw std::runtime_error(index + ": " + err);
+                scope.c.visited = (long long)st.shapesLoaded;
+            }
+            std::cout << "Region " << boxArg(region) << ": loaded " << st.shapesLoaded << " of " << st.shapes
+                      << " shapes from " << st.tilesLoaded << "/" << st.tiles << " index tiles\n";
+            StatsScope scope("drc", "region");
+            violations = checkRegion(store, rules, die, region);
+        } catch (const std::exception& e) {
+            std::cerr << "ERROR: " << e.what() << "\n";
+            return 1;
+        }
+    } else if (pipeline) {
+        // 管線模式：parse 與 check 重疊，報表直接寫檔（見 pipeline.hpp）
+        PipelineOptions opt;
+        opt.bands = bands;
+        opt.threads = threads;
+        PipelineResult res;
+        try {
+            StatsScope scope("drc", "pipeline");
+            res = runPipelined(layoutFile, rules, die, opt);
+            scope.c.visited = (long long)res.shapes;
+            scope.c.found = (long long)res.fails;
+        } catch (const std::exception& e) {
+            std::cerr << "ERROR: " << e.what() << "\n";
+            return 1;
+        }
+        std::cout << "Loaded " << res.shapes << " shapes\n";
+        if (res.fellBack) std::cout << "Pipeline: " << res.reason << ", ran a full pass instead\n";
+        else {
+            std::cout << "Pipeline: " << res.bands << " bands, " << res.bandsWhileParsing
+                      << " checked while parsing";
+            if (res.firstOutputMs >= 0) std::cout << ", first violations after " << res.firstOutputMs << " ms";
+            std::cout << "\n";
+        }
+        std::cout << "Wrote " << res.fails << " violations to drc_report.txt / drc_fail_table.csv\n";
+        if (!labelsFile.empty()) {
+            ShapeStore store;
+            {
+                StatsScope scope("parse");
+                store = readLayout(layoutFile, rules);
+            }
+            if (!runConnectivity(store)) return 1;
+        }
+    } else if (incremental) {
+        // 增量模式不整份重新解析：從快取載入上一次的 layout，只重讀檔案裡改過的那一段
+        const std::string cache = layoutFile + ".drccache";
+        IncrementalState state;
+        {
+            StatsScope scope("parse", "incremental");
+            loadIncremental(cache, layoutFile, rules, state);
+            scope.c.visited = (long long)state.layout.count();
+        }
+        std::cout << "Loaded " << state.layout.count() << " shapes\n";
+        IncrementalStats st;
+        {
+            StatsScope scope("drc", "incremental");
+            violations = updateIncremental(state, rules, readFileText(rulesFile), die, threads, &st);
+        }
+        if (st.full) std::cout << "Incremental: no usable cache, full run\n";
+        else std::cout << "Incremental: +" << st.added << " -" << st.removed << " shapes, kept "
+                       << st.kept << ", recomputed " << st.recomputed << " violations\n";
+        try {
+            saveIncrementalCache(cache, layoutFile, state);
+        } catch (const std::exception& e) {
+            std::cerr << "WARNING: " << e.what() << "\n";
+        }
+        if (!labelsFile.empty() && !runConnectivity(state.layout.toStore())) return 1;
+    } else {
+        ShapeStore store;
+        {
+            StatsScope scope("parse");
+            store = readLayout(layoutFile, rules);
+            scope.c.visited = (long long)store.count;
+        }
+        std::cout << "Loaded " << store.count << " shapes\n";
+        if (stream) {
+            SinkOptions opt;
+            opt.maxPerRule = maxPerRule;
+            try {
+                ViolationSink sink(store, rules, opt);
+                {
+                    StatsScope scope("drc", "stream");
+                    run_drc_stream(store, rules, die.x1,die.y1,die.x2,die.y2, threads, sink);
+                    sink.close();
+                    scope.c.found = (long long)sink.fails();
+                }
+                std::cout << "Streamed " << sink.fails() << " violations to drc_report.txt / drc_fail_table.csv";
+                if (sink.dropped()) std::cout << " (" << sink.dropped() << " over --max-per-rule dropped)";
+                std::cout << "\n";
+            } catch (const std::exception& e) {
+                std::cerr << "ERROR: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (fused) {
+            StatsScope scope("drc", "fused");
+            violations = run_drc_fused(store, rules, die.x1,die.y1,die.x2,die.y2);
+        } else if (merged) {
+            StatsScope scope("drc", "merged");
+            violations = run_drc_merged(store, rules, die.x1,die.y1,die.x2,die.y2);
+        } else {
+            StatsScope scope("drc");
+            violations = run_drc(store, rules, die.x1,die.y1,die.x2,die.y2, threads);
+        }
+
+        if (!labelsFile.empty() && !runConnectivity(store)) return 1;
+    }
+    if (stream || pipeline) { finishStats(); return 0; }   // 報表已經邊跑邊寫好了
+    {
+        StatsScope scope("report");
+        scope.c.visited = (long long)violations.size();
+        printViolations(std::cout, violations);
+        writeDRCReport("drc_report.txt", violations);
+        std::cout << "DRC results saved to drc_report.txt\n";
+
+        // 5) 表格化 (CSV by print_table )
+        writeDRCReportTable("drc_fail_table.csv", violations);
+        std::cout << "DRC table saved to drc_fail_table.csv\n";
+    }
 
+    finishStats();
     return 0;
 }
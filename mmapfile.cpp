@@ -0,0 +1,54 @@
+#include "mmapfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+MappedFile::MappedFile(const std::string& path){
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return;
+    file_ = f;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz)) return;
+    size_ = (size_t)sz.QuadPart;
+    if (size_ == 0) { ok_ = true; return; }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) return;
+    mapping_ = m;
+    data_ = (const char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    ok_ = data_ != nullptr;
+}
+
+MappedFile::~MappedFile(){
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle((HANDLE)mapping_);
+    if (file_) CloseHandle((HANDLE)file_);
+}
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) != 0) { ::close(fd); return; }
+    size_ = (size_t)st.st_size;
+    if (size_ == 0) { ::close(fd); ok_ = true; return; }
+    void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);                        // mapping 保留到 munmap，fd 可以先關
+    if (p == MAP_FAILED) { size_ = 0; return; }
+    ::madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = (const char*)p;
+    ok_ = true;
+}
+
+MappedFile::~MappedFile(){
+    if (data_) ::munmap((void*)data_, size_);
+}
+#endif
@@ -1,19 +1,154 @@
 #include "parser.hpp"
+#include "mmapfile.hpp"
+#include "layoutbin.hpp"
+#include <charconv>
+#include <cstring>
 
-// 讀取版圖矩形列表：每行格式為 "<layer> <x1> <y1> <x2> <y2>"
-std::vector<Shape> readLayout(const std::string& filename){
-    std::vector<Shape> v;                 // 用來存所有矩形 (layer 與座標)
-    std::ifstream fin(filename);          // 開檔（RAII：離開作用域自動關閉）
-    if(!fin.is_open()){                   // 檔案開啟失敗就回傳空 vector
+// ---- layout 文字檔 tokenizer ----
+// 整個檔案 mmap 進來，逐行手寫掃描：層名直接在 buffer 上比對後 intern 成小整數 ID，
+// 座標用 std::from_chars，整個過程不為每個矩形配置字串。
+// 格式錯誤的行記下「行:欄」後略過，繼續讀下一行（舊版遇到壞行會直接默默停止）。
+static inline bool isBlank(char c){ return c==' ' || c=='\t' || c=='\r' || c=='\f' || c=='\v'; }
+
+// emit(id, x1, y1, x2, y2, 行首)；line = 第一行的前一個行號（錯誤訊息用）
+template<class F>
+static void parseLayoutBuffer(const char* p, const char* end, LayerTable& layers,
+                              std::vector<ParseError>& errs, F&& emit, size_t line = 0)
+{
+    while (p < end) {
+        ++line;
+        const char* ls = p;
+        const char* le = (const char*)std::memchr(p, '\n', (size_t)(end - p));
+        if (!le) le = end;
+        p = le + 1;
+
+        const char* q = ls;
+        auto skipBlank = [&]{ while (q < le && isBlank(*q)) ++q; };
+        auto fail = [&](const char* at, std::string msg){
+            errs.push_back({line, (size_t)(at - ls) + 1, std::move(msg)});
+        };
+
+        skipBlank();
+        if (q == le) continue;                           // 空行
+        const char* ns = q;
+        while (q < le && !isBlank(*q)) ++q;
+        std::string_view name(ns, (size_t)(q - ns));
+
+        int c[4];
+        bool ok = true;
+        for (int k = 0; k < 4 && ok; ++k) {
+            skipBlank();
+            if (q == le) { fail(q, "expected 4 coordinates, got " + std::to_string(k)); ok = false; break; }
+            const char* ts = q;
+            if (*q == '+') ++q;                          // from_chars 不接受前置 '+'
+            auto r = std::from_chars(q, le, c[k]);
+            if (r.ec == std::errc::result_out_of_range) { fail(ts, "coordinate out of int range"); ok = false; break; }
+            if (r.ec != std::errc() || (r.ptr < le && !isBlank(*r.ptr))) {
+                const char* te = ts;
+                while (te < le && !isBlank(*te)) ++te;
+                fail(ts, "invalid coordinate '" + std::string(ts, te) + "'");
+                ok = false; break;
+            }
+            q = r.ptr;
+        }
+        if (!ok) continue;
+        skipBlank();
+        if (q != le) { fail(q, "unexpected trailing text"); continue; }
+
+        emit(layers.intern(name), c[0], c[1], c[2], c[3], ls);
+    }
+}
+
+void reportParseErrors(const std::string& filename, const std::vector<ParseError>& errs,
+                       std::vector<ParseError>* errors)
+{
+    if (errors) { errors->insert(errors->end(), errs.begin(), errs.end()); return; }
+    const size_t shown = std::min<size_t>(errs.size(), 20);
+    for (size_t k = 0; k < shown; ++k) {
+        if (errs[k].line == 0) { std::cerr << filename << ": error: " << errs[k].msg << "\n"; continue; }
+        std::cerr << filename << ":" << errs[k].line << ":" << errs[k].col
+                  << ": error: " << errs[k].msg << " (line skipped)\n";
+    }
+    if (errs.size() > shown)
+        std::cerr << filename << ": " << (errs.size() - shown) << " more malformed lines skipped\n";
+}
+
+// 讀取版圖矩形列表：每行格式為 "<layer> <x1> <y1> <x2> <y2>"，直接依層放進 SoA
+static ShapeStore readLayout(const std::string& filename, LayerTable layers, std::vector<ParseError>* errors){
+    ShapeStore store;
+    store.layers = std::move(layers);
+    MappedFile mf(filename);
+    if(!mf.ok()){                         // 檔案開啟失敗就回傳空的 store
+        std::cerr<<"Error opening "<<filename<<"\n";
+        return store;
+    }
+    std::vector<ParseError> errs;
+    if (isBinaryLayout(mf.data(), mf.size())) {
+        // layout2bin 轉出的二進位檔：每層整塊複製，不需解析
+        std::string err;
+        if (!decodeBinaryLayout(mf.data(), mf.size(), store, err)) {
+            errs.push_back({0, 0, "bad binary layout: " + err});
+            store.byLayer.clear();
+            store.layers.names.clear();
+            store.count = 0;
+        }
+    } else {
+        parseLayoutBuffer(mf.data(), mf.data() + mf.size(), store.layers, errs,
+                          [&](int id, int x1, int y1, int x2, int y2, const char*){
+                              store.add(id, x1, y1, x2, y2);
+                          });
+    }
+    reportParseErrors(filename, errs, errors);
+    return store;                          // RVO/NRVO
+}
+
+ShapeStore readLayout(const std::string& filename, std::vector<ParseError>* errors){
+    return readLayout(filename, LayerTable{}, errors);
+}
+
+ShapeStore readLayout(const std::string& filename, const RuleSet& rules, std::vector<ParseError>* errors){
+    return readLayout(filename, layerTableFor(rules), errors);
+}
+
+bool scanLayout(const std::string& filename, LayerTable& layers,
+                const std::function<void(const Shape&, size_t)>& fn,
+                std::vector<ParseError>* errors){
+    MappedFile mf(filename);
+    if(!mf.ok()){
         std::cerr<<"Error opening "<<filename<<"\n";
-        return v;
+        return false;
     }
-    std::string layer; int x1,y1,x2,y2;   // 暫存單行欄位
-    // 透過 operator>> 逐欄讀取；只要一欄讀失敗（含 EOF）整行就結束迴圈
-    while(fin >> layer >> x1 >> y1 >> x2 >> y2)
-        // 以聚合初始化(aggregate initialization) 直接建構 Shape 並 push_back
-        v.push_back({layer,x1,y1,x2,y2});
-    return v;                              // 回傳收集到的所有 Shape（RVO/NRVO）
+    std::vector<ParseError> errs;
+    if (isBinaryLayout(mf.data(), mf.size())) {
+        // 二進位檔是依層存放：逐層直接從 mmap 解碼回呼，不先建整份 store；idx 用檔內記的全域 idx（不保證遞增）
+        std::string err;
+        int gid = -1;
+        if (!scanBinaryLayout(mf.data(), mf.size(),
+                              [&](std::string_view name){ gid = layers.intern(name); },
+                              [&](int x1, int y1, int x2, int y2, int idx){
+                                  fn(Shape{gid, x1, y1, x2, y2}, (size_t)idx);
+                              }, err))
+            errs.push_back({0, 0, "bad binary layout: " + err});
+        reportParseErrors(filename, errs, errors);
+        return errs.empty();
+    }
+    size_t idx = 0;
+    parseLayoutBuffer(mf.data(), mf.data() + mf.size(), layers, errs,
+                      [&](int id, int x1, int y1, int x2, int y2, const char*){
+                          fn(Shape{id, x1, y1, x2, y2}, idx++);
+                      });
+    reportParseErrors(filename, errs, errors);
+    return true;
+}
+
+void parseLayoutText(const char* data, size_t size, LayerTable& layers,
+                     const std::function<void(const Shape&, size_t)>& fn,
+                     std::vector<ParseError>& errs, size_t firstLine)
+{
+    parseLayoutBuffer(data, data + size, layers, errs,
+                      [&](int id, int x1, int y1, int x2, int y2, const char* ls){
+                          fn(Shape{id, x1, y1, x2, y2}, (size_t)(ls - data));
+                      }, firstLine - 1);
 }
 
 
@@ -47,14 +182,26 @@ RuleSet readRules(const std::string& filename){
     RuleSet r{};
 
     try {
-        r.min_spacing_M1 = j["min_spacing"].at("M1").get<int>();
-        r.min_spacing_M2 = j["min_spacing"].at("M2").get<int>();
-        r.min_width_M1   = j["min_width"].at("M1").get<int>();
-        r.min_width_M2   = j["min_width"].at("M2").get<int>();
-        r.max_width_M1   = j["max_width"].at("M1").get<int>();
-        r.max_width_M2   = j["max_width"].at("M2").get<int>();
+        // 每層的 width / spacing 規則：表裡有幾層就收幾層，不再只認 M1/M2
+        auto perLayer = [&](const char* key, int RuleSet::LayerRule::* field){
+            for (auto it = j[key].begin(); it != j[key].end(); ++it)
+                r.layer_rules[it.key()].*field = it.value().get<int>();
+        };
+        perLayer("min_spacing", &RuleSet::LayerRule::min_spacing);
+        perLayer("min_width",   &RuleSet::LayerRule::min_width);
+        perLayer("max_width",   &RuleSet::LayerRule::max_width);
+
+        if (j.contains("layers")) {
+            for (const auto& s : j["layers"])
+                r.layers.push_back(s.get<std::string>());
+        }
+        if (j.contains("layer_mapping")) {
+            for (auto it = j["layer_mapping"].begin(); it != j["layer_mapping"].end(); ++it)
+                r.layer_mapping[it.key()] = it.value().get<int>();
+        }
         r.density_window = j["density_check"].at("window_size").get<int>();
         r.min_density    = j["density_check"].at("min_density").get<double>();
+        r.density_step   = j["density_check"].value("step", r.density_window);
 
         if (j.contains("via_enclosure")) {
             for (auto it = j["via_enclosure"].begin(); it != j["via_enclosure"].end(); ++it) {
@@ -70,19 +217,49 @@ RuleSet readRules(const std::string& filename){
             }
         }
 
+        // 導通關係：每條 via_enclosure 規則的 via 連接 under 與 over
+        for (const auto& kv : r.via_encl_map)
+            r.via_conn[kv.first] = {kv.second.under, kv.second.over};
+
         if (j.contains("conductive_layers")) {
             for (const auto& s : j["conductive_layers"])
                 r.conductive_layers.insert(s.get<std::string>());
+        } else {
+            // 預設：有 width/spacing 規則的層，加上所有 via 與它連接的層
+            for (const auto& kv : r.layer_rules) r.conductive_layers.insert(kv.first);
+            for (const auto& kv : r.via_conn) {
+                r.conductive_layers.insert(kv.first);
+                r.conductive_layers.insert(kv.second[0]);
+                r.conductive_layers.insert(kv.second[1]);
+            }
         }
 
-        if (j.contains("density_layers")) {
-            for (const auto& s : j["density_layers"])
+        // 密度層：density_check.layers，其次是舊版頂層的 density_layers，都沒有時用 M1~M3
+        const json* densityLayers = j["density_check"].contains("layers") ? &j["density_check"]["layers"]
+                                  : j.contains("density_layers")          ? &j["density_layers"] : nullptr;
+        if (densityLayers) {
+            for (const auto& s : *densityLayers)
                 r.density_layers.insert(s.get<std::string>());
         } else {
             r.density_layers.insert("M1");
             r.density_layers.insert("M2");
             r.density_layers.insert("M3");
         }
+        // 有宣告 "layers" 時，規則只能引用宣告過的層（多半是打錯字）
+        if (!r.layers.empty()) {
+            auto check = [&](const std::string& name, const char* where){
+                if (std::find(r.layers.begin(), r.layers.end(), name) == r.layers.end())
+                    throw std::runtime_error(std::string("rules.json: ") + where +
+                                             " refers to undeclared layer '" + name + "'");
+            };
+            for (const auto& kv : r.layer_rules)   check(kv.first, "min_spacing/min_width/max_width");
+            for (const auto& kv : r.layer_mapping) check(kv.first, "layer_mapping");
+            for (const auto& kv : r.via_encl_map) {
+                check(kv.first, "via_enclosure");
+                check(kv.second.under, "via_enclosure");
+                check(kv.second.over, "via_enclosure");
+            }
+        }
     } catch (const json::type_error& e) {
         throw std::runtime_error(std::string("rules.json type error: ") + e.what());
     } catch (const json::out_of_range& e) {
@@ -91,3 +268,55 @@ RuleSet readRules(const std::string& filename){
 
     return r;
 }
+
+
+// 讀取 net label：每行 "<name> <layer> <x> <y>"，空行略過；格式錯誤的行印出行號後略過
+std::vector<Label> readLabels(const std::string& file){
+    std::vector<Label> labels;
+    std::ifstream fin(file);
+    if(!fin.is_open()){
+        std::cerr<<"Error opening "<<file<<"\n";
+        return labels;
+    }
+    std::string line;
+    size_t lineNo = 0;
+    while (std::getline(fin, line)) {
+        ++lineNo;
+        std::istringstream ss(line);
+        Label L;
+        if (!(ss >> L.name)) continue;                   // 空行
+        std::string extra;
+        if (!(ss >> L.layer >> L.x >> L.y) || (ss >> extra)) {
+            std::cerr << file << ":" << lineNo << ": error: expected \"<name> <layer> <x> <y>\" (line skipped)\n";
+            continue;
+        }
+        labels.push_back(std::move(L));
+    }
+    return labels;
+}
+
+
+std::unordered_map<std::string, std::vector<std::string>>
+readSchematic(const std::string& file){
+    std::ifstream fin(file);
+    if(!fin.is_open()){
+        throw std::runtime_error("Cannot open schematic file: " + file);
+    }
+    json j;
+    try {
+        fin >> j;
+    } catch (const json::parse_error& e) {
+        throw std::runtime_error(file + " parse error at byte " + std::to_string(e.byte) + ": " + e.what());
+    }
+
+    std::unordered_map<std::string, std::vector<std::string>> nets;
+    try {
+        const json& top = j.is_object() && j.contains("nets") ? j["nets"] : j;
+        if (!top.is_object()) throw std::runtime_error(file + ": expected an object of nets");
+        for (auto it = top.begin(); it != top.end(); ++it)
+            nets[it.key()] = it.value().get<std::vector<std::string>>();
+    } catch (const json::type_error& e) {
+        throw std::runtime_error(file + ": each net must map to an array of pin names (" + e.what() + ")");
+    }
+    return nets;
+}
@@ -1,8 +1,35 @@
 #pragma once
 #include "common.hpp"
+#include <functional>
 
-std::vector<Shape> readLayout(const std::string& filename);
+// layout 格式錯誤的行：行號、欄號都從 1 起算
+struct ParseError { size_t line, col; std::string msg; };
+
+// 文字檔或 layout2bin 轉出的二進位檔（看檔頭 magic 自動判斷）。
+// 壞行會被略過；errors==nullptr 時錯誤直接印到 stderr，否則收進 *errors（二進位檔損毀時 line==0）
+ShapeStore readLayout(const std::string& filename,
+                      std::vector<ParseError>* errors = nullptr);
+// 同上，但層名先經 rules 的 layer_mapping 換成正名（見 layerTableFor）；要配 rules 跑 check 時用這個
+ShapeStore readLayout(const std::string& filename, const RuleSet& rules,
+                      std::vector<ParseError>* errors = nullptr);
+// 逐筆回呼 fn(shape, idx)，shape.layer 是 layers 裡的 ID（layers 帶的別名照樣套用）；
+// 不把整份 layout 留在記憶體（tile worker 用）；開檔失敗或二進位檔損毀回傳 false。
+// 二進位檔依層回呼，idx 不保證遞增
+bool scanLayout(const std::string& filename, LayerTable& layers,
+                const std::function<void(const Shape&, size_t)>& fn,
+                std::vector<ParseError>* errors = nullptr);
+// 記憶體裡的一段 layout 文字（完整的行）：fn(shape, 該行行首在 data 中的位移)，壞行收進 errs，
+// 行號從 firstLine 起算。增量模式只重讀檔案中改過的那一段用
+void parseLayoutText(const char* data, size_t size, LayerTable& layers,
+                     const std::function<void(const Shape&, size_t)>& fn,
+                     std::vector<ParseError>& errs, size_t firstLine = 1);
+// errors==nullptr 時把 errs 印到 stderr（最多 20 筆，其餘只計數），否則接到 *errors 後面
+void reportParseErrors(const std::string& filename, const std::vector<ParseError>& errs,
+                       std::vector<ParseError>* errors);
 RuleSet readRules(const std::string& filename);
+// 每行 "<name> <layer> <x> <y>"
 std::vector<Label> readLabels(const std::string& file);
+// schematic（JSON）：{ "nets": { "<net>": ["<pin>", ...], ... } }，也接受不包 "nets" 的頂層物件；
+// pin 名稱對應 layout label 的 name
 std::unordered_map<std::string, std::vector<std::string>>
 readSchematic(const std::string& file);
@@ -0,0 +1,249 @@
+#include "pipeline.hpp"
+#include "drc.hpp"
+#include "hier.hpp"
+#include "layoutbin.hpp"
+#include "mmapfile.hpp"
+#include "parser.hpp"
+#include "report.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
+#include "tile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t PARSE_CHUNK = 1 << 20;   // 一次解析（與檢查 CELL / INST）的 bytes，切在下一個換行
+
+struct PooledShape { Shape s; long long idx; };
+
+class Pipeline {
+public:
+    Pipeline(const RuleSet& rules, const Box& die, const PipelineOptions& opt)
+        : layers(layerTableFor(rules)), rules(rules), die(die), opt(opt), halo(ruleHalo(rules)),
+          window(std::max(rules.density_window, 0)), t0(std::chrono::steady_clock::now())
+    {
+        // 每條帶要讀的範圍比 core 多 window + 2·halo；帶再窄下去，重疊的部分比帶本身還多，只是白算
+        const long long height = std::max(1LL, (long long)die.y2 - die.y1);
+        const long long minHeight = std::max(1LL, window + 2 * halo);
+        cores = splitDie(die, 1, (int)std::max(1LL, std::min<long long>(opt.bands, height / minHeight)));
+        ownedTop.assign(cores.size(), LLONG_MIN);
+        done.resize(cores.size());
+        ready.assign(cores.size(), 0);
+        rep.reset(new BufferedWriter(opt.reportPath));
+        csv.reset(new BufferedWriter(opt.csvPath));
+        if (!rep->ok()) throw std::runtime_error("Cannot write " + opt.reportPath);
+        if (!csv->ok()) throw std::runtime_error("Cannot write " + opt.csvPath);
+        writeCsvHeader(*csv);
+        pool.reset(new ThreadPool(std::max(1, ThreadPool::resolveThreads(opt.threads))));
+    }
+
+    // 讀到一半丟例外（例如遇到階層 layout）時，還在跑的帶會用到下面的成員，先等它們做完
+    ~Pipeline(){
+        try { pool->wait(); } catch (const std::exception&) {}   // 正常結束時 finish 已經等過、例外也丟過了
+    }
+
+    // 讀到一個 shape（parse 執行緒）
+    void add(const Shape& s, size_t idx){
+        ++result.shapes;
+        if (result.fellBack) return;
+        if (s.x1 > s.x2 || s.y1 > s.y2) { fallBack("inverted rectangle"); return; }
+        if (s.y1 <= horizon) { fallBack("layout is not sorted by y"); return; }
+
+        const int b = ownerBand(s);
+        ownedTop[b] = std::max<long long>(ownedTop[b], s.y2);
+        shapes.push_back({s, (long long)idx});
+
+        // 之後的 shape 左下角 y 都 >= s.y1：需要範圍整個在 s.y1 以下的帶已經齊了
+        while (next + 1 < (int)cores.size() && need(next) < s.y1) release(next++, true);
+    }
+
+    PipelineResult finish(){
+        if (!result.fellBack)
+            while (next < (int)cores.size()) release(next++, false);
+        pool->wait();
+        rep.reset();
+        csv.reset();
+        result.bands = (int)cores.size();
+        result.firstOutputMs = firstOutputMs;
+        result.violations = violations;
+        result.fails = fails;
+        return result;
+    }
+
+    LayerTable layers;   // parse 執行緒邊讀邊 intern（帶 layer_mapping 別名）；送出帶時複製一份給 worker
+
+private:
+    const RuleSet& rules;
+    const Box die;
+    const PipelineOptions opt;
+    const long long halo, window;
+    const std::chrono::steady_clock::time_point t0;
+
+    std::vector<Box> cores;
+    std::vector<long long> ownedTop;     // 各帶目前擁有的 shape 的最高上緣
+    std::vector<PooledShape> shapes;     // 暫存池：下一條帶之後還可能用到的 shape
+    int next = 0;                        // 下一條要送出的帶
+    long long horizon = LLONG_MIN;       // 已送出的帶需要的範圍上緣；之後的 shape 不能落在這之下
+
+    std::unique_ptr<ThreadPool> pool;
+    std::mutex outM;                     // 以下由 worker 在鎖內更新
+    std::vector<std::vector<Violation>> done;
+    std::vector<char> ready;
+    int written = 0;
+    std::unique_ptr<BufferedWriter> rep, csv;
+    double firstOutputMs = -1;
+    size_t violations = 0, fails = 0;
+
+    PipelineResult result;               // 只有 parse 執行緒寫
+
+    // 與 ownsShape 相同：左下角 y clamp 進 die，落在哪條帶（core 依 y 遞增、首尾相接）
+    int ownerBand(const Shape& s) const {
+        const long long y = std::min<long long>(std::max<long long>(s.y1, die.y1), (long long)die.y2 - 1);
+        auto it = std::upper_bound(cores.begin(), cores.end(), y,
+                                   [](long long v, const Box& c){ return v < c.y1; });
+        return std::max(0, (int)(it - cores.begin()) - 1);
+    }
+
+    // checkRegion 會用到的 y 範圍上緣（與它算的 R 相同）
+    long long need(int b) const {
+        return std::max((long long)cores[b].y2 + window, ownedTop[b]) + halo;
+    }
+
+    void release(int b, bool whileParsing){
+        StatsScope stats("pipeline", "release");
+        horizon = std::max(horizon, need(b));
+        result.bandsWhileParsing += whileParsing;
+
+        auto band = std::make_shared<ShapeStore>();
+        band->layers = layers;
+        band->byLayer.resize(layers.size());
+        for (const auto& p : shapes) band->add(p.s.layer, p.s.x1, p.s.y1, p.s.x2, p.s.y2, p.idx);
+        stats.c.visited = (long long)band->count;
+
+        // 後面的帶需要的範圍從 core.y1 - halo 起（擁有的 shape 左下角都在 core 內）
+        if (b + 1 < (int)cores.size()) {
+            const long long keepFrom = (long long)cores[b + 1].y1 - halo;
+            shapes.erase(std::remove_if(shapes.begin(), shapes.end(),
+                                        [&](const PooledShape& p){ return p.s.y2 < keepFrom; }),
+                         shapes.end());
+        }
+
+        pool->submit([this, b, band]{
+            std::vector<Violation> V;
+            {
+                StatsScope scope("pipeline", "band");
+                // density 的範圍要多一個 window，分開跑讓其他 check 只看擁有的 shape 加 halo
+                V = checkRegion(*band, rules, die, cores[b], CHECK_WIDTH | CHECK_SPACING | CHECK_ENCLOSURE);
+                std::vector<Violation> D = checkRegion(*band, rules, die, cores[b], CHECK_DENSITY);
+                V.insert(V.end(), std::make_move_iterator(D.begin()), std::make_move_iterator(D.end()));
+                scope.c.visited = (long long)band->count;
+                scope.c.found = (long long)V.size();
+            }
+            std::lock_guard<std::mutex> lk(outM);
+            done[b] = std::move(V);
+            ready[b] = 1;
+            flushReady();
+        });
+    }
+
+    // 依帶的順序寫出已經做完的帶
+    void flushReady(){
+        while (written < (int)cores.size() && ready[written]) {
+            // 退回一般模式時這裡寫的會整份被覆寫，照寫無妨
+            std::vector<Violation>& V = done[written];
+            if (!V.empty() && firstOutputMs < 0)
+                firstOutputMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            for (const auto& v : V) {
+                writeReportLine(*rep, v);
+                ++violations;
+                if (v.pass) continue;
+                writeCsvLine(*csv, v);
+                ++fails;
+            }
+            std::vector<Violation>().swap(V);
+            ++written;
+        }
+    }
+
+    void fallBack(const std::string& why){
+        result.fellBack = true;
+        result.reason = why;
+        std::vector<PooledShape>().swap(shapes);
+    }
+};
+
+} // namespace
+
+
+PipelineResult runPipelined(const std::string& layoutFile, const RuleSet& rules, const Box& die,
+                            const PipelineOptions& opt)
+{
+    bool binary = false;
+    {
+        MappedFile mf(layoutFile);
+        if (!mf.ok()) throw std::runtime_error("Cannot open layout file: " + layoutFile);
+        binary = isBinaryLayout(mf.data(), mf.size());
+    }
+
+    // 報表開不起來就不跑：退回一般模式時 writeDRCReport 只會在 stderr 印一行，結束碼卻是成功
+    for (const std::string* path : {&opt.reportPath, &opt.csvPath})
+        if (!std::ofstream(*path, std::ios::app).is_open()) throw std::runtime_error("Cannot write " + *path);
+
+    PipelineResult result;
+    if (!binary) {
+        Pipeline p(rules, die, opt);
+        {
+            StatsScope scope("parse", "pipeline");
+            MappedFile mf(layoutFile);
+            if (!mf.ok()) throw std::runtime_error("Cannot open layout file: " + layoutFile);
+            // 一次解析一段（切在換行）：階層 layout 在讀到第一個 CELL / INST 的那一段就停，不先掃過整份檔案
+            std::vector<ParseError> errs;
+            size_t idx = 0, line = 1;
+            const char* const end = mf.data() + mf.size();
+            for (const char* at = mf.data(); at < end; ) {
+                const char* stop = at + std::min<size_t>(PARSE_CHUNK, (size_t)(end - at));
+                const char* nl = (const char*)std::memchr(stop - 1, '\n', (size_t)(end - stop + 1));
+                stop = nl ? nl + 1 : end;
+                if (hasHierKeyword(at, (size_t)(stop - at)))
+                    throw std::runtime_error(layoutFile + ": hierarchical layout (CELL / INST) is not supported in pipeline mode");
+                parseLayoutText(at, (size_t)(stop - at), p.layers,
+                                [&](const Shape& s, size_t){ p.add(s, idx++); }, errs, line);
+                line += (size_t)std::count(at, stop, '\n');
+                at = stop;
+            }
+            reportParseErrors(layoutFile, errs, nullptr);
+        }
+        result = p.finish();
+        if (!result.fellBack) return result;
+    } else {
+        result.fellBack = true;
+        result.reason = "binary layout";
+    }
+
+    // 退回一般模式：讀完整份再跑，覆寫已經寫了一半的報表
+    ShapeStore store;
+    {
+        StatsScope scope("parse");
+        store = readLayout(layoutFile, rules);
+    }
+    std::vector<Violation> V;
+    {
+        StatsScope scope("drc");
+        V = run_drc(store, rules, die.x1,die.y1,die.x2,die.y2, opt.threads);
+    }
+    writeDRCReport(opt.reportPath, V);
+    writeDRCReportTable(opt.csvPath, V);
+    result.shapes = store.count;
+    result.violations = V.size();
+    result.fails = (size_t)std::count_if(V.begin(), V.end(), [](const Violation& v){ return !v.pass; });
+    result.bandsWhileParsing = 0;
+    result.firstOutputMs = -1;
+    return result;
+}
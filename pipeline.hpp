@@ -0,0 +1,36 @@
+#pragma once
+#include "common.hpp"
+#include <string>
+
+// ---- 管線模式（main --pipeline）----
+// parse 與 check 重疊：die 沿 y 切成 bands 條橫帶（擁有規則同 tile 模式，看 shape 左下角），
+// 主執行緒邊讀 layout 邊把 shape 放進暫存池；讀到的左下角 y 已經超過某條帶需要的範圍
+// （擁有的 shape 上緣、從帶內起跳的 density window 上緣，再加 halo）時，
+// 那條帶就交給 worker 建索引、跑 checkRegion，結果依帶的順序寫進 drc_report.txt / CSV，
+// 後面的帶還在讀。暫存池只留下一條帶還可能用到的 shape，記憶體與同時在處理的幾條帶成正比。
+//
+// 前提是 layout 依 shape 左下角的 y 遞增排列（同一條帶內的順序不拘，只要不落回已經送出的範圍）。
+// 讀到違反前提的 shape（或反向矩形、二進位 layout）時，已寫出的部分作廢，改為讀完整份再跑一般的 run_drc，
+// 報表仍然正確。輸出順序是帶的順序、帶內依 (cat,a,b,sub)；排序後與一般模式相同。
+
+struct PipelineOptions {
+    int bands = 64;                                 // 橫帶數上限（每條帶至少 density window + 2·halo 高）
+    int threads = 1;                                // check 的 worker 數（parse 在呼叫端執行緒）
+    std::string reportPath = "drc_report.txt";
+    std::string csvPath = "drc_fail_table.csv";     // 只列 FAIL
+};
+
+struct PipelineResult {
+    size_t shapes = 0;
+    int bands = 0;
+    int bandsWhileParsing = 0;     // 讀檔還沒結束就送出的帶
+    double firstOutputMs = -1;     // 第一批違規寫出的時間（從開始讀檔算）；沒有違規 = -1
+    size_t violations = 0, fails = 0;
+    bool fellBack = false;         // 輸入沒有依 y 排序，改跑一般模式
+    std::string reason;            // fellBack 的原因
+};
+
+// layout 讀不到、或報表 / CSV 開不起來時丟 std::runtime_error（一開始就檢查，不會跑到一半才發現）。
+// 階層 layout 不支援：讀到第一個 CELL / INST 行時丟 std::runtime_error，已寫出的報表不完整
+PipelineResult runPipelined(const std::string& layoutFile, const RuleSet& rules, const Box& die,
+                            const PipelineOptions& opt = {});
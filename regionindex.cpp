@@ -0,0 +1,296 @@
+#include "regionindex.hpp"
+#include "hier.hpp"
+#include "mmapfile.hpp"
+#include "parser.hpp"
+#include "tile.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+static size_t padTo(size_t n, size_t a){ return (n + a - 1) / a * a; }
+
+std::string regionIndexPath(const std::string& layoutFile){ return layoutFile + ".ridx"; }
+
+// 來源 layout 的大小與修改時間；讀不到回傳 false
+static bool sourceStamp(const std::string& layoutFile, uint64_t& size, int64_t& mtime){
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    size = (uint64_t)fs::file_size(layoutFile, ec);
+    if (ec) return false;
+    auto t = fs::last_write_time(layoutFile, ec);
+    if (ec) return false;
+    mtime = (int64_t)t.time_since_epoch().count();
+    return true;
+}
+
+
+// ---- 建立 ----
+
+void buildRegionIndex(const std::string& layoutFile, const std::string& indexPath, int shapesPerTile){
+    RidxHeader h{};
+    std::memcpy(h.magic, RIDX_MAGIC, sizeof h.magic);
+    h.version = RIDX_VERSION;
+    if (!sourceStamp(layoutFile, h.srcSize, h.srcMtime))
+        throw std::runtime_error("Cannot open layout file: " + layoutFile);
+    // CELL / INST 行在平面 parser 一定是壞行：有壞行才再看是不是階層 layout，是的話只記 flag、不收 shape
+    std::vector<ParseError> errs;
+    ShapeStore store = readLayout(layoutFile, &errs);
+    if (!errs.empty() && isHierarchicalLayout(layoutFile)) {
+        h.flags |= RIDX_HIER;
+        store = ShapeStore{};
+    } else {
+        reportParseErrors(layoutFile, errs, nullptr);
+    }
+    h.numLayers = (uint32_t)store.numLayers();
+    h.count = store.count;
+
+    // 格子範圍 = 所有左下角的外框；格數讓平均每格約 shapesPerTile 個，長寬比跟著外框
+    long long mx = LLONG_MAX, my = LLONG_MAX, Mx = LLONG_MIN, My = LLONG_MIN;
+    for (int id = 0; id < store.numLayers(); ++id){
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k){
+            const long long lx = std::min(L.x1[k], L.x2[k]), ly = std::min(L.y1[k], L.y2[k]);
+            mx = std::min(mx, lx); Mx = std::max(Mx, lx);
+            my = std::min(my, ly); My = std::max(My, ly);
+            h.maxW = std::max<int64_t>(h.maxW, std::abs((long long)L.x2[k] - L.x1[k]));
+            h.maxH = std::max<int64_t>(h.maxH, std::abs((long long)L.y2[k] - L.y1[k]));
+            if (L.x1[k] > L.x2[k] || L.y1[k] > L.y2[k]) h.flags |= RIDX_INVERTED;
+        }
+    }
+    if (store.count == 0) { mx = my = 0; Mx = My = 0; }
+    const long long W = Mx - mx + 1, H = My - my + 1;
+    const double tiles = std::max(1.0, (double)store.count / std::max(1, shapesPerTile));
+    const long long nx0 = std::min<long long>(W, std::max(1LL, std::llround(std::sqrt(tiles * W / H))));
+    const long long ny0 = std::min<long long>(H, std::max(1LL, (long long)std::ceil(tiles / nx0)));
+    h.gx = mx; h.gy = my;
+    h.tw = (W + nx0 - 1) / nx0;
+    h.th = (H + ny0 - 1) / ny0;
+    h.nx = (uint32_t)((W + h.tw - 1) / h.tw);
+    h.ny = (uint32_t)((H + h.th - 1) / h.th);
+    const size_t numTiles = (size_t)h.nx * h.ny;
+
+    auto tileOf = [&](long long lx, long long ly){
+        return (size_t)((ly - h.gy) / h.th) * h.nx + (size_t)((lx - h.gx) / h.tw);
+    };
+
+    // 依格子做 counting sort
+    std::vector<RidxTile> dir(numTiles);
+    for (auto& t : dir) { t.x1 = t.y1 = INT32_MAX; t.x2 = t.y2 = INT32_MIN; }
+    for (int id = 0; id < store.numLayers(); ++id){
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k){
+            RidxTile& t = dir[tileOf(std::min(L.x1[k], L.x2[k]), std::min(L.y1[k], L.y2[k]))];
+            ++t.n;
+            t.x1 = std::min({t.x1, L.x1[k], L.x2[k]}); t.y1 = std::min({t.y1, L.y1[k], L.y2[k]});
+            t.x2 = std::max({t.x2, L.x1[k], L.x2[k]}); t.y2 = std::max({t.y2, L.y1[k], L.y2[k]});
+        }
+    }
+    size_t layerBytes = 0;
+    for (int id = 0; id < store.numLayers(); ++id) layerBytes += 4 + padTo(store.layerName(id).size(), 4);
+    const size_t dirAt = padTo(sizeof h + layerBytes, 8);
+    uint64_t at = dirAt + numTiles * sizeof(RidxTile);
+    std::vector<size_t> fill(numTiles);
+    for (size_t t = 0; t < numTiles; ++t) {
+        dir[t].offset = at;
+        fill[t] = (size_t)((at - (dirAt + numTiles * sizeof(RidxTile))) / sizeof(RidxRecord));
+        at += dir[t].n * sizeof(RidxRecord);
+    }
+    std::vector<RidxRecord> recs(store.count);
+    for (int id = 0; id < store.numLayers(); ++id){
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k)
+            recs[fill[tileOf(std::min(L.x1[k], L.x2[k]), std::min(L.y1[k], L.y2[k]))]++] =
+                RidxRecord{id, L.x1[k], L.y1[k], L.x2[k], L.y2[k], L.idx[k]};
+    }
+
+    // 先寫到同目錄的暫存檔再 rename 過去：寫到一半失敗（或同時有查詢在讀）時不會留下半份、
+    // 表頭卻看起來是新的索引
+    const std::string tmpPath = indexPath + ".tmp" + std::to_string(std::random_device{}());
+    std::ofstream out(tmpPath, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Cannot write " + tmpPath);
+    auto fail = [&](const std::string& msg){
+        out.close();
+        std::error_code ec;
+        std::filesystem::remove(tmpPath, ec);
+        throw std::runtime_error(msg);
+    };
+    out.write((const char*)&h, sizeof h);
+    static const char zeros[8] = {0};
+    for (int id = 0; id < store.numLayers(); ++id){
+        const std::string& name = store.layerName(id);
+        uint32_t nameLen = (uint32_t)name.size();
+        out.write((const char*)&nameLen, 4);
+        out.write(name.data(), nameLen);
+        out.write(zeros, (std::streamsize)(padTo(nameLen, 4) - nameLen));
+    }
+    out.write(zeros, (std::streamsize)(dirAt - sizeof h - layerBytes));
+    out.write((const char*)dir.data(), (std::streamsize)(numTiles * sizeof(RidxTile)));
+    out.write((const char*)recs.data(), (std::streamsize)(recs.size() * sizeof(RidxRecord)));
+    out.close();
+    if (!out) fail("Write failed: " + tmpPath);
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, indexPath, ec);
+    if (ec) fail("Cannot replace " + indexPath + ": " + ec.message());
+}
+
+bool regionIndexFresh(const std::string& layoutFile, const std::string& indexPath){
+    std::ifstream in(indexPath, std::ios::binary);
+    RidxHeader h;
+    if (!in.read((char*)&h, sizeof h)) return false;
+    uint64_t size;
+    int64_t mtime;
+    if (std::memcmp(h.magic, RIDX_MAGIC, sizeof h.magic) != 0 || h.version != RIDX_VERSION ||
+        !sourceStamp(layoutFile, size, mtime) || size != h.srcSize || mtime != h.srcMtime) return false;
+
+    // 表頭對得上但檔案被截斷（寫到一半、磁碟滿）也算過期：檔案大小必須剛好是層名表 + 目錄 + 全部記錄
+    std::error_code ec;
+    const uint64_t fileSize = (uint64_t)std::filesystem::file_size(indexPath, ec);
+    if (ec) return false;
+    uint64_t at = sizeof h;
+    for (uint32_t id = 0; id < h.numLayers; ++id){
+        uint32_t nameLen;
+        if (at + 4 > fileSize || !in.seekg((std::streamoff)at) || !in.read((char*)&nameLen, 4)) return false;
+        at += 4 + padTo(nameLen, 4);
+    }
+    const uint64_t numTiles = (uint64_t)h.nx * h.ny;
+    if (numTiles > fileSize / sizeof(RidxTile) || h.count > fileSize / sizeof(RidxRecord)) return false;
+    return padTo(at, 8) + numTiles * sizeof(RidxTile) + h.count * sizeof(RidxRecord) == fileSize;
+}
+
+
+// ---- 查詢 ----
+
+// 左下角座標落在 [lo, hi] 的格子欄（列）範圍；沒有就回傳 false
+static bool cellRange(long long lo, long long hi, long long g, long long size, uint32_t n,
+                      uint32_t& a, uint32_t& b){
+    if (hi < g || lo > hi) return false;
+    const long long ia = lo <= g ? 0 : (lo - g) / size;
+    if (ia >= (long long)n) return false;
+    const long long ib = hi >= g + (long long)n * size ? (long long)n - 1 : (hi - g) / size;
+    a = (uint32_t)ia; b = (uint32_t)ib;
+    return true;
+}
+
+bool loadRegion(const std::string& indexPath, const RuleSet& rules, const Box& die, const Box& core,
+                ShapeStore& out, std::string& err, RegionLoadStats* stats)
+{
+    MappedFile mf(indexPath);
+    if (!mf.ok()) { err = "cannot open " + indexPath; return false; }
+    const char* data = mf.data();
+    const size_t size = mf.size();
+    RidxHeader h;
+    if (size < sizeof h || std::memcmp(data, RIDX_MAGIC, sizeof RIDX_MAGIC) != 0) { err = "not a region index"; return false; }
+    std::memcpy(&h, data, sizeof h);
+    if (h.version != RIDX_VERSION)  { err = "unsupported version " + std::to_string(h.version); return false; }
+    if (h.flags & ~(RIDX_INVERTED | RIDX_HIER)) { err = "unknown flags " + std::to_string(h.flags); return false; }
+    if (h.flags & RIDX_HIER)        { err = "hierarchical layout (CELL / INST) is not supported in region mode"; return false; }
+    if (h.tw <= 0 || h.th <= 0 || h.nx == 0 || h.ny == 0) { err = "bad tile grid"; return false; }
+
+    // 索引裡是 layout 的原始層名；經 rules 的 layer_mapping 換成正名，別名跟正名併成同一個 ID
+    out = ShapeStore{};
+    out.layers = layerTableFor(rules);
+    LayerTable raw;
+    std::vector<int> idOf(h.numLayers);
+    size_t p = sizeof h;
+    for (uint32_t id = 0; id < h.numLayers; ++id){
+        uint32_t nameLen;
+        if (size - p < 4) { err = "truncated layer table"; return false; }
+        std::memcpy(&nameLen, data + p, 4);
+        p += 4;
+        if (size - p < padTo(nameLen, 4)) { err = "truncated layer table"; return false; }
+        const std::string_view name(data + p, nameLen);
+        if (raw.intern(name) != (int)id) { err = "duplicate layer"; return false; }
+        idOf[id] = out.layers.intern(name);
+        p += padTo(nameLen, 4);
+    }
+    out.byLayer.resize(out.layers.size());
+    const size_t dirAt = padTo(p, 8);
+    const size_t numTiles = (size_t)h.nx * h.ny;
+    if (dirAt > size || (size - dirAt) / sizeof(RidxTile) < numTiles) { err = "truncated tile directory"; return false; }
+
+    std::vector<char> loaded(numTiles, 0);
+    std::vector<RidxRecord> recs;
+    size_t tilesLoaded = 0;
+    auto tile = [&](size_t t){
+        RidxTile e;
+        std::memcpy(&e, data + dirAt + t * sizeof e, sizeof e);
+        return e;
+    };
+    auto take = [&](size_t t, const RidxTile& e){
+        if (loaded[t]) return true;
+        loaded[t] = 1;
+        if (e.offset > size || (size - e.offset) / sizeof(RidxRecord) < e.n) return false;
+        const size_t at = recs.size();
+        recs.resize(at + e.n);
+        std::memcpy(recs.data() + at, data + e.offset, e.n * sizeof(RidxRecord));
+        ++tilesLoaded;
+        return true;
+    };
+    // 左下角落在 [x1,x2]×[y1,y2] 的格子裡，外框碰到 reach（沒給就不看外框）的都讀進來
+    auto takeCells = [&](long long x1, long long y1, long long x2, long long y2, const long long* reach){
+        uint32_t ia, ib, ja, jb;
+        if (!cellRange(x1, x2, h.gx, h.tw, h.nx, ia, ib) || !cellRange(y1, y2, h.gy, h.th, h.ny, ja, jb)) return true;
+        for (uint32_t j = ja; j <= jb; ++j)
+            for (uint32_t i = ia; i <= ib; ++i){
+                const size_t t = (size_t)j * h.nx + i;
+                const RidxTile e = tile(t);
+                if (e.n == 0) continue;
+                if (reach && (e.x2 < reach[0] || e.x1 > reach[2] || e.y2 < reach[1] || e.y1 > reach[3])) continue;
+                if (!take(t, e)) return false;
+            }
+        return true;
+    };
+
+    bool ok = true;
+    if (h.flags & RIDX_INVERTED) {
+        // 反向矩形會讓 checkRegion 整份都看，這裡也整份載入
+        for (size_t t = 0; t < numTiles && ok; ++t) ok = take(t, tile(t));
+    } else {
+        // 1) 可能被 core 擁有的 shape：左下角 clamp 進 die 後落在 core（clamp 到 die 邊的那側往外無限延伸）
+        auto owned = [](long long c1, long long c2, long long d1, long long d2, long long& lo, long long& hi){
+            lo = std::max(c1, d1);
+            hi = std::min(c2, d2) - 1;
+            if (lo > hi) return false;
+            if (lo == d1) lo = LLONG_MIN;
+            if (hi == d2 - 1) hi = LLONG_MAX;
+            return true;
+        };
+        long long ox1, ox2, oy1, oy2;
+        if (owned(core.x1, core.x2, die.x1, die.x2, ox1, ox2) && owned(core.y1, core.y2, die.y1, die.y2, oy1, oy2))
+            ok = takeCells(ox1, oy1, ox2, oy2, nullptr);
+
+        // 2) 與 checkRegion 相同的讀取範圍；格內 shape 最多往右 / 上伸出 maxW / maxH
+        const long long halo = ruleHalo(rules), ext = std::max(rules.density_window, 0);
+        long long R[4] = {core.x1, core.y1, (long long)core.x2 + ext, (long long)core.y2 + ext};
+        for (const auto& r : recs) {
+            if (!ownsShape(die, core, Shape{r.layer, r.x1, r.y1, r.x2, r.y2})) continue;
+            R[0] = std::min<long long>(R[0], r.x1); R[1] = std::min<long long>(R[1], r.y1);
+            R[2] = std::max<long long>(R[2], r.x2); R[3] = std::max<long long>(R[3], r.y2);
+        }
+        R[0] -= halo; R[1] -= halo; R[2] += halo; R[3] += halo;
+        if (ok) ok = takeCells(R[0] - h.maxW, R[1] - h.maxH, R[2], R[3], R);
+    }
+    if (!ok) { err = "tile payload out of range"; return false; }
+
+    for (auto& r : recs) {
+        if (r.layer < 0 || (uint32_t)r.layer >= h.numLayers) { err = "bad layer id in record"; return false; }
+        r.layer = idOf[r.layer];
+    }
+    // 各層依全域 idx 遞增（check 的輸出順序依賴它）
+    std::sort(recs.begin(), recs.end(), [](const RidxRecord& a, const RidxRecord& b){
+        return a.layer != b.layer ? a.layer < b.layer : a.idx < b.idx;
+    });
+    for (const auto& r : recs) out.add(r.layer, r.x1, r.y1, r.x2, r.y2, r.idx);
+    if (stats) {
+        stats->tiles = numTiles;
+        stats->tilesLoaded = tilesLoaded;
+        stats->shapes = (size_t)h.count;
+        stats->shapesLoaded = recs.size();
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "common.hpp"
+#include <cstdint>
+#include <string>
+
+// ---- 區域查詢用的磁碟空間索引（<layout>.ridx）----
+// 所有 shape 依左下角放進 nx×ny 的格子（格子範圍 = 所有左下角的外框），同一格的 shape 連續存放，
+// 目錄記下每格的位置與格內 shape 的外框。查詢時整檔 mmap，只讀碰得到的那幾格，I/O 與區域大小成正比。
+// 所有整數皆為 little-endian，檔案配置：
+//
+//   RidxHeader                             104 bytes
+//   重複 numLayers 次：
+//     uint32 nameLen, char name[nameLen]   補 0 到 4 的倍數
+//   補 0 到 8 的倍數
+//   RidxTile[nx*ny]                        第 (i,j) 格在 j*nx + i
+//   RidxRecord[count]                      依格子順序，格內依 layout 的行序
+//
+// 表頭記下來源 layout 的大小與修改時間，對不上就視為過期、重建。
+// layout 是不是階層式在建索引時記進 flags，查詢時不必再掃一次 layout。
+static constexpr char     RIDX_MAGIC[8]   = {'M','D','R','C','R','I','D','X'};
+static constexpr uint32_t RIDX_VERSION    = 2;
+static constexpr uint32_t RIDX_INVERTED   = 1u << 0;   // layout 有反向矩形：查詢一律整份載入
+static constexpr uint32_t RIDX_HIER       = 1u << 1;   // 階層 layout（有 CELL / INST 行）：不收 shape，查詢直接失敗
+
+struct RidxHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t numLayers;
+    uint32_t nx, ny;
+    uint32_t reserved;
+    int64_t  gx, gy;           // 格子原點（左下角的最小值）
+    int64_t  tw, th;           // 每格寬、高
+    int64_t  maxW, maxH;       // 最大的 shape 寬、高：格內 shape 往右 / 上最多伸出這麼多
+    uint64_t count;            // 全部 shape 數
+    uint64_t srcSize;
+    int64_t  srcMtime;
+};
+static_assert(sizeof(RidxHeader) == 104, "RidxHeader layout");
+
+struct RidxTile {
+    uint64_t offset;           // 第一筆 RidxRecord 在檔案中的位置
+    uint64_t n;
+    int32_t  x1, y1, x2, y2;   // 格內 shape 的外框；空格 x1 > x2
+};
+static_assert(sizeof(RidxTile) == 32, "RidxTile layout");
+
+struct RidxRecord { int32_t layer, x1, y1, x2, y2, idx; };
+static_assert(sizeof(RidxRecord) == 24, "RidxRecord layout");
+
+std::string regionIndexPath(const std::string& layoutFile);   // <layout>.ridx
+
+// 讀整份 layout（文字或 .bin）寫出索引；shapesPerTile 是平均每格的 shape 數。失敗丟 std::runtime_error
+void buildRegionIndex(const std::string& layoutFile, const std::string& indexPath, int shapesPerTile = 1024);
+
+// 索引存在、格式正確、檔案大小與表頭記的內容相符（沒有被截斷），且與 layout 目前的大小與修改時間相符
+bool regionIndexFresh(const std::string& layoutFile, const std::string& indexPath);
+
+struct RegionLoadStats {
+    size_t tiles = 0, tilesLoaded = 0;
+    size_t shapes = 0, shapesLoaded = 0;
+};
+
+// 載入 core 擁有的違規需要的 shape（歸屬規則同 tile 模式）：先讀可能有 core 擁有的 shape 的格子，
+// 算出與 checkRegion 相同的讀取範圍，再補上外框碰到該範圍的格子。
+// 各層依全域 idx 遞增；格式錯誤或索引來自階層 layout 時回傳 false 並填 err
+bool loadRegion(const std::string& indexPath, const RuleSet& rules, const Box& die, const Box& core,
+                ShapeStore& out, std::string& err, RegionLoadStats* stats = nullptr);
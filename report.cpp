@@ -1,265 +1,271 @@
 #include "common.hpp"
 #include "drc.hpp"
 #include "report.hpp"
+#include "connectivity.hpp"
+#include "lvs.hpp"
+#include <charconv>
 #include <fstream>
 #include <iostream>
-#include <climits>
-#include <algorithm>
-#include <unordered_map>
 #include <vector>
 #include <string>
 
 
-#ifndef DRC_VIOLATION_DEFINED
-#define DRC_VIOLATION_DEFINED
-struct Violation {
-    std::string type;   
-    std::string layer;  
-    std::string object; 
-    std::string bbox;   
-    std::string rule;   
-    double actual = 0.0; 
-    double delta  = 0.0; 
-    std::string status;  
-};
-#endif
+// ---- BufferedWriter ----
+
+BufferedWriter::BufferedWriter(const std::string& path, size_t bufSize)
+    : fp(std::fopen(path.c_str(), "w")), buf(bufSize), failed(fp == nullptr) {}
 
+BufferedWriter::~BufferedWriter(){ close(); }
 
-#ifndef DRC_BBOXSTR_HELPER
-#define DRC_BBOXSTR_HELPER
-static inline std::string bboxStr(const Shape& s){
-    return "(" + std::to_string(s.x1) + "," + std::to_string(s.y1) + ")-(" +
-           std::to_string(s.x2) + "," + std::to_string(s.y2) + ")";
+bool BufferedWriter::close(){
+    if (fp) {
+        flush();
+        failed |= std::fclose(fp) != 0;
+        fp = nullptr;
+    }
+    return !failed;
 }
-#endif
 
+void BufferedWriter::flush(){
+    if (fp && n) failed |= std::fwrite(buf.data(), 1, n, fp) != n;
+    n = 0;
+}
 
-void writeDRCReport(const std::string& path,
-                    const std::vector<Shape>& shapes,
-                    const RuleSet& rules,
-                    int die_x1,int die_y1,int die_x2,int die_y2)
-{
-    std::ofstream out(path);
-    if(!out.is_open()){ std::cerr<<"ERROR: cannot write "<<path<<"\n"; return; }
-    std::streambuf* bak = std::cout.rdbuf();
-    std::cout.rdbuf(out.rdbuf());
+void BufferedWriter::put(std::string_view s){
+    if (s.size() > buf.size() - n){
+        flush();
+        if (s.size() > buf.size()) { if (fp) failed |= std::fwrite(s.data(), 1, s.size(), fp) != s.size(); return; }
+    }
+    std::copy(s.begin(), s.end(), buf.begin() + n);
+    n += s.size();
+}
 
-    check_min_width(shapes, rules);
-    check_min_spacing(shapes, rules);
-    check_via_enclosure_multi(shapes, rules);
-    check_density(shapes, rules, die_x1,die_y1,die_x2,die_y2);
+void BufferedWriter::putInt(long long v){
+    char tmp[24];
+    auto res = std::to_chars(tmp, tmp + sizeof tmp, v);
+    put(std::string_view(tmp, res.ptr - tmp));
+}
 
-    std::cout.rdbuf(bak);
+void BufferedWriter::putDouble(double v){
+    char tmp[32];
+    auto res = std::to_chars(tmp, tmp + sizeof tmp, v, std::chars_format::general, 6);
+    put(std::string_view(tmp, res.ptr - tmp));
 }
- 
 
 
-void writeDRCReportTable(const std::string& path,
-                         const std::vector<Shape>& shapes,
-                         const RuleSet& rules,
-                         int die_x1,int die_y1,int die_x2,int die_y2)
-{std::cerr << "[DEBUG] reached writeDRCReportTable in report.cpp\n";
-    std::ofstream out(path);
-    if(!out.is_open()){ std::cerr<<"ERROR: cannot write "<<path<<"\n"; return; }
-
-    auto csvEscape = [](const std::string& s)->std::string {
-        bool need = false;
-        for(char c : s)
-            if(c==',' || c=='"' || c=='\n' || c=='\r'){ need = true; break; }
-        if(!need) return s;
-        std::string t; t.reserve(s.size()+2);
-        t.push_back('"');
-        for(char c : s){ t.push_back(c); if(c=='"') t.push_back('"'); }
-        t.push_back('"');
-        return t;
-    };
-
- 
-    const double EPS = 1e-9;
-
-    std::vector<Violation> V;
-
-
-    for(size_t i=0;i<shapes.size();++i){
-        const auto& s = shapes[i];
-        int w = std::min(std::abs(s.x2 - s.x1), std::abs(s.y2 - s.y1));
-        int L = std::max(std::abs(s.x2 - s.x1), std::abs(s.y2 - s.y1));
-
-        if(s.layer=="M1"){
-            if(w + EPS < rules.min_width_M1)
-                V.push_back({"WIDTH","M1","idx="+std::to_string(i),bboxStr(s),
-                    ">= "+std::to_string(rules.min_width_M1),
-                    static_cast<double>(w),
-                    static_cast<double>(rules.min_width_M1 - w),
-                    "FAIL"});
-            if(L > rules.max_width_M1 + EPS)
-                V.push_back({"WIDTH","M1","idx="+std::to_string(i),bboxStr(s),
-                    "<= "+std::to_string(rules.max_width_M1),
-                    static_cast<double>(L),
-                    static_cast<double>(L - rules.max_width_M1),
-                    "FAIL"});
-        } else if(s.layer=="M2"){
-            if(w + EPS < rules.min_width_M2)
-                V.push_back({"WIDTH","M2","idx="+std::to_string(i),bboxStr(s),
-                    ">= "+std::to_string(rules.min_width_M2),
-                    static_cast<double>(w),
-                    static_cast<double>(rules.min_width_M2 - w),
-                    "FAIL"});
-            if(L > rules.max_width_M2 + EPS)
-                V.push_back({"WIDTH","M2","idx="+std::to_string(i),bboxStr(s),
-                    "<= "+std::to_string(rules.max_width_M2),
-                    static_cast<double>(L),
-                    static_cast<double>(L - rules.max_width_M2),
-                    "FAIL"});
-        }
-    }
+// ---- 單筆違規的各欄位 ----
+// W 是 BufferedWriter 或包著 ostream 的 OstreamOut；欄位直接寫出去，只有要 CSV 跳脫的欄位先組進暫存字串
 
+namespace {
 
+struct OstreamOut {
+    std::ostream& os;
+    void put(char c)             { os.put(c); }
+    void put(std::string_view s) { os.write(s.data(), (std::streamsize)s.size()); }
+    void putInt(long long v)     { os << v; }
+    void putDouble(double v)     { os << v; }
+};
 
-    auto spacing = [](const Shape& a,const Shape& b)->double{
-        
-        if(!(a.x2 < b.x1 || b.x2 < a.x1 || a.y2 < b.y1 || b.y2 < a.y1)) return 0.0;
-        int dx=0,dy=0;
-        if(a.x2<b.x1) dx=b.x1-a.x2; else if(b.x2<a.x1) dx=a.x1-b.x2;
-        if(a.y2<b.y1) dy=b.y1-a.y2; else if(b.y2<a.y1) dy=a.y1-b.y2;
-        return static_cast<double>(std::max(dx,dy));
-    };
-
-    for(size_t i=0;i<shapes.size();++i){
-        for(size_t j=i+1;j<shapes.size();++j){
-            if(shapes[i].layer != shapes[j].layer) continue;
-            double d = spacing(shapes[i], shapes[j]);
-            if(shapes[i].layer=="M1" && d + EPS < rules.min_spacing_M1)
-                V.push_back({"SPACING","M1","("+std::to_string(i)+","+std::to_string(j)+")","-",
-                    ">= "+std::to_string(rules.min_spacing_M1),
-                    d,
-                    static_cast<double>(rules.min_spacing_M1) - d,
-                    "FAIL"});
-            if(shapes[i].layer=="M2" && d + EPS < rules.min_spacing_M2)
-                V.push_back({"SPACING","M2","("+std::to_string(i)+","+std::to_string(j)+")","-",
-                    ">= "+std::to_string(rules.min_spacing_M2),
-                    d,
-                    static_cast<double>(rules.min_spacing_M2) - d,
-                    "FAIL"});
-        }
+void appendInt(std::string& s, long long v){
+    char t[24];
+    auto e = std::to_chars(t, t + sizeof t, v);
+    s.append(t, e.ptr);
+}
+
+void appendObject(std::string& s, const Violation& v){
+    switch (v.cat){
+    case 0:  s += "idx="; appendInt(s, v.a); break;
+    case 1:  s += '('; appendInt(s, v.a); s += ','; appendInt(s, v.b); s += ')'; break;
+    case 2:  if (v.object) s += *v.object; break;
+    default: s += '['; appendInt(s, v.x1); s += ','; appendInt(s, v.y1); s += ']'; break;
     }
+}
 
+void appendBBox(std::string& s, const Violation& v, char open = '(', char close = ')'){
+    if (v.cat == 1) { s += '-'; return; }
+    s += open; appendInt(s, v.x1); s += ','; appendInt(s, v.y1); s += close; s += '-';
+    s += open; appendInt(s, v.x2); s += ','; appendInt(s, v.y2); s += close;
+}
 
-    auto enclosureMarginLocal = [](const Shape& metal, const Shape& via)->int{
-        int left   = via.x1 - metal.x1;
-        int right  = metal.x2 - via.x2;
-        int bottom = via.y1 - metal.y1;
-        int top    = metal.y2 - via.y2;
-        return std::min(std::min(left, right), std::min(bottom, top));
-    };
-    auto fullyCoversLocal = [](const Shape& m,const Shape& v)->bool{
-        return m.x1<=v.x1 && m.y1<=v.y1 && m.x2>=v.x2 && m.y2>=v.y2;
-    };
-    auto overlap = [](const Shape& a,const Shape& b)->bool{
-        return !(a.x2 < b.x1 || b.x2 < a.x1 || a.y2 < b.y1 || b.y2 < a.y1);
-    };
-
-    std::unordered_map<std::string, std::vector<const Shape*>> bucket;
-    for(const auto& s: shapes) bucket[s.layer].push_back(&s);
-
-    auto best_encl = [&](const Shape& v, const std::string& lay)->int{
-        int best = INT_MIN;
-        auto it = bucket.find(lay);
-        if(it == bucket.end()) return best;
-
-        for(auto p : it->second)
-            if(fullyCoversLocal(*p, v))
-                best = std::max(best, enclosureMarginLocal(*p, v));
-
-        if(best == INT_MIN){
-            for(auto p : it->second)
-                if(overlap(*p, v))
-                    best = std::max(best, enclosureMarginLocal(*p, v));
-        }
-        return best;
-    };
-
-    for(const auto& kv: rules.via_encl_map){
-        const std::string& viaL = kv.first;
-        const auto& cfg = kv.second;
-
-        auto vit = bucket.find(viaL);
-        if(vit == bucket.end()) continue;
-
-        for(const Shape* vp : vit->second){
-            const Shape& v = *vp;
-            int best_under = best_encl(v, cfg.under);
-            int best_over  = best_encl(v, cfg.over);
-
-            auto pushEnc=[&](const char* pos, const std::string& lay, int best){
-                if(best==INT_MIN){
-                    V.push_back({"ENCLOSURE",std::string(pos)+" "+lay,viaL,bboxStr(v),
-                        ">= "+std::to_string(cfg.min_enclose),
-                        0.0,
-                        static_cast<double>(cfg.min_enclose),
-                        "FAIL"});
-                } else if(best + EPS < cfg.min_enclose){
-                    V.push_back({"ENCLOSURE",std::string(pos)+" "+lay,viaL,bboxStr(v),
-                        ">= "+std::to_string(cfg.min_enclose),
-                        static_cast<double>(best),
-                        static_cast<double>(cfg.min_enclose - best),
-                        "FAIL"});
-                }
-            };
-            pushEnc("UNDER",cfg.under,best_under);
-            pushEnc("OVER", cfg.over ,best_over );
-        }
+void appendRule(std::string& s, const Violation& v){
+    if (v.cat == 3) { s += ">= "; s += std::to_string(v.threshold); return; }
+    s += (v.cat == 0 && v.sub == 1) ? "<= " : ">= ";
+    appendInt(s, (long long)v.threshold);
+}
+
+const std::string& layerOf(const Violation& v){
+    static const std::string none;
+    return v.layer ? *v.layer : none;
+}
+
+template<class W>
+void putCsv(W& w, std::string_view s){
+    if (s.find_first_of(",\"\n\r") == std::string_view::npos) { w.put(s); return; }
+    w.put('"');
+    for (char c : s){ w.put(c); if (c == '"') w.put('"'); }
+    w.put('"');
+}
+
+// console 格式（[WIDTH][M1] idx=0 short=20 < 30 ...）
+template<class W>
+void reportLine(W& w, const Violation& v){
+    thread_local std::string tmp;
+    tmp.clear();
+    const std::string& layer = layerOf(v);
+    switch (v.cat){
+    case 0: {
+        const bool isMin = v.sub == 0;
+        w.put("[WIDTH]["); w.put(layer); w.put("] idx="); w.putInt(v.a);
+        w.put(isMin ? " short=" : " width="); w.putDouble(v.actual);
+        w.put(isMin ? " < " : " > ");         w.putDouble(v.threshold); w.put('\n');
+        break;
     }
+    case 1:
+        w.put("[SPACING]["); w.put(layer); w.put("] ("); w.putInt(v.a); w.put(',');
+        w.putInt(v.b); w.put(") d="); w.putDouble(v.actual); w.put(" < "); w.putDouble(v.threshold);
+        w.put('\n');
+        break;
+    case 2: {
+        // layer = "UNDER M1" / "OVER M2"，位置欄補到 5 格對齊
+        std::string_view lv(layer);
+        size_t sp = std::min(lv.find(' '), lv.size());
+        std::string_view pos = lv.substr(0, sp), lay = lv.substr(std::min(sp + 1, lv.size()));
+        w.put("[ENCLOSURE]["); w.put(pos);
+        for (size_t i = pos.size(); i < 5; ++i) w.put(' ');
+        w.put(' '); w.put(lay); w.put("] ");
+        appendObject(tmp, v); tmp += " bbox="; appendBBox(tmp, v);
+        w.put(tmp);
+        if (v.missing)         { w.put(" missing metal coverage (need +"); w.putDouble(v.threshold); w.put("nm)\n"); }
+        else if (v.delta > 0)  { w.put(" need +"); w.putDouble(v.delta); w.put("nm\n"); }    // 不足
+        else if (v.delta < 0)  { w.put(" over by "); w.putDouble(-v.delta); w.put("nm\n"); } // 過包
+        else                     w.put(" OK (exact)\n");
+        break;
+    }
+    default:
+        appendBBox(tmp, v, '[', ']');
+        w.put("[DENSITY] "); w.put(tmp); w.put(" density="); w.putDouble(v.actual);
+        w.put(" < "); w.putDouble(v.threshold); w.put('\n');
+        break;
+    }
+}
 
+template<class W>
+void csvHeader(W& w){ w.put("type,layer,object,bbox,rule,actual,delta,status\n"); }
+
+template<class W>
+void csvLine(W& w, const Violation& v){
+    thread_local std::string tmp;
+    putCsv(w, violationType(v));  w.put(',');
+    putCsv(w, layerOf(v));        w.put(',');
+    tmp.clear(); appendObject(tmp, v); putCsv(w, tmp); w.put(',');
+    tmp.clear(); appendBBox(tmp, v);   putCsv(w, tmp); w.put(',');
+    tmp.clear(); appendRule(tmp, v);   putCsv(w, tmp); w.put(',');
+    w.putDouble(v.actual);        w.put(',');
+    w.putDouble(v.delta);         w.put(',');
+    putCsv(w, violationStatus(v)); w.put('\n');
+}
 
-    auto interAreaLocal = [](int ax1,int ay1,int ax2,int ay2,
-                             int bx1,int by1,int bx2,int by2)->int{
-        int x1 = std::max(ax1,bx1), y1 = std::max(ay1,by1);
-        int x2 = std::min(ax2,bx2), y2 = std::min(ay2,by2);
-        if(x2<=x1 || y2<=y1) return 0;
-        return (x2-x1)*(y2-y1);
-    };
-
-    const int W = rules.density_window;
-    for(int y=die_y1;y<die_y2;y+=W){
-        for(int x=die_x1;x<die_x2;x+=W){
-            int win_x2 = std::min(x+W, die_x2);
-            int win_y2 = std::min(y+W, die_y2);
-            int win_area = (win_x2 - x) * (win_y2 - y);
-            long long metal_area = 0;
-
-            for(const auto& s : shapes)
-                if(rules.density_layers.count(s.layer))
-                    metal_area += interAreaLocal(x, y, win_x2, win_y2,
-                                                 s.x1, s.y1, s.x2, s.y2);
-
-            double dens = win_area ? (double)metal_area / win_area : 0.0;
-            if(dens + EPS < rules.min_density){
-                V.push_back({
-                    "DENSITY", "window",
-                    "[" + std::to_string(x) + "," + std::to_string(y) + "]",
-                    "(" + std::to_string(x) + "," + std::to_string(y) + ")-(" +
-                        std::to_string(win_x2) + "," + std::to_string(win_y2) + ")",
-                    ">= " + std::to_string(rules.min_density),
-                    dens,
-                    static_cast<double>(rules.min_density - dens),
-                    "FAIL"
-                });
-            }
-        }
+template<class W>
+void mdHeader(W& w){
+    w.put("| type | layer | object | bbox | rule | actual | delta | status |\n");
+    w.put("|------|--------|---------|-------|-------|--------:|--------:|--------|\n");
+}
+
+template<class W>
+void mdLine(W& w, const Violation& v){
+    thread_local std::string tmp;
+    tmp.clear();
+    tmp += "| "; tmp += violationType(v); tmp += " | "; tmp += layerOf(v);
+    tmp += " | "; appendObject(tmp, v); tmp += " | "; appendBBox(tmp, v);
+    tmp += " | "; appendRule(tmp, v);   tmp += " | ";
+    w.put(tmp); w.putDouble(v.actual); w.put(" | "); w.putDouble(v.delta);
+    w.put(" | "); w.put(violationStatus(v)); w.put(" |\n");
+}
+
+} // namespace
+
+void writeReportLine(BufferedWriter& w, const Violation& v){ reportLine(w, v); }
+void writeCsvLine(BufferedWriter& w, const Violation& v)   { csvLine(w, v); }
+void writeMdLine(BufferedWriter& w, const Violation& v)    { mdLine(w, v); }
+void writeCsvHeader(BufferedWriter& w)                     { csvHeader(w); }
+void writeMdHeader(BufferedWriter& w)                      { mdHeader(w); }
+
+
+void printViolations(std::ostream& os, const std::vector<Violation>& V){
+    OstreamOut w{os};
+    for (const auto& v : V) reportLine(w, v);
+}
+
+
+bool writeDRCReport(const std::string& path, const std::vector<Violation>& V)
+{
+    BufferedWriter out(path);
+    if(!out.ok()){ std::cerr<<"ERROR: cannot write "<<path<<"\n"; return false; }
+    for (const auto& v : V) reportLine(out, v);
+    if(!out.close()){ std::cerr<<"ERROR: write failed: "<<path<<"\n"; return false; }
+    return true;
+}
+
+
+bool writeDRCReportTable(const std::string& path, const std::vector<Violation>& V)
+{
+    BufferedWriter out(path);
+    if(!out.ok()){ std::cerr<<"ERROR: cannot write "<<path<<"\n"; return false; }
+    csvHeader(out);
+    for (const auto& v : V)
+        if (!v.pass) csvLine(out, v);
+    if(!out.close()){ std::cerr<<"ERROR: write failed: "<<path<<"\n"; return false; }
+    return true;
+}
+
+
+void ReportWriter::print(std::ostream& os, const std::vector<ReportRow>& rows,
+                         const std::string& fmt, bool failOnly)
+{
+    OstreamOut w{os};
+    if (fmt == "csv") csvHeader(w); else mdHeader(w);
+    for (const auto& r : rows) {
+        if (failOnly && r.pass) continue;
+        if (fmt == "csv") csvLine(w, r); else mdLine(w, r);
     }
+}
 
 
-    out << "type,layer,object,bbox,rule,actual,delta,status\n";
-    for (const auto& v : V) { 
-        out << csvEscape(v.type)   << ','
-            << csvEscape(v.layer)  << ','
-            << csvEscape(v.object) << ','
-            << csvEscape(v.bbox)   << ','
-            << csvEscape(v.rule)   << ','
-            << v.actual            << ','
-            << v.delta             << ','
-            << csvEscape(v.status) << '\n';
+void writeNetReport(const std::string& path, const Netlist& nets, const std::vector<Label>& labels){
+    std::ofstream out(path);
+    if(!out.is_open()){ std::cerr << "Cannot write " << path << "\n"; return; }
+    out << "nets=" << nets.numNets << " labels=" << labels.size() << "\n";
+    for(size_t i = 0; i < labels.size(); ++i){
+        const Label& lb = labels[i];
+        out << lb.name << " " << lb.layer << " (" << lb.x << "," << lb.y << ") ";
+        int n = nets.labelNet[i];
+        if(n < 0) out << "FLOATING\n";
+        else      out << "net=" << n << " shapes=" << nets.netSize[n] << "\n";
+    }
+}
+
+void writeLvsReport(std::ostream& os, const LvsReport& R){
+    os << "LVS: schematic nets=" << R.schematicNets << " layout nets=" << R.layoutNets
+       << " matched=" << R.matched << (R.clean() ? " CLEAN" : " MISMATCH") << "\n";
+    for(const auto& o : R.opens){
+        os << "[OPEN] " << o.net << ":";
+        for(const auto& piece : o.pieces){
+            os << " {";
+            for(size_t i = 0; i < piece.size(); ++i) os << (i ? "," : "") << piece[i];
+            os << "}";
+        }
+        os << "\n";
+    }
+    for(const auto& s : R.shorts){
+        os << "[SHORT] layout net " << s.layoutNet << " joins";
+        for(const auto& n : s.nets) os << " " << n;
+        os << "\n";
+    }
+    for(const auto& p : R.missingPins) os << "[MISSING] " << p << "\n";
+    for(const auto& l : R.extraLabels) os << "[EXTRA] " << l << "\n";
+    for(const auto& d : R.duplicatePins){
+        os << "[SCHEMATIC] pin " << d.pin << " listed under";
+        for(const auto& n : d.nets) os << " " << n;
+        os << "\n";
     }
-    out.flush();
 }
@@ -1,36 +1,60 @@
 #pragma once
+#include <cstdio>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 #include <iomanip>
-#include "common.hpp"   
+#include "common.hpp"
+#include "drc.hpp"
 
 
-static constexpr double EPS = 1e-9;
+using ReportRow = Violation;
 
-struct ReportRow {
-    std::string type;     // WIDTH / SPACING / ENCLOSURE / DENSITY
-    std::string layer;    
-    std::string object;   
-    std::string bbox;     
-    std::string rule;     
-    double actual = 0.0;  
-    double threshold = 0.0;
-    double margin = 0.0;  
-    std::string status;   
+// 大緩衝的檔案輸出，數字自己轉字串，不經過 iostream（報表與串流輸出共用）
+class BufferedWriter {
+public:
+    explicit BufferedWriter(const std::string& path, size_t bufSize = 1 << 20);
+    ~BufferedWriter();
+    bool ok() const { return fp != nullptr; }
+    bool close();                 // 寫完剩下的並關檔；開檔或任何一次寫入失敗回傳 false
+
+    void put(char c)             { if (n == buf.size()) flush(); buf[n++] = c; }
+    void put(std::string_view s);
+    void putInt(long long v);
+    void putDouble(double v);     // 與 ostream 預設格式相同（%g，6 位有效數字）
+    void flush();
+
+private:
+    std::FILE* fp = nullptr;
+    std::vector<char> buf;
+    size_t n = 0;
+    bool failed = false;
 };
 
-// 文字報告（把 check_* 的輸出導到檔案）
-void writeDRCReport(const std::string& path,
-                    const std::vector<Shape>& shapes,
-                    const RuleSet& rules,
-                    int die_x1,int die_y1,int die_x2,int die_y2);
+// 單筆違規的一行：console / drc_report.txt 格式、CSV、markdown 表格（欄位都在這時才組出來）
+void writeReportLine(BufferedWriter& w, const Violation& v);
+void writeCsvLine(BufferedWriter& w, const Violation& v);
+void writeMdLine(BufferedWriter& w, const Violation& v);
+void writeCsvHeader(BufferedWriter& w);
+void writeMdHeader(BufferedWriter& w);
+
+// console 格式（[WIDTH][M1] idx=0 short=20 < 30 ...），stdout 與 drc_report.txt 共用
+void printViolations(std::ostream& os, const std::vector<Violation>& V);
 
-// CSV 報表
-void writeDRCReportTable(const std::string& path,
-                         const std::vector<Shape>& shapes,
-                         const RuleSet& rules,
-                         int die_x1,int die_y1,int die_x2,int die_y2);
+// 文字報告；開檔或寫入失敗時在 stderr 印一行並回傳 false
+bool writeDRCReport(const std::string& path, const std::vector<Violation>& V);
+
+// CSV 報表（只列 FAIL）；失敗同上
+bool writeDRCReportTable(const std::string& path, const std::vector<Violation>& V);
+
+// net 報表：每個 label 一行（所在 net、net 的 shape 數），沒落在導電 shape 上的標 FLOATING
+struct Netlist;
+void writeNetReport(const std::string& path, const Netlist& nets, const std::vector<Label>& labels);
+
+// LVS-lite 報表
+struct LvsReport;
+void writeLvsReport(std::ostream& os, const LvsReport& R);
 
 class ReportWriter {
 public:
@@ -38,25 +62,11 @@ public:
 
     static bool pass_ge(double actual, double thr) { return (actual + EPS) >= thr; }
 
-    void print(std::ostream& os, const std::string& fmt="md") const {
-        if (fmt == "csv") {
-            os << "type,layer,object,bbox,rule,actual,margin,status\n";
-            for (const auto& r : rows) {
-                os << r.type << "," << r.layer << "," << r.object << ","
-                   << r.bbox << "," << r.rule << ","
-                   << r.actual << "," << r.margin << ","
-                   << r.status << "\n";
-            }
-        } else {
-            os << "| type | layer | object | bbox | rule | actual | margin | status |\n";
-            os << "|------|--------|---------|-------|-------|--------:|--------:|--------|\n";
-            for (const auto& r : rows) {
-                os << "| " << r.type << " | " << r.layer << " | " << r.object
-                   << " | " << r.bbox << " | " << r.rule << " | "
-                   << r.actual << " | " << r.margin << " | " << r.status << " |\n";
-            }
-        }
-    }
+    void print(std::ostream& os, const std::string& fmt="md") const { print(os, rows, fmt); }
+
+    // fmt = "csv" / "md"；直接序列化外部傳入的清單，不複製
+    static void print(std::ostream& os, const std::vector<ReportRow>& rows,
+                      const std::string& fmt="md", bool failOnly=false);
 
 private:
     std::vector<ReportRow> rows;
@@ -0,0 +1,385 @@
+#include "server.hpp"
+#include "incremental.hpp"
+#include "parser.hpp"
+#include "tile.hpp"
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#ifdef _WIN32
+
+int runServer(const ServerOptions&){
+    std::cerr << "--serve 需要 Unix socket，這個平台不支援\n";
+    return 2;
+}
+
+#else
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct Session {                 // 一份常駐的 layout
+    std::shared_mutex mu;
+    IncrementalState live;       // layout 與它的索引、上一次整片 check 的結果（rulesKey = 規則名稱 + 載入序號）
+};
+
+struct LoadedRules {
+    RuleSet rules;
+    std::string key;
+};
+
+class Server {
+public:
+    explicit Server(const ServerOptions& opt) : opt(opt) {}
+    int run();
+
+private:
+    const ServerOptions& opt;
+    std::mutex mu;               // 保護下面兩張表（不含 Session 內容）
+    std::map<std::string, std::shared_ptr<Session>> layouts;
+    std::map<std::string, std::shared_ptr<const LoadedRules>> rulesets;
+    unsigned generation = 0;
+    std::atomic<bool> stopping{false};
+    std::mutex clientsMu;        // 目前開著的連線；結束時由連線自己移除並 close
+    std::condition_variable clientsDone;
+    std::vector<int> clients;
+
+    void serveClient(int fd);
+    // 處理一個 request；send 寫一行回應，回傳 false 代表連線已斷
+    // sendLines 直接寫已經排好的多行（違規串流用）
+    void handle(const json& req, const std::function<bool(const json&)>& send,
+                const std::function<bool(const std::string&)>& sendLines);
+
+    void loadRules(const std::string& name, const std::string& path);
+    std::shared_ptr<Session> session(const std::string& name);
+    std::shared_ptr<const LoadedRules> ruleset(const std::string& name);
+};
+
+bool sendAll(int fd, const std::string& s){
+    size_t off = 0;
+    while (off < s.size()){
+        ssize_t n = ::send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += (size_t)n;
+    }
+    return true;
+}
+
+unsigned parseChecks(const json& req){
+    if (!req.contains("checks")) return CHECK_ALL;
+    unsigned m = 0;
+    for (const auto& c : req.at("checks")){
+        const std::string s = c.get<std::string>();
+        if      (s == "width")     m |= CHECK_WIDTH;
+        else if (s == "spacing")   m |= CHECK_SPACING;
+        else if (s == "enclosure") m |= CHECK_ENCLOSURE;
+        else if (s == "density")   m |= CHECK_DENSITY;
+        else throw std::runtime_error("unknown check: " + s);
+    }
+    return m;
+}
+
+Box parseBoxJson(const json& j){
+    if (!j.is_array() || j.size() != 4) throw std::runtime_error("box must be [x1,y1,x2,y2]");
+    return {j.at(0).get<int>(), j.at(1).get<int>(), j.at(2).get<int>(), j.at(3).get<int>()};
+}
+
+// remove / add 直接改常駐的 layout 與索引，結果與直接改 layout 檔（刪行、加在檔尾）後重讀相同；
+// 成本只跟這次加刪的 shape 數有關。整個 request 先驗證完才動手，有錯時 layout 不變
+void applyDelta(IncrementalState& st, const json& req, size_t& added, size_t& removed){
+    std::vector<long long> drop;
+    for (const auto& r : req.value("remove", json::array())){
+        long long i = r.get<long long>();
+        if (i < 0 || (size_t)i >= st.layout.count()) throw std::runtime_error("remove: no shape " + std::to_string(i));
+        drop.push_back(i);
+    }
+    std::sort(drop.begin(), drop.end());
+    drop.erase(std::unique(drop.begin(), drop.end()), drop.end());
+
+    struct Add { std::string layer; int x1, y1, x2, y2; };
+    std::vector<Add> adds;
+    for (const auto& a : req.value("add", json::array())){
+        std::istringstream ss(a.get<std::string>());
+        Add s;
+        if (!(ss >> s.layer >> s.x1 >> s.y1 >> s.x2 >> s.y2))
+            throw std::runtime_error("add: expected \"LAYER x1 y1 x2 y2\", got \"" + a.get<std::string>() + "\"");
+        adds.push_back(std::move(s));
+    }
+
+    removeShapes(st, drop);
+    for (const auto& s : adds) appendShape(st, s.layer, s.x1, s.y1, s.x2, s.y2);
+    removed += drop.size();
+    added += adds.size();
+}
+
+// region check 要的 shape 從常駐索引取，不掃整份 layout：先找出 region 擁有的 shape，
+// 再取與「擁有的 shape 與 core（外擴 density window）的外框，外擴 rule halo」相交的，
+// 與 checkRegion 自己篩的範圍相同。回傳的 store 的 idx 是 slot（先後與 idx 相同）
+ShapeStore regionShapes(const LiveLayout& lay, const RuleSet& rules, const Box& die, const Box& core,
+                        unsigned checks){
+    const int n = (int)lay.layers().size();
+    // 左下角 clamp 進 die 後落在 core：core 貼著 die 邊的那一側，die 外的 shape 也算
+    const int ox1 = core.x1 <= die.x1 ? INT_MIN : core.x1, oy1 = core.y1 <= die.y1 ? INT_MIN : core.y1;
+    const int ox2 = core.x2 >= die.x2 ? INT_MAX : core.x2, oy2 = core.y2 >= die.y2 ? INT_MAX : core.y2;
+    std::vector<int> cand, pick;
+    for (int id = 0; id < n; ++id) lay.query(id, ox1, oy1, ox2, oy2, cand);
+
+    const long long ext = (checks & CHECK_DENSITY) ? std::max(rules.density_window, 0) : 0;
+    long long rx1 = core.x1, ry1 = core.y1, rx2 = (long long)core.x2 + ext, ry2 = (long long)core.y2 + ext;
+    for (int s : cand){
+        const Shape sh = lay.shape(s);
+        if (!ownsShape(die, core, sh)) continue;
+        if (sh.x1 > sh.x2 || sh.y1 > sh.y2){   // 反向矩形的範圍沒有意義，跟 checkRegion 一樣整份都要
+            for (int t = 0; t < lay.slots(); ++t) pick.push_back(t);
+            return lay.subset(pick);
+        }
+        rx1 = std::min<long long>(rx1, sh.x1); ry1 = std::min<long long>(ry1, sh.y1);
+        rx2 = std::max<long long>(rx2, sh.x2); ry2 = std::max<long long>(ry2, sh.y2);
+    }
+    const long long halo = ruleHalo(rules);
+    auto clampInt = [](long long v){ return (int)std::min<long long>(std::max<long long>(v, INT_MIN), INT_MAX); };
+    for (int id = 0; id < n; ++id)
+        lay.query(id, clampInt(rx1 - halo), clampInt(ry1 - halo), clampInt(rx2 + halo), clampInt(ry2 + halo), pick);
+    return lay.subset(pick);
+}
+
+void Server::loadRules(const std::string& name, const std::string& path){
+    auto r = std::make_shared<LoadedRules>();
+    r->rules = readRules(path);
+    std::lock_guard<std::mutex> lk(mu);
+    r->key = name + "#" + std::to_string(++generation);   // 重新載入後舊的增量結果自動失效
+    rulesets[name] = std::move(r);
+}
+
+std::shared_ptr<Session> Server::session(const std::string& name){
+    std::lock_guard<std::mutex> lk(mu);
+    auto it = layouts.find(name);
+    if (it == layouts.end()) throw std::runtime_error("layout not loaded: " + name);
+    return it->second;
+}
+
+std::shared_ptr<const LoadedRules> Server::ruleset(const std::string& name){
+    std::lock_guard<std::mutex> lk(mu);
+    auto it = rulesets.find(name);
+    if (it == rulesets.end()) throw std::runtime_error("rules not loaded: " + name);
+    return it->second;
+}
+
+void Server::handle(const json& req, const std::function<bool(const json&)>& send,
+                    const std::function<bool(const std::string&)>& sendLines){
+    const json id = req.value("id", json());
+    const std::string cmd = req.at("cmd").get<std::string>();
+    json reply = {{"id", id}, {"ok", true}};
+
+    if (cmd == "ping") {
+    } else if (cmd == "load_rules") {
+        const std::string name = req.value("name", "default");
+        loadRules(name, req.at("path").get<std::string>());
+        reply["rules"] = name;
+    } else if (cmd == "load_layout") {
+        const std::string path = req.at("path").get<std::string>();
+        const std::string name = req.value("name", path);
+        if (!std::ifstream(path).is_open()) throw std::runtime_error("Cannot open layout file: " + path);
+        auto s = std::make_shared<Session>();
+        std::vector<ParseError> errors;
+        // 層號別名依 "rules" 的 layer_mapping 換成正名；沒指定時用 default，default 還沒載入就照原名
+        std::shared_ptr<const LoadedRules> R;
+        if (req.contains("rules")) R = ruleset(req.at("rules").get<std::string>());
+        else { std::lock_guard<std::mutex> lk(mu); auto it = rulesets.find("default"); if (it != rulesets.end()) R = it->second; }
+        s->live.layout = LiveLayout(R ? readLayout(path, R->rules, &errors) : readLayout(path, &errors));
+        reply["layout"] = name;
+        reply["shapes"] = s->live.layout.count();
+        reply["parse_errors"] = errors.size();
+        std::lock_guard<std::mutex> lk(mu);
+        layouts[name] = std::move(s);
+    } else if (cmd == "apply_delta") {
+        auto s = session(req.at("layout").get<std::string>());
+        std::unique_lock<std::shared_mutex> lk(s->mu);
+        size_t added = 0, removed = 0;
+        applyDelta(s->live, req, added, removed);
+        reply["shapes"] = s->live.layout.count();
+        reply["added"] = added;
+        reply["removed"] = removed;
+    } else if (cmd == "check") {
+        auto s = session(req.at("layout").get<std::string>());
+        auto R = ruleset(req.value("rules", "default"));
+        const unsigned checks = parseChecks(req);
+        const Box die = req.contains("die") ? parseBoxJson(req.at("die")) : opt.die;
+        size_t count = 0;
+        bool alive = true;
+        auto stream = [&](const std::vector<Violation>& V){   // 一批一次 send
+            if (!alive || V.empty()) return;
+            std::string lines;
+            for (const auto& v : V)
+                lines += json{{"id", id}, {"violation", violationJson(v)}}.dump() + "\n";
+            alive = sendLines(lines);
+            count += V.size();
+        };
+
+        if (req.contains("region")) {
+            std::shared_lock<std::shared_mutex> lk(s->mu);
+            const LiveLayout& lay = s->live.layout;
+            const Box core = parseBoxJson(req.at("region"));
+            const bool dense = (size_t)lay.slots() == lay.count();
+            checkRegion(regionShapes(lay, R->rules, die, core, checks), R->rules, die, core, checks,
+                        [&](std::vector<Violation>& V){
+                            if (!dense)   // 局部 store 的 idx 是 slot，送出前換回目前的 idx
+                                for (auto& v : V){
+                                    if (v.cat == 0 || v.cat == 1) v.a = lay.idxOf((int)v.a);
+                                    if (v.cat == 1 || v.cat == 2) v.b = lay.idxOf((int)v.b);
+                                }
+                            stream(V);
+                        });
+        } else {
+            std::unique_lock<std::shared_mutex> lk(s->mu);
+            IncrementalStats st;
+            std::vector<Violation> V = updateIncremental(s->live, R->rules, R->key, die, opt.threads, &st);
+            if (checks != CHECK_ALL)
+                V.erase(std::remove_if(V.begin(), V.end(),
+                                       [&](const Violation& v){ return !(checks & (1u << v.cat)); }),
+                        V.end());
+            stream(V);
+            reply["incremental"] = {{"full", st.full}, {"added", st.added}, {"removed", st.removed},
+                                    {"kept", st.kept}, {"recomputed", st.recomputed}};
+        }
+        if (!alive) return;
+        reply["count"] = count;
+    } else if (cmd == "unload") {
+        std::lock_guard<std::mutex> lk(mu);
+        if (!layouts.erase(req.at("layout").get<std::string>()))
+            throw std::runtime_error("layout not loaded: " + req.at("layout").get<std::string>());
+    } else if (cmd == "status") {
+        // 先在 mu 底下複製表，放掉 mu 才逐一鎖 session：某個 session 正在整批 check / apply_delta 時
+        // 只有這個 status 要等，其他連線的 load / check / unload 不會卡在 mu 上
+        std::vector<std::pair<std::string, std::shared_ptr<Session>>> S;
+        json L = json::object(), Rn = json::array();
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            S.assign(layouts.begin(), layouts.end());
+            for (const auto& kv : rulesets) Rn.push_back(kv.first);
+        }
+        for (const auto& kv : S){
+            std::shared_lock<std::shared_mutex> slk(kv.second->mu);
+            L[kv.first] = kv.second->live.layout.count();
+        }
+        reply["layouts"] = L;
+        reply["rules"] = Rn;
+    } else if (cmd == "shutdown") {
+        stopping = true;
+    } else {
+        throw std::runtime_error("unknown cmd: " + cmd);
+    }
+    send(reply);
+}
+
+void Server::serveClient(int fd){
+    auto sendLines = [fd](const std::string& s){ return sendAll(fd, s); };
+    auto send = [fd](const json& j){ return sendAll(fd, j.dump() + "\n"); };
+    std::string buf;
+    char chunk[65536];
+    while (!stopping){
+        ssize_t n = ::recv(fd, chunk, sizeof chunk, 0);
+        if (n <= 0) break;
+        buf.append(chunk, (size_t)n);
+        size_t start = 0, nl;
+        while ((nl = buf.find('\n', start)) != std::string::npos){
+            std::string line = buf.substr(start, nl - start);
+            start = nl + 1;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            json req;
+            try {
+                req = json::parse(line);
+                handle(req, send, sendLines);
+            } catch (const std::exception& e) {
+                json id = req.is_object() ? req.value("id", json()) : json();
+                send({{"id", id}, {"ok", false}, {"error", e.what()}});
+            }
+        }
+        buf.erase(0, start);
+    }
+    std::lock_guard<std::mutex> lk(clientsMu);
+    clients.erase(std::find(clients.begin(), clients.end(), fd));
+    ::close(fd);
+    clientsDone.notify_all();
+}
+
+int Server::run(){
+    if (!opt.rulesFile.empty()) {
+        try { loadRules("default", opt.rulesFile); }
+        catch (const std::exception& e) { std::cerr << "WARNING: " << e.what() << "\n"; }
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (opt.socketPath.size() >= sizeof addr.sun_path){
+        std::cerr << "socket path too long: " << opt.socketPath << "\n";
+        return 2;
+    }
+    std::strncpy(addr.sun_path, opt.socketPath.c_str(), sizeof addr.sun_path - 1);
+
+    // 上次沒收乾淨的 socket 檔才刪；路徑上是別的檔案（打錯路徑）就不動它
+    struct stat old{};
+    if (::lstat(opt.socketPath.c_str(), &old) == 0){
+        if (!S_ISSOCK(old.st_mode)){
+            std::cerr << "Cannot listen on " << opt.socketPath << ": exists and is not a socket\n";
+            return 2;
+        }
+        ::unlink(opt.socketPath.c_str());
+    }
+    int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    struct stat mine{};
+    if (lfd < 0 || ::bind(lfd, (sockaddr*)&addr, sizeof addr) != 0 || ::listen(lfd, 64) != 0 ||
+        ::lstat(opt.socketPath.c_str(), &mine) != 0){
+        std::cerr << "Cannot listen on " << opt.socketPath << "\n";
+        if (lfd >= 0) ::close(lfd);
+        return 2;
+    }
+    std::cout << "DRC server listening on " << opt.socketPath << std::endl;
+
+    while (!stopping){
+        pollfd p{lfd, POLLIN, 0};
+        if (::poll(&p, 1, 200) <= 0) continue;   // 定時醒來看 stopping
+        int fd = ::accept(lfd, nullptr, nullptr);
+        if (fd < 0) continue;
+        {
+            std::lock_guard<std::mutex> lk(clientsMu);
+            clients.push_back(fd);
+        }
+        std::thread([this, fd]{ serveClient(fd); }).detach();
+    }
+
+    // 叫醒還卡在 recv 的連線，等它們都結束
+    {
+        std::unique_lock<std::mutex> lk(clientsMu);
+        for (int fd : clients) ::shutdown(fd, SHUT_RDWR);
+        clientsDone.wait(lk, [this]{ return clients.empty(); });
+    }
+    ::close(lfd);
+    // 只刪自己 bind 出來的那個 socket（期間被換成別的檔案就留著）
+    struct stat now{};
+    if (::lstat(opt.socketPath.c_str(), &now) == 0 && S_ISSOCK(now.st_mode) &&
+        now.st_dev == mine.st_dev && now.st_ino == mine.st_ino)
+        ::unlink(opt.socketPath.c_str());
+    return 0;
+}
+
+} // namespace
+
+int runServer(const ServerOptions& opt){
+    Server s(opt);
+    return s.run();
+}
+
+#endif
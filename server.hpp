@@ -0,0 +1,31 @@
+#pragma once
+#include "common.hpp"
+#include <string>
+
+// ---- 常駐 DRC 伺服器（main --serve SOCKET）----
+// RuleSet 與 layout 讀一次後留在記憶體，編輯器 / CI 透過 Unix socket 送小查詢，省掉每次啟動重讀重建。
+// 協定：一行一個 JSON request，回應也是一行一個 JSON；request 帶的 "id" 原樣放進每一行回應。
+//   {"cmd":"load_rules","name":"default","path":"rules.json"}
+//   {"cmd":"load_layout","name":"top","path":"layout 1.txt","rules":"default"}   name 省略 = path；
+//        層名寫 layer number 的依 rules（省略 = default）的 layer_mapping 換成層名
+//   {"cmd":"apply_delta","layout":"top","remove":[12,40],"add":["M1 0 0 10 10", ...]}
+//        remove 是目前的 shape idx；保留的 shape 依原順序重新編號，add 的接在最後（與改 layout 檔相同）；
+//        直接改常駐的索引，成本只跟加刪的 shape 數有關
+//   {"cmd":"check","layout":"top","rules":"default","checks":["width","spacing"],"region":[x1,y1,x2,y2],"die":[...]}
+//        checks 省略 = 全部；region 省略 = 整片，同一組 rules / die 下次會走增量（incremental.hpp）；
+//        有 region 時只回傳 region 擁有的違規（與 tile 模式相同的歸屬規則），需要的 shape 從常駐的索引取，
+//        每做完一項 check 就先送出
+//        每筆違規一行 {"id":..,"violation":{...}}（欄位同 tile 的 JSON lines），最後 {"id":..,"ok":true,"count":N}
+//   {"cmd":"unload","layout":"top"}   {"cmd":"status"}   {"cmd":"ping"}   {"cmd":"shutdown"}
+// 失敗時回 {"id":..,"ok":false,"error":"..."}，連線不中斷。
+// 每條連線一個執行緒；同一份 layout 的 region check 可以同時跑，整片 check 與 apply_delta 獨佔。
+
+struct ServerOptions {
+    std::string socketPath;                 // 已存在時只有它是 socket（上次沒收掉的）才會刪掉重建，其他檔案一律不動
+    std::string rulesFile = "rules.json";   // 啟動時預先載入成 "default"（讀不到就略過）
+    Box die{0, 0, 200, 100};                // check 沒帶 die 時用這個
+    int threads = 1;                        // 整片 check 的執行緒數
+};
+
+// 收到 shutdown 後回傳 0；socket 開不起來回傳非 0
+int runServer(const ServerOptions& opt);
@@ -0,0 +1,205 @@
+#include "simd.hpp"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MINIDRC_X86 1
+#include <immintrin.h>
+#define TARGET(t) __attribute__((target(t)))
+#endif
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2 };
+
+// 偵測一次；環境變數 MINIDRC_SIMD=scalar / sse4.1 可強制降級（比對各版本輸出用）
+static SimdLevel detectLevel(){
+    SimdLevel lv = SIMD_SCALAR;
+#ifdef MINIDRC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))        lv = SIMD_AVX2;
+    else if (__builtin_cpu_supports("sse4.1")) lv = SIMD_SSE41;
+#endif
+    if (const char* env = std::getenv("MINIDRC_SIMD")) {
+        if (std::strcmp(env, "scalar") == 0) lv = SIMD_SCALAR;
+        else if (std::strcmp(env, "sse4.1") == 0 && lv > SIMD_SSE41) lv = SIMD_SSE41;
+    }
+    return lv;
+}
+
+static SimdLevel level(){
+    static const SimdLevel lv = detectLevel();
+    return lv;
+}
+
+const char* simdLevel(){
+    switch (level()) {
+        case SIMD_AVX2:  return "avx2";
+        case SIMD_SSE41: return "sse4.1";
+        default:         return "scalar";
+    }
+}
+
+
+// =================== width ===================
+
+static void widthScalar(const LayerShapes& L, size_t k0, size_t k1, int lo, int hi,
+                        std::vector<int>& hits){
+    for (size_t k = k0; k < k1; ++k){
+        int w = std::abs(L.x2[k] - L.x1[k]), h = std::abs(L.y2[k] - L.y1[k]);
+        if (std::min(w, h) < lo || std::max(w, h) > hi) hits.push_back((int)k);
+    }
+}
+
+#ifdef MINIDRC_X86
+static inline void pushMask(int m, size_t base, std::vector<int>& hits){
+    while (m) { hits.push_back((int)base + __builtin_ctz(m)); m &= m - 1; }
+}
+
+TARGET("avx2")
+static void widthAVX2(const LayerShapes& L, size_t k0, size_t k1, int lo, int hi,
+                      std::vector<int>& hits){
+    const __m256i vlo = _mm256_set1_epi32(lo), vhi = _mm256_set1_epi32(hi);
+    size_t k = k0;
+    for (; k + 8 <= k1; k += 8){
+        __m256i x1 = _mm256_loadu_si256((const __m256i*)(L.x1.data() + k));
+        __m256i y1 = _mm256_loadu_si256((const __m256i*)(L.y1.data() + k));
+        __m256i x2 = _mm256_loadu_si256((const __m256i*)(L.x2.data() + k));
+        __m256i y2 = _mm256_loadu_si256((const __m256i*)(L.y2.data() + k));
+        __m256i w  = _mm256_abs_epi32(_mm256_sub_epi32(x2, x1));
+        __m256i h  = _mm256_abs_epi32(_mm256_sub_epi32(y2, y1));
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, _mm256_min_epi32(w, h)),
+                                      _mm256_cmpgt_epi32(_mm256_max_epi32(w, h), vhi));
+        pushMask(_mm256_movemask_ps(_mm256_castsi256_ps(bad)), k, hits);
+    }
+    widthScalar(L, k, k1, lo, hi, hits);
+}
+
+TARGET("sse4.1")
+static void widthSSE41(const LayerShapes& L, size_t k0, size_t k1, int lo, int hi,
+                       std::vector<int>& hits){
+    const __m128i vlo = _mm_set1_epi32(lo), vhi = _mm_set1_epi32(hi);
+    size_t k = k0;
+    for (; k + 4 <= k1; k += 4){
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(L.x1.data() + k));
+        __m128i y1 = _mm_loadu_si128((const __m128i*)(L.y1.data() + k));
+        __m128i x2 = _mm_loadu_si128((const __m128i*)(L.x2.data() + k));
+        __m128i y2 = _mm_loadu_si128((const __m128i*)(L.y2.data() + k));
+        __m128i w  = _mm_abs_epi32(_mm_sub_epi32(x2, x1));
+        __m128i h  = _mm_abs_epi32(_mm_sub_epi32(y2, y1));
+        __m128i bad = _mm_or_si128(_mm_cmpgt_epi32(vlo, _mm_min_epi32(w, h)),
+                                   _mm_cmpgt_epi32(_mm_max_epi32(w, h), vhi));
+        pushMask(_mm_movemask_ps(_mm_castsi128_ps(bad)), k, hits);
+    }
+    widthScalar(L, k, k1, lo, hi, hits);
+}
+#endif
+
+void widthScreen(const LayerShapes& L, size_t k0, size_t k1, int minW, int maxW,
+                 std::vector<int>& hits){
+    hits.clear();
+    const int lo = minW < 0 ? INT_MIN : minW;
+    const int hi = maxW < 0 ? INT_MAX : maxW;
+#ifdef MINIDRC_X86
+    if (level() == SIMD_AVX2)  { widthAVX2(L, k0, k1, lo, hi, hits);  return; }
+    if (level() == SIMD_SSE41) { widthSSE41(L, k0, k1, lo, hi, hits); return; }
+#endif
+    widthScalar(L, k0, k1, lo, hi, hits);
+}
+
+
+// =================== spacing ===================
+
+bool narrowCoords(const LayerShapes& L){
+    const int lim = 1 << 30;
+    for (const auto* col : {&L.x1, &L.y1, &L.x2, &L.y2})
+        for (int v : *col)
+            if (v < -lim || v >= lim) return false;
+    return true;
+}
+
+// 與 rectSpacing 相同的 dx/dy 分支（反向矩形也一樣），64-bit 比較距離平方
+static void spacingScalar(const Shape& a, const LayerShapes& L, const int* cand, size_t n,
+                          long long S2, std::vector<int>& hits){
+    for (size_t i = 0; i < n; ++i){
+        const int j = cand[i];
+        long long dx = 0, dy = 0;
+        if (a.x2 <= L.x1[j]) dx = (long long)L.x1[j] - a.x2;
+        else if (L.x2[j] <= a.x1) dx = (long long)a.x1 - L.x2[j];
+        if (a.y2 <= L.y1[j]) dy = (long long)L.y1[j] - a.y2;
+        else if (L.y2[j] <= a.y1) dy = (long long)a.y1 - L.y2[j];
+        if (dx * dx + dy * dy < S2) hits.push_back(j);
+    }
+}
+
+// 向量版的前提：a 不是反向矩形、座標 narrow、S <= 32767。
+// dx = max(b.x1-a.x2, a.x1-b.x2, 0) 再夾到 S，d² <= 2S² 不會溢位 int32；反向的候選直接留下。
+#ifdef MINIDRC_X86
+TARGET("avx2")
+static void spacingAVX2(const Shape& a, const LayerShapes& L, const int* cand, size_t n,
+                        int S, std::vector<int>& hits){
+    const __m256i ax1 = _mm256_set1_epi32(a.x1), ay1 = _mm256_set1_epi32(a.y1);
+    const __m256i ax2 = _mm256_set1_epi32(a.x2), ay2 = _mm256_set1_epi32(a.y2);
+    const __m256i vS = _mm256_set1_epi32(S), vS2 = _mm256_set1_epi32(S * S);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(cand + i));
+        __m256i bx1 = _mm256_i32gather_epi32(L.x1.data(), idx, 4);
+        __m256i by1 = _mm256_i32gather_epi32(L.y1.data(), idx, 4);
+        __m256i bx2 = _mm256_i32gather_epi32(L.x2.data(), idx, 4);
+        __m256i by2 = _mm256_i32gather_epi32(L.y2.data(), idx, 4);
+        __m256i dx = _mm256_max_epi32(_mm256_max_epi32(_mm256_sub_epi32(bx1, ax2),
+                                                       _mm256_sub_epi32(ax1, bx2)), zero);
+        __m256i dy = _mm256_max_epi32(_mm256_max_epi32(_mm256_sub_epi32(by1, ay2),
+                                                       _mm256_sub_epi32(ay1, by2)), zero);
+        dx = _mm256_min_epi32(dx, vS);
+        dy = _mm256_min_epi32(dy, vS);
+        __m256i d2 = _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy));
+        __m256i inv = _mm256_or_si256(_mm256_cmpgt_epi32(bx1, bx2), _mm256_cmpgt_epi32(by1, by2));
+        __m256i hit = _mm256_or_si256(_mm256_cmpgt_epi32(vS2, d2), inv);
+        int m = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+        while (m) { hits.push_back(cand[i + __builtin_ctz(m)]); m &= m - 1; }
+    }
+    spacingScalar(a, L, cand + i, n - i, (long long)S * S, hits);
+}
+
+TARGET("sse4.1")
+static void spacingSSE41(const Shape& a, const LayerShapes& L, const int* cand, size_t n,
+                         int S, std::vector<int>& hits){
+    const __m128i ax1 = _mm_set1_epi32(a.x1), ay1 = _mm_set1_epi32(a.y1);
+    const __m128i ax2 = _mm_set1_epi32(a.x2), ay2 = _mm_set1_epi32(a.y2);
+    const __m128i vS = _mm_set1_epi32(S), vS2 = _mm_set1_epi32(S * S);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        const int* c = cand + i;
+        __m128i bx1 = _mm_setr_epi32(L.x1[c[0]], L.x1[c[1]], L.x1[c[2]], L.x1[c[3]]);
+        __m128i by1 = _mm_setr_epi32(L.y1[c[0]], L.y1[c[1]], L.y1[c[2]], L.y1[c[3]]);
+        __m128i bx2 = _mm_setr_epi32(L.x2[c[0]], L.x2[c[1]], L.x2[c[2]], L.x2[c[3]]);
+        __m128i by2 = _mm_setr_epi32(L.y2[c[0]], L.y2[c[1]], L.y2[c[2]], L.y2[c[3]]);
+        __m128i dx = _mm_max_epi32(_mm_max_epi32(_mm_sub_epi32(bx1, ax2), _mm_sub_epi32(ax1, bx2)), zero);
+        __m128i dy = _mm_max_epi32(_mm_max_epi32(_mm_sub_epi32(by1, ay2), _mm_sub_epi32(ay1, by2)), zero);
+        dx = _mm_min_epi32(dx, vS);
+        dy = _mm_min_epi32(dy, vS);
+        __m128i d2 = _mm_add_epi32(_mm_mullo_epi32(dx, dx), _mm_mullo_epi32(dy, dy));
+        __m128i inv = _mm_or_si128(_mm_cmpgt_epi32(bx1, bx2), _mm_cmpgt_epi32(by1, by2));
+        __m128i hit = _mm_or_si128(_mm_cmpgt_epi32(vS2, d2), inv);
+        int m = _mm_movemask_ps(_mm_castsi128_ps(hit));
+        while (m) { hits.push_back(c[__builtin_ctz(m)]); m &= m - 1; }
+    }
+    spacingScalar(a, L, cand + i, n - i, (long long)S * S, hits);
+}
+#endif
+
+void spacingScreen(const Shape& a, const LayerShapes& L, const int* cand, size_t n,
+                   int S, bool narrow, std::vector<int>& hits){
+    hits.clear();
+#ifdef MINIDRC_X86
+    const bool vec = narrow && S >= 0 && S <= 32767 && a.x1 <= a.x2 && a.y1 <= a.y2;
+    if (vec && level() == SIMD_AVX2)  { spacingAVX2(a, L, cand, n, S, hits);  return; }
+    if (vec && level() == SIMD_SSE41) { spacingSSE41(a, L, cand, n, S, hits); return; }
+#else
+    (void)narrow;
+#endif
+    spacingScalar(a, L, cand, n, (long long)S * S, hits);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "common.hpp"
+#include <vector>
+
+// ---- 向量化的 width / spacing 粗篩 ----
+// 直接吃 LayerShapes 的 SoA 陣列；執行時依 CPU 選 AVX2（8 lanes）/ SSE4.1（4 lanes）/ 純量版。
+// 粗篩只回傳「可能違規」的層內序號（不會漏），真正的違規值仍由呼叫端用純量公式確認，
+// 所以不論走哪個版本，報表都與逐筆計算相同。
+
+// 目前選用的版本："avx2" / "sse4.1" / "scalar"
+const char* simdLevel();
+
+// [k0,k1) 中短邊 < minW 或長邊 > maxW 的 k（遞增）；minW / maxW 為 -1 代表不檢查該項
+void widthScreen(const LayerShapes& L, size_t k0, size_t k1, int minW, int maxW,
+                 std::vector<int>& hits);
+
+// 整層座標都在 ±2^30 內（差值不會溢位 int32）才能走 spacingScreen 的向量版
+bool narrowCoords(const LayerShapes& L);
+
+// a 對候選 cand[0..n) 的 min spacing 粗篩：用距離平方比較、不開根號，
+// 留下 d < S 可能成立的候選（反向矩形一律留下）。narrow=false 或 S 太大時走純量版。
+void spacingScreen(const Shape& a, const LayerShapes& L, const int* cand, size_t n,
+                   int S, bool narrow, std::vector<int>& hits);
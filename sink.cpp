@@ -0,0 +1,130 @@
+#include "sink.hpp"
+#include <chrono>
+#include <stdexcept>
+
+
+// ---- RecordQueue ----
+
+RecordQueue::RecordQueue(size_t capacity){
+    size_t n = 2;
+    while (n < capacity) n <<= 1;
+    cells.reset(new Cell[n]);
+    for (size_t i = 0; i < n; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    mask = n - 1;
+}
+
+bool RecordQueue::tryPush(const ViolationRecord& r){
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;){
+        Cell& c = cells[pos & mask];
+        size_t seq = c.seq.load(std::memory_order_acquire);
+        long long dif = (long long)seq - (long long)pos;
+        if (dif == 0){
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                c.rec = r;
+                c.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;                            // 滿了
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool RecordQueue::tryPop(ViolationRecord& r){
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (;;){
+        Cell& c = cells[pos & mask];
+        size_t seq = c.seq.load(std::memory_order_acquire);
+        long long dif = (long long)seq - (long long)(pos + 1);
+        if (dif == 0){
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                r = c.rec;
+                c.seq.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;                            // 空的
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+// ---- ViolationSink ----
+
+ViolationSink::ViolationSink(const ShapeStore& store, const RuleSet& rules, const SinkOptions& opt)
+    : ctx(store.layers, bindRules(rules, store.layers)), opt(opt), queue(opt.capacity)
+{
+    size_t refs = std::max<size_t>({ctx.layer.size(), ctx.via.size(), 1});
+    ruleSlots = refs * 8;
+    ruleCount.reset(new std::atomic<long long>[ruleSlots]);
+    for (size_t i = 0; i < ruleSlots; ++i) ruleCount[i].store(0, std::memory_order_relaxed);
+    for (auto [w, path] : {std::pair{&rep, &opt.reportPath}, std::pair{&csv, &opt.csvPath}, std::pair{&md, &opt.mdPath}}){
+        if (path->empty()) continue;
+        w->reset(new BufferedWriter(*path));
+        if (!(*w)->ok()) throw std::runtime_error("Cannot write " + *path);
+    }
+    writer = std::thread([this]{ writeLoop(); });
+}
+
+ViolationSink::~ViolationSink(){
+    try { close(); } catch (const std::exception&) {}   // 要知道寫入有沒有失敗就自己呼叫 close
+}
+
+size_t ViolationSink::ruleSlot(const ViolationRecord& r) const {
+    return ((size_t)r.ref * 2 + r.sub) * 4 + r.cat;
+}
+
+void ViolationSink::push(const ViolationRecord& r){
+    if (opt.maxPerRule > 0){
+        std::atomic<long long>& c = ruleCount[ruleSlot(r)];
+        // PASS 不算違規、不佔名額，但規則額滿後一起略過
+        if (r.pass ? c.load(std::memory_order_relaxed) >= opt.maxPerRule
+                   : c.fetch_add(1, std::memory_order_relaxed) >= opt.maxPerRule){
+            nDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    while (!queue.tryPush(r)) std::this_thread::yield();   // 滿了就等 writer（背壓）
+}
+
+void ViolationSink::close(){
+    if (!writer.joinable()) return;
+    done.store(true, std::memory_order_release);
+    writer.join();
+    for (auto [w, path] : {std::pair{&rep, &opt.reportPath}, std::pair{&csv, &opt.csvPath}, std::pair{&md, &opt.mdPath}})
+        if (*w && !(*w)->close()) throw std::runtime_error("Write failed: " + *path);
+}
+
+void ViolationSink::writeLoop(){
+    if (csv) writeCsvHeader(*csv);
+    if (md)  writeMdHeader(*md);
+
+    // record 轉成 Violation 不配置記憶體（名稱都是 intern 過的指標），各行欄位在 write*Line 裡才組
+    auto write = [&](const ViolationRecord& r){
+        Violation v = toViolation(r, ctx);
+        ++nWritten;
+        if (rep) writeReportLine(*rep, v);
+        if (v.pass) return;   // 表格只列 FAIL
+        ++nFail;
+        if (csv) writeCsvLine(*csv, v);
+        if (md)  writeMdLine(*md, v);
+    };
+
+    ViolationRecord r;
+    int idle = 0;
+    for (;;){
+        if (queue.tryPop(r)) { write(r); idle = 0; continue; }
+        if (done.load(std::memory_order_acquire)){
+            // close() 在所有 push 都結束後才呼叫，這裡清空就是全部了
+            while (queue.tryPop(r)) write(r);
+            break;
+        }
+        if (++idle < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "common.hpp"
+#include "drc.hpp"
+#include "report.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ---- 串流輸出（--stream）----
+// check 直接把 ViolationRecord 推進有界的 lock-free 佇列，一條 writer 執行緒把它們格式化成
+// drc_report.txt / CSV / markdown；整份違規清單從不放進記憶體，峰值記憶體與違規數無關。
+// 佇列滿了 check 端就等（背壓），不會丟資料；只有 per-rule 上限會丟。
+// 輸出順序是發現順序（多執行緒時不固定），內容與一般模式排序後相同。
+
+// 固定容量的多生產者 / 多消費者環狀佇列（Vyukov）：每格一個序號，push / pop 各只有一次 CAS
+class RecordQueue {
+public:
+    explicit RecordQueue(size_t capacity);   // 會進位到 2 的冪
+    bool tryPush(const ViolationRecord& r);
+    bool tryPop(ViolationRecord& r);
+
+private:
+    struct Cell { std::atomic<size_t> seq; ViolationRecord rec; };
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};   // 下一個要 pop 的位置
+    alignas(64) std::atomic<size_t> tail{0};   // 下一個要 push 的位置
+};
+
+struct SinkOptions {
+    std::string reportPath = "drc_report.txt";      // console 格式；空字串 = 不寫
+    std::string csvPath    = "drc_fail_table.csv";  // 只列 FAIL
+    std::string mdPath;                             // markdown 表格（只列 FAIL）
+    long long maxPerRule   = 0;                     // 每條規則最多寫幾筆；0 = 不限
+    size_t capacity        = 1 << 16;               // 佇列容量（record 數）
+};
+
+class ViolationSink : public RecordSink {
+public:
+    // 建構時就把層名 / via 名稱換成 RecordContext、開好輸出檔並啟動 writer 執行緒；之後不再參考 store / rules。
+    // 輸出檔開不起來丟 std::runtime_error（還沒開始 check）
+    ViolationSink(const ShapeStore& store, const RuleSet& rules, const SinkOptions& opt = {});
+    ~ViolationSink() override;
+
+    void push(const ViolationRecord& r) override;   // 可從多個執行緒同時呼叫
+    void close();                                   // 等 writer 寫完並關檔；寫入失敗丟 std::runtime_error
+
+    size_t written() const { return nWritten; }     // 寫出的 record 數（含 PASS）
+    size_t fails() const { return nFail; }          // 其中 FAIL 的筆數
+    size_t dropped() const { return nDropped.load(); }   // 超過 per-rule 上限丟掉的
+
+private:
+    RecordContext ctx;
+    SinkOptions opt;
+
+    std::unique_ptr<BufferedWriter> rep, csv, md;   // 沒有要寫的是 null
+    RecordQueue queue;
+    std::atomic<bool> done{false};
+    std::thread writer;
+
+    // 規則槽：(ref, sub, cat) 各一個計數器
+    std::unique_ptr<std::atomic<long long>[]> ruleCount;
+    size_t ruleSlots = 0;
+    std::atomic<size_t> nDropped{0};
+    size_t nWritten = 0, nFail = 0;       // 只有 writer 寫
+
+    size_t ruleSlot(const ViolationRecord& r) const;
+    void writeLoop();
+};
@@ -0,0 +1,214 @@
+#include "spatial.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+
+// 格子大小：至少 minCell（通常是 spacing），並參考平均邊長，
+// 讓一般矩形只落在少數幾格；總格數限制在 shape 數的數倍以內，避免稀疏層爆記憶體。
+LayerGrid::LayerGrid(const LayerShapes& L, int minCell){
+    long long bx1 = LLONG_MAX, by1 = LLONG_MAX, bx2 = LLONG_MIN, by2 = LLONG_MIN;
+    long long sumExt = 0;
+    std::vector<int> regular;
+    regular.reserve(L.size());
+    for (size_t k = 0; k < L.size(); ++k){
+        if (L.x1[k] > L.x2[k] || L.y1[k] > L.y2[k]){ irregular.push_back((int)k); continue; }
+        regular.push_back((int)k);
+        bx1 = std::min<long long>(bx1, L.x1[k]); by1 = std::min<long long>(by1, L.y1[k]);
+        bx2 = std::max<long long>(bx2, L.x2[k]); by2 = std::max<long long>(by2, L.y2[k]);
+        sumExt += std::max(L.x2[k] - L.x1[k], L.y2[k] - L.y1[k]);
+    }
+    if (regular.empty()) return;
+
+    long long c = std::max<long long>(1, minCell);
+    c = std::max<long long>(c, sumExt / (long long)regular.size());
+    const long long cap = 4LL * (long long)regular.size() + 64;
+    while (((bx2 - bx1) / c + 1) * ((by2 - by1) / c + 1) > cap) c *= 2;
+
+    x0 = (int)bx1; y0 = (int)by1; cell = (int)c;
+    nx = (int)((bx2 - bx1) / c + 1);
+    ny = (int)((by2 - by1) / c + 1);
+
+    // 兩趟 counting sort：先數每格數量，再填入
+    start.assign((size_t)nx * ny + 1, 0);
+    auto forCells = [&](int k, auto&& fn){
+        int cx1 = (int)(((long long)L.x1[k] - x0) / cell), cx2 = (int)(((long long)L.x2[k] - x0) / cell);
+        int cy1 = (int)(((long long)L.y1[k] - y0) / cell), cy2 = (int)(((long long)L.y2[k] - y0) / cell);
+        for (int cy = cy1; cy <= cy2; ++cy)
+            for (int cx = cx1; cx <= cx2; ++cx)
+                fn((size_t)cy * nx + cx);
+    };
+    for (int k : regular) forCells(k, [&](size_t c){ ++start[c + 1]; });
+    for (size_t k = 1; k < start.size(); ++k) start[k] += start[k - 1];
+    items.resize(start.back());
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (int k : regular) forCells(k, [&](size_t c){ items[fill[c]++] = k; });
+}
+
+void LayerGrid::query(int qx1,int qy1,int qx2,int qy2, std::vector<int>& out) const {
+    out.clear();
+    out.insert(out.end(), irregular.begin(), irregular.end());
+    if (nx > 0){
+        auto clampX = [&](long long v){ return (int)std::min<long long>(std::max<long long>(v, 0), nx - 1); };
+        auto clampY = [&](long long v){ return (int)std::min<long long>(std::max<long long>(v, 0), ny - 1); };
+        long long lx1 = (long long)qx1 - x0, lx2 = (long long)qx2 - x0;
+        long long ly1 = (long long)qy1 - y0, ly2 = (long long)qy2 - y0;
+        if (lx2 >= 0 && ly2 >= 0 && lx1 <= (long long)nx * cell && ly1 <= (long long)ny * cell){
+            int cx1 = clampX(lx1 / cell), cx2 = clampX(lx2 / cell);
+            int cy1 = clampY(ly1 / cell), cy2 = clampY(ly2 / cell);
+            for (int cy = cy1; cy <= cy2; ++cy)
+                for (int cx = cx1; cx <= cx2; ++cx){
+                    size_t k = (size_t)cy * nx + cx;
+                    out.insert(out.end(), items.begin() + start[k], items.begin() + start[k + 1]);
+                }
+        }
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+
+SpacingIndex buildSpacingIndex(const ShapeStore& store, const BoundRules& rules,
+                               ThreadPool* pool){
+    SpacingIndex idx;
+    const int n = store.numLayers();
+    idx.grids.resize(n);
+    idx.spacing.assign(n, -1);
+    idx.narrow.assign(n, 0);
+    for (int id = 0; id < n; ++id){
+        int S = rules.layer[id].min_spacing;
+        if (S < 0 || store.byLayer[id].size() == 0) continue;
+        idx.spacing[id] = S;
+        LayerGrid* g = &idx.grids[id];
+        char* nw = &idx.narrow[id];
+        const LayerShapes* L = &store.byLayer[id];
+        auto build = [g, nw, L, S]{ *g = LayerGrid(*L, S); *nw = narrowCoords(*L); };
+        if (pool) pool->submit(build); else build();
+    }
+    if (pool) pool->wait();
+    return idx;
+}
+
+// d < S 代表 dx < S 且 dy < S，所以把 bbox 四邊各擴 S 做 range query 一定不會漏
+void SpacingIndex::candidates(const ShapeStore& store, int layer, size_t k, std::vector<int>& out) const {
+    out.clear();
+    if (layer >= (int)spacing.size() || spacing[layer] < 0) return;
+    const int S = spacing[layer];
+    const LayerShapes& L = store.byLayer[layer];
+    auto clampInt = [](long long v){ return (int)std::min<long long>(std::max<long long>(v, INT_MIN), INT_MAX); };
+    if (L.x1[k] > L.x2[k] || L.y1[k] > L.y2[k])     // 反向矩形的 rectSpacing 不是幾何距離，直接全層比對
+        grids[layer].query(INT_MIN, INT_MIN, INT_MAX, INT_MAX, out);
+    else
+        grids[layer].query(clampInt((long long)L.x1[k] - S), clampInt((long long)L.y1[k] - S),
+                           clampInt((long long)L.x2[k] + S), clampInt((long long)L.y2[k] + S), out);
+    out.erase(out.begin(), std::upper_bound(out.begin(), out.end(), (int)k));
+}
+
+
+// ---- via enclosure ----
+
+// 16-bit x、y 交錯成 32-bit Z-order code
+static uint32_t interleave16(uint32_t v){
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+std::vector<int> mortonOrder(const LayerShapes& L){
+    const size_t n = L.size();
+    std::vector<int> order(n);
+    if (n == 0) return order;
+
+    // 中心點先平移到非負，再右移到 16 bits 以內
+    std::vector<long long> cx(n), cy(n);
+    long long mx = LLONG_MAX, my = LLONG_MAX, Mx = LLONG_MIN, My = LLONG_MIN;
+    for (size_t k = 0; k < n; ++k){
+        cx[k] = ((long long)L.x1[k] + L.x2[k]) / 2;
+        cy[k] = ((long long)L.y1[k] + L.y2[k]) / 2;
+        mx = std::min(mx, cx[k]); Mx = std::max(Mx, cx[k]);
+        my = std::min(my, cy[k]); My = std::max(My, cy[k]);
+    }
+    int shift = 0;
+    while (((std::max(Mx - mx, My - my)) >> shift) > 0xffff) ++shift;
+
+    std::vector<std::pair<uint32_t, int>> keyed(n);
+    for (size_t k = 0; k < n; ++k){
+        uint32_t code = interleave16((uint32_t)((cx[k] - mx) >> shift)) |
+                        (interleave16((uint32_t)((cy[k] - my) >> shift)) << 1);
+        keyed[k] = {code, (int)k};
+    }
+    std::sort(keyed.begin(), keyed.end());
+    for (size_t k = 0; k < n; ++k) order[k] = keyed[k].second;
+    return order;
+}
+
+EnclosureIndex buildEnclosureIndex(const ShapeStore& store, const BoundRules& rules,
+                                   ThreadPool* pool, bool sortVias){
+    EnclosureIndex idx;
+    const int n = store.numLayers();
+    idx.grids.resize(n);
+    idx.order.resize(n);
+    std::vector<char> need(n, 0), isVia(n, 0);
+    for (const auto& v : rules.vias){
+        if (v.via < 0) continue;
+        isVia[v.via] = 1;
+        if (v.under >= 0) need[v.under] = 1;
+        if (v.over  >= 0) need[v.over]  = 1;
+    }
+    for (int id = 0; id < n; ++id){
+        const LayerShapes* L = &store.byLayer[id];
+        if (need[id] && L->size()){
+            LayerGrid* g = &idx.grids[id];
+            auto build = [g, L]{ *g = LayerGrid(*L, 1); };
+            if (pool) pool->submit(build); else build();
+        }
+        if (isVia[id] && sortVias){
+            std::vector<int>* o = &idx.order[id];
+            auto sortVias = [o, L]{ *o = mortonOrder(*L); };
+            if (pool) pool->submit(sortVias); else sortVias();
+        }
+    }
+    if (pool) pool->wait();
+    return idx;
+}
+
+// 「相交含邊界」對反向 via 而言等於金屬要跨過 [min, max]，所以用正規化後的 bbox 查
+void EnclosureIndex::candidates(const ShapeStore& store, int via, size_t k, int metal,
+                                std::vector<int>& out) const {
+    out.clear();
+    if (metal < 0 || metal >= (int)grids.size()) return;
+    const LayerShapes& V = store.byLayer[via];
+    grids[metal].query(std::min(V.x1[k], V.x2[k]), std::min(V.y1[k], V.y2[k]),
+                       std::max(V.x1[k], V.x2[k]), std::max(V.y1[k], V.y2[k]), out);
+}
+
+
+// 桶數限制在 n 的兩倍以內：稀疏層不會配置一大堆空桶
+ActiveBuckets::ActiveBuckets(int xmin, int xmax, int width_, int halo_, size_t n)
+    : x0(xmin), width(std::max(1, width_)), halo(halo_), seen(n, 0)
+{
+    if (xmin > xmax) return;
+    const long long span = (long long)xmax - xmin;
+    while (span / width + 1 > 2 * (long long)n + 64) width *= 2;
+    buckets.resize((size_t)(span / width + 1));
+}
+
+void ActiveBuckets::insert(int k, int x1,int y1,int x2,int y2){
+    const int b1 = bucketOf(x1), b2 = bucketOf(x2);
+    for (int b = b1; b <= b2; ++b) buckets[b].push_back({k, x1, y1, x2, y2});
+    entries += (size_t)(b2 - b1 + 1);
+    if (entries > nextCompact) compact(y1);
+}
+
+// 插入依 y1 遞增，目前插入的 y1 就是掃描線的位置
+void ActiveBuckets::compact(int y){
+    for (auto& B : buckets)
+        B.erase(std::remove_if(B.begin(), B.end(), [&](const Entry& e){ return (long long)e.y2 + halo < y; }), B.end());
+    entries = 0;
+    for (const auto& B : buckets) entries += B.size();
+    nextCompact = std::max(2 * entries + 1024, buckets.size());   // 每次掃描的成本攤在之後的插入上
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "common.hpp"
+#include <vector>
+#include <string>
+
+// ---- 單層均勻網格 (uniform grid) ----
+// 建一次、查很多次：每個 shape 依 bbox 登記到它覆蓋的所有 cell（CSR 格式存放），
+// query 回傳與查詢框相交（含邊界）的層內序號 k，已遞增排序且去重。
+// x1>x2 或 y1>y2 的「反向」矩形不進網格，每次 query 都一併回傳，保證結果不漏。
+class LayerGrid {
+public:
+    LayerGrid() = default;
+    LayerGrid(const LayerShapes& L, int minCell);
+
+    void query(int qx1,int qy1,int qx2,int qy2, std::vector<int>& out) const;
+    bool empty() const { return items.empty() && irregular.empty(); }
+
+private:
+    int x0 = 0, y0 = 0, cell = 1, nx = 0, ny = 0;
+    std::vector<int> start;      // cell c 的項目在 items[start[c], start[c+1])
+    std::vector<int> items;
+    std::vector<int> irregular;
+};
+
+// 同層 min spacing 的候選查詢：每個有 spacing 規則的層各建一張網格
+struct SpacingIndex {
+    std::vector<LayerGrid> grids;   // grids[layer ID]
+    std::vector<int> spacing;       // spacing[layer ID]，-1 = 這層沒有 spacing 規則
+    std::vector<char> narrow;       // narrow[layer ID]：座標可走 spacingScreen 的向量版
+
+    // 與第 layer 層第 k 個 shape 落在「bbox 外擴 min spacing」範圍內、層內序號 > k 的候選（遞增）
+    void candidates(const ShapeStore& store, int layer, size_t k, std::vector<int>& out) const;
+};
+
+class ThreadPool;
+// 有 pool 時每層網格各是一個 task，函式返回前會 pool->wait()
+SpacingIndex buildSpacingIndex(const ShapeStore& store, const BoundRules& rules,
+                               ThreadPool* pool = nullptr);
+
+// via enclosure 的查詢：被 via 規則引用的 under/over 金屬層各建一張網格，
+// 對 via bbox 做 stabbing query 取出碰到它（含邊界）的金屬候選，不再整層掃。
+// via 依 Morton（Z-order）順序批次查詢，相鄰的查詢落在相鄰的 cell，網格資料留在 cache 裡。
+struct EnclosureIndex {
+    std::vector<LayerGrid> grids;            // grids[layer ID]，只有被引用的金屬層有建
+    std::vector<std::vector<int>> order;     // order[via layer ID]：via 的層內序號依 Morton code 排序
+
+    // 與第 via 層第 k 個 via 的 bbox 相交（含邊界）的 metal 層候選（遞增，可能多給，呼叫端再精確判斷）
+    void candidates(const ShapeStore& store, int via, size_t k, int metal, std::vector<int>& out) const;
+};
+
+// 依 bbox 中心的 Morton code 排序的層內序號（同 code 依序號）
+std::vector<int> mortonOrder(const LayerShapes& L);
+
+// 有 pool 時每張網格 / 每個 via 層的排序各是一個 task，函式返回前會 pool->wait()
+// sortVias=false 時不排 order（只查少數 via 的增量重算用）
+EnclosureIndex buildEnclosureIndex(const ShapeStore& store, const BoundRules& rules,
+                                   ThreadPool* pool = nullptr, bool sortVias = true);
+
+// ---- plane sweep 的 active set ----
+// 矩形依 y1 遞增插入；x 方向切成等寬的桶，每個矩形登記到它 x 範圍涵蓋的桶（連座標一起存，
+// 比對時不必回頭讀層的陣列）。查詢只看 x 範圍相關的桶，順手移掉已經過期的項目
+// （y2 + halo < 目前的 y），所以每個矩形只進出 active set 一次；項目數翻倍時整個掃一遍，
+// 很久沒被查到的桶也不會一直累積。
+// 只放正向矩形（x1<=x2、y1<=y2）；反向矩形由呼叫端另外處理。
+class ActiveBuckets {
+public:
+    struct Entry { int k, x1, y1, x2, y2; };
+
+    // [xmin, xmax]：所有會插入與查詢的 x 範圍；width：桶寬下限；n：k 的上限（去重用）
+    ActiveBuckets(int xmin, int xmax, int width, int halo, size_t n);
+
+    void insert(int k, int x1,int y1,int x2,int y2);
+    // x 範圍碰到 [qx1, qx2] 的桶裡、尚未過期（y2 + halo >= y）的項目各回呼一次（可能多給，呼叫端再精確判斷）
+    template<class F> void query(int qx1, int qx2, int y, F&& fn);
+
+private:
+    long long x0 = 0, width = 1;
+    int halo = 0;
+    std::vector<std::vector<Entry>> buckets;
+    std::vector<unsigned> seen;     // seen[k] == stamp：這次查詢已經回呼過（跨多個桶的矩形）
+    unsigned stamp = 0;
+    size_t entries = 0, nextCompact = 1024;
+
+    void compact(int y);
+
+    int bucketOf(long long x) const {
+        return (int)std::min<long long>(std::max<long long>((x - x0) / width, 0), (long long)buckets.size() - 1);
+    }
+};
+
+template<class F>
+void ActiveBuckets::query(int qx1, int qx2, int y, F&& fn){
+    if (buckets.empty()) return;
+    if (++stamp == 0) { std::fill(seen.begin(), seen.end(), 0u); stamp = 1; }
+    const int b1 = bucketOf(qx1), b2 = bucketOf(qx2);
+    for (int b = b1; b <= b2; ++b) {
+        std::vector<Entry>& B = buckets[b];
+        for (size_t i = 0; i < B.size();) {
+            const Entry& e = B[i];
+            if ((long long)e.y2 + halo < y) { B[i] = B.back(); B.pop_back(); --entries; continue; }
+            if (seen[e.k] != stamp) { seen[e.k] = stamp; fn(e); }
+            ++i;
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include "stats.hpp"
+#include "common.hpp"
+#include "drc.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+namespace {
+
+struct StatsRecord {
+    const char* stage;
+    const std::string* detail;
+    int tid;
+    long long start, wall, cpu;    // µs；start 從 enableStats 起算
+    long long rssKB;               // scope 結束時的 peak RSS
+    StageCounters c;
+};
+
+std::atomic<bool> gEnabled{false};
+std::mutex gMutex;
+std::vector<StatsRecord> gRecords;
+std::chrono::steady_clock::time_point gEpoch = std::chrono::steady_clock::now();
+std::atomic<int> gNextTid{0};
+
+long long wallMicros(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - gEpoch).count();
+}
+
+// 目前執行緒的 CPU time（µs）
+long long threadCpuMicros(){
+#ifdef _WIN32
+    FILETIME c, e, k, u;
+    if (!GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u)) return 0;
+    auto t = [](const FILETIME& f){ return ((long long)f.dwHighDateTime << 32 | f.dwLowDateTime) / 10; };
+    return t(k) + t(u);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+long long peakRssKB(){
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc)) return 0;
+    return (long long)(pmc.PeakWorkingSetSize / 1024);
+#else
+    rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;        // macOS 是 bytes
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+}
+
+int threadId(){
+    thread_local int id = gNextTid.fetch_add(1);
+    return id;
+}
+
+} // namespace
+
+
+void enableStats(bool on){
+    if (on && !gEnabled.load()) {
+        std::lock_guard<std::mutex> lk(gMutex);
+        gRecords.clear();
+        gEpoch = std::chrono::steady_clock::now();
+    }
+    gEnabled.store(on);
+}
+
+bool statsEnabled(){ return gEnabled.load(std::memory_order_relaxed); }
+
+
+StatsScope::StatsScope(const char* stage, std::string_view detail)
+    : stage(stage), on(statsEnabled())
+{
+    if (!on) return;
+    if (!detail.empty()) this->detail = internName(detail);
+    wall0 = wallMicros();
+    cpu0 = threadCpuMicros();
+}
+
+StatsScope::~StatsScope(){
+    if (!on) return;
+    StatsRecord r{stage, detail, threadId(), wall0, wallMicros() - wall0,
+                  threadCpuMicros() - cpu0, peakRssKB(), c};
+    std::lock_guard<std::mutex> lk(gMutex);
+    gRecords.push_back(r);
+}
+
+
+void writeStats(const std::string& base, int threads){
+    struct Agg {
+        long long first = 0, calls = 0, wall = 0, cpu = 0, rssKB = 0;
+        StageCounters c;
+    };
+    std::map<std::pair<std::string, std::string>, Agg> byKey;
+    long long peak = peakRssKB(), end = wallMicros();
+    {
+        std::lock_guard<std::mutex> lk(gMutex);
+        for (const auto& r : gRecords) {
+            auto key = std::make_pair(std::string(r.stage), r.detail ? *r.detail : std::string());
+            auto [it, fresh] = byKey.try_emplace(key);
+            Agg& a = it->second;
+            if (fresh || r.start < a.first) a.first = r.start;
+            a.calls++; a.wall += r.wall; a.cpu += r.cpu;
+            a.rssKB = std::max(a.rssKB, r.rssKB);
+            a.c.visited += r.c.visited; a.c.candidates += r.c.candidates;
+            a.c.tested += r.c.tested;   a.c.found += r.c.found;
+        }
+    }
+    // 依第一次開始的時間排：main 的階段與各 check 大致照執行順序
+    std::vector<std::pair<const std::pair<std::string, std::string>*, const Agg*>> rows;
+    for (const auto& kv : byKey) rows.push_back({&kv.first, &kv.second});
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& l, const auto& r){ return l.second->first < r.second->first; });
+
+    auto hitRate = [](const StageCounters& c){ return c.candidates > 0 ? (double)c.tested / c.candidates : 0.0; };
+
+    json stages = json::array();
+    for (const auto& [key, a] : rows)
+        stages.push_back({
+            {"stage", key->first}, {"detail", key->second}, {"calls", a->calls},
+            {"wall_ms", a->wall / 1000.0}, {"cpu_ms", a->cpu / 1000.0}, {"peak_rss_kb", a->rssKB},
+            {"visited", a->c.visited}, {"candidates", a->c.candidates}, {"tested", a->c.tested},
+            {"found", a->c.found}, {"index_hit_rate", hitRate(a->c)}
+        });
+    std::ofstream js(base + ".json");
+    if (!js.is_open()) { std::cerr << "ERROR: cannot write " << base << ".json\n"; return; }
+    js << json{{"threads", threads}, {"elapsed_ms", end / 1000.0}, {"peak_rss_kb", peak},
+               {"stages", stages}}.dump(2) << "\n";
+
+    std::ofstream csv(base + ".csv");
+    if (!csv.is_open()) { std::cerr << "ERROR: cannot write " << base << ".csv\n"; return; }
+    csv << "stage,detail,calls,wall_ms,cpu_ms,peak_rss_kb,visited,candidates,tested,found,index_hit_rate\n";
+    for (const auto& [key, a] : rows)
+        csv << key->first << "," << key->second << "," << a->calls << "," << a->wall / 1000.0 << ","
+            << a->cpu / 1000.0 << "," << a->rssKB << "," << a->c.visited << "," << a->c.candidates << ","
+            << a->c.tested << "," << a->c.found << "," << hitRate(a->c) << "\n";
+}
+
+void writeStatsTrace(const std::string& path){
+    std::ofstream out(path);
+    if (!out.is_open()) { std::cerr << "ERROR: cannot write " << path << "\n"; return; }
+    std::lock_guard<std::mutex> lk(gMutex);
+    out << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < gRecords.size(); ++i) {
+        const StatsRecord& r = gRecords[i];
+        json ev = {
+            {"name", r.detail ? std::string(r.stage) + " " + *r.detail : std::string(r.stage)},
+            {"cat", r.stage}, {"ph", "X"}, {"ts", r.start}, {"dur", r.wall}, {"pid", 1}, {"tid", r.tid},
+            {"args", {{"cpu_us", r.cpu}, {"visited", r.c.visited}, {"candidates", r.c.candidates},
+                      {"tested", r.c.tested}, {"found", r.c.found}}}
+        };
+        out << ev.dump() << (i + 1 < gRecords.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// ---- 執行剖析（--stats）----
+// main 的各階段與每個 check 的 kernel（每層 / 每段一次）各包一個 StatsScope，記下
+// wall time、該執行緒的 CPU time、結束時的 peak RSS，以及 kernel 自己數的計數器：
+//   visited     掃過的 shape / via / window 數
+//   candidates  索引（網格）回傳的候選數
+//   tested      通過粗篩、真正做精確判斷的候選數（tested / candidates = 索引命中率）
+//   found       找到的違規數（不含 PASS）
+// 沒開 --stats 時 StatsScope 只讀一個旗標，計數器只是區域變數的加法。
+// 結果可彙整成 JSON / CSV（依 stage × 層），或逐筆輸出成 Chrome trace-event 檔（chrome://tracing）。
+
+struct StageCounters {
+    long long visited = 0, candidates = 0, tested = 0, found = 0;
+};
+
+void enableStats(bool on);
+bool statsEnabled();
+
+class StatsScope {
+public:
+    // stage：固定字串（"spacing"、"parse"…）；detail：層名等，開啟時才 intern
+    explicit StatsScope(const char* stage, std::string_view detail = {});
+    ~StatsScope();
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+
+    StageCounters c;
+
+private:
+    const char* stage;
+    const std::string* detail = nullptr;
+    bool on;
+    long long wall0 = 0, cpu0 = 0;
+};
+
+// 彙整（stage × detail）寫成 <base>.json 與 <base>.csv；threads 只是記進檔頭
+void writeStats(const std::string& base, int threads);
+// 每個 scope 一筆 "X" 事件
+void writeStatsTrace(const std::string& path);
@@ -0,0 +1,104 @@
+#include "threadpool.hpp"
+
+namespace {
+thread_local const ThreadPool* tl_pool = nullptr;
+thread_local int tl_index = -1;
+}
+
+int ThreadPool::resolveThreads(int n){
+    if (n > 0) return n;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? (int)hw : 1;
+}
+
+ThreadPool::ThreadPool(int n){
+    n = resolveThreads(n);
+    for (int i = 0; i < n; ++i) queues.push_back(std::make_unique<Queue>());
+    for (int i = 0; i < n; ++i) workers.emplace_back([this, i]{ loop(i); });
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lk(sleepM);
+        stopping = true;
+    }
+    wakeCv.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> fn){
+    int target = (tl_pool == this) ? tl_index : (int)(rr++ % queues.size());
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lk(queues[target]->m);
+        queues[target]->q.push_back(std::move(fn));
+        queued.fetch_add(1);
+    }
+    {
+        std::lock_guard<std::mutex> lk(sleepM);   // 避免 worker 剛檢查完 queued、還沒睡下時漏掉通知
+    }
+    wakeCv.notify_one();
+}
+
+bool ThreadPool::tryRunOne(int self){
+    std::function<void()> job;
+    const int n = (int)queues.size();
+    {
+        std::lock_guard<std::mutex> lk(queues[self]->m);
+        if (!queues[self]->q.empty()){
+            job = std::move(queues[self]->q.back());
+            queues[self]->q.pop_back();
+            queued.fetch_sub(1);
+        }
+    }
+    for (int k = 1; !job && k < n; ++k){
+        Queue& victim = *queues[(self + k) % n];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if (!victim.q.empty()){
+            job = std::move(victim.q.front());
+            victim.q.pop_front();
+            queued.fetch_sub(1);
+        }
+    }
+    if (!job) return false;
+
+    try { job(); }
+    catch (...) {
+        std::lock_guard<std::mutex> lk(sleepM);
+        if (!firstError) firstError = std::current_exception();
+    }
+    if (pending.fetch_sub(1) == 1){
+        std::lock_guard<std::mutex> lk(sleepM);
+        doneCv.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::loop(int self){
+    tl_pool = this;
+    tl_index = self;
+    for (;;){
+        if (tryRunOne(self)) continue;
+        std::unique_lock<std::mutex> lk(sleepM);
+        if (stopping) return;
+        // 還有工作躺在別人 deque 裡（或剛 submit）就繼續偷，否則睡到下一次 submit
+        if (queued.load() == 0) wakeCv.wait(lk);
+    }
+}
+
+void ThreadPool::wait(){
+    // 在 worker 裡呼叫 wait() 時，自己也下去幫忙做，避免卡死
+    if (tl_pool == this){
+        while (pending.load() > 0)
+            if (!tryRunOne(tl_index)) std::this_thread::yield();
+    } else {
+        std::unique_lock<std::mutex> lk(sleepM);
+        doneCv.wait(lk, [&]{ return pending.load() == 0; });
+    }
+    std::exception_ptr err;
+    {
+        std::lock_guard<std::mutex> lk(sleepM);
+        std::swap(err, firstError);
+    }
+    if (err) std::rethrow_exception(err);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ---- Work-stealing thread pool ----
+// 每個 worker 有自己的 deque：自己從尾端拿（LIFO、cache 熱），閒著時從別人的頭端偷（FIFO）。
+// 外部 submit 以 round-robin 分散；worker 內 submit 直接放進自己的 deque。
+// wait() 會等到目前所有工作（含工作中再 submit 的）做完，並把第一個例外丟回呼叫端。
+class ThreadPool {
+public:
+    explicit ThreadPool(int n);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> fn);
+    void wait();
+    int size() const { return (int)workers.size(); }
+
+    // n<=0 代表用全部硬體執行緒
+    static int resolveThreads(int n);
+
+private:
+    struct Queue { std::mutex m; std::deque<std::function<void()>> q; };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{0};   // 已 submit 尚未做完
+    std::atomic<size_t> queued{0};    // 還躺在 deque 裡、沒人拿走
+    std::atomic<size_t> rr{0};
+    std::mutex sleepM;
+    std::condition_variable wakeCv, doneCv;
+    bool stopping = false;
+    std::exception_ptr firstError;
+
+    bool tryRunOne(int self);
+    void loop(int self);
+};
@@ -0,0 +1,350 @@
+#include "tile.hpp"
+#include "parser.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+
+int ruleHalo(const RuleSet& rules){
+    int h = 0;
+    for (const auto& kv : rules.layer_rules)
+        h = std::max(h, kv.second.min_spacing);
+    for (const auto& kv : rules.via_encl_map)
+        h = std::max(h, kv.second.min_enclose);
+    return std::max(h, 0);
+}
+
+std::vector<Box> splitDie(const Box& die, int nx, int ny){
+    nx = std::max(1, nx); ny = std::max(1, ny);
+    std::vector<Box> tiles;
+    long long W = (long long)die.x2 - die.x1, H = (long long)die.y2 - die.y1;
+    for (int j = 0; j < ny; ++j)
+        for (int i = 0; i < nx; ++i)
+            tiles.push_back({(int)(die.x1 + W * i / nx),       (int)(die.y1 + H * j / ny),
+                             (int)(die.x1 + W * (i + 1) / nx), (int)(die.y1 + H * (j + 1) / ny)});
+    return tiles;
+}
+
+bool parseBox(const std::string& s, Box& b){
+    return std::sscanf(s.c_str(), "%d,%d,%d,%d", &b.x1, &b.y1, &b.x2, &b.y2) == 4;
+}
+
+std::string boxArg(const Box& b){
+    return std::to_string(b.x1) + "," + std::to_string(b.y1) + "," +
+           std::to_string(b.x2) + "," + std::to_string(b.y2);
+}
+
+
+// ---- worker ----
+
+static bool isInverted(const Shape& s){ return s.x1 > s.x2 || s.y1 > s.y2; }
+
+// 左下角 clamp 進 die 後是否落在 core（core 半開區間；最後一塊的右/上邊就是 die 邊）
+static bool ownsPoint(const Box& die, const Box& core, long long x, long long y){
+    x = std::min<long long>(std::max<long long>(x, die.x1), (long long)die.x2 - 1);
+    y = std::min<long long>(std::max<long long>(y, die.y1), (long long)die.y2 - 1);
+    return x >= core.x1 && x < core.x2 && y >= core.y1 && y < core.y2;
+}
+bool ownsShape(const Box& die, const Box& core, const Shape& s){
+    return ownsPoint(die, core, std::min(s.x1, s.x2), std::min(s.y1, s.y2));
+}
+
+// WIDTH / SPACING 看 shape a、ENCLOSURE 看 via b；DENSITY 在算的時候就只算了擁有的 window
+static std::vector<Violation> ownedOnly(std::vector<Violation>& V, const std::vector<long long>& owned){
+    auto isOwned = [&](long long idx){ return std::binary_search(owned.begin(), owned.end(), idx); };
+    std::vector<Violation> out;
+    out.reserve(V.size());
+    for (auto& v : V){
+        if ((v.cat == 0 || v.cat == 1) && !isOwned(v.a)) continue;
+        if (v.cat == 2 && !isOwned(v.b)) continue;
+        out.push_back(std::move(v));
+    }
+    return out;
+}
+
+std::vector<Violation> runTile(const std::string& layoutFile, const RuleSet& rules,
+                               const Box& die, const Box& core, int threads)
+{
+    const long long halo = ruleHalo(rules);
+
+    // 1) 第一趟：需要的範圍 R = core（含從 core 起跳的 density window）∪ 擁有的 shape bbox
+    long long rx1 = core.x1, ry1 = core.y1;
+    long long rx2 = (long long)core.x2 + std::max(rules.density_window, 0);
+    long long ry2 = (long long)core.y2 + std::max(rules.density_window, 0);
+    bool everything = false;   // 擁有反向矩形：它的 rectSpacing 不是幾何距離，只好全讀
+    LayerTable layers = layerTableFor(rules);   // 兩趟共用同一張表，layer ID 才對得上
+    bool ok = scanLayout(layoutFile, layers, [&](const Shape& s, size_t){
+        if (!ownsShape(die, core, s)) return;
+        if (isInverted(s)) { everything = true; return; }
+        rx1 = std::min<long long>(rx1, s.x1); ry1 = std::min<long long>(ry1, s.y1);
+        rx2 = std::max<long long>(rx2, s.x2); ry2 = std::max<long long>(ry2, s.y2);
+    });
+    if (!ok) throw std::runtime_error("Cannot open layout file: " + layoutFile);
+    rx1 -= halo; ry1 -= halo; rx2 += halo; ry2 += halo;
+
+    // 2) 第二趟：只留與 R 相交（含邊界）的 shape，直接帶全域 idx 進 store；反向矩形一律保留
+    ShapeStore local;
+    std::vector<long long> owned;    // 擁有的全域 idx
+    std::vector<ParseError> seen;    // 壞行第一趟已經報過了
+    scanLayout(layoutFile, layers, [&](const Shape& s, size_t idx){
+        bool keep = everything || isInverted(s) ||
+                    !(s.x2 < rx1 || s.x1 > rx2 || s.y2 < ry1 || s.y1 > ry2);
+        if (!keep) return;
+        local.add(s.layer, s.x1, s.y1, s.x2, s.y2, (long long)idx);
+        if (ownsShape(die, core, s)) owned.push_back((long long)idx);
+    }, &seen);
+    local.layers = layers;
+    std::sort(owned.begin(), owned.end());   // 二進位 layout 是依層回呼的
+    for (auto& L : local.byLayer) L.sortByIdx();   // 別名併進同一層的 shape 也一樣
+
+    // 3) width / spacing / enclosure 用區域 shape 跑（die 給空的，density 另外算只屬於 core 的 window）
+    std::vector<Violation> V = run_drc(local, rules, 0,0,0,0, threads);
+    check_density_origins(local, rules, die.x1,die.y1,die.x2,die.y2,
+                          core.x1,core.y1,core.x2,core.y2, V);
+
+    // 4) 只留擁有的違規（idx 已經是全域的）
+    return ownedOnly(V, owned);
+}
+
+std::vector<Violation> checkRegion(const ShapeStore& store, const RuleSet& rules,
+                                   const Box& die, const Box& core, unsigned checks,
+                                   const std::function<void(std::vector<Violation>&)>& emit)
+{
+    const long long halo = ruleHalo(rules);
+
+    // 與 runTile 相同的兩趟，只是 shape 來自常駐的 store
+    // 只有 density 需要從 core 內起跳的 window 整個落在範圍裡
+    const long long ext = (checks & CHECK_DENSITY) ? std::max(rules.density_window, 0) : 0;
+    long long rx1 = core.x1, ry1 = core.y1;
+    long long rx2 = (long long)core.x2 + ext;
+    long long ry2 = (long long)core.y2 + ext;
+    bool everything = false;
+    for (int id = 0; id < store.numLayers(); ++id){
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k){
+            Shape s = L.at(id, k);
+            if (!ownsShape(die, core, s)) continue;
+            if (isInverted(s)) { everything = true; continue; }
+            rx1 = std::min<long long>(rx1, s.x1); ry1 = std::min<long long>(ry1, s.y1);
+            rx2 = std::max<long long>(rx2, s.x2); ry2 = std::max<long long>(ry2, s.y2);
+        }
+    }
+    rx1 -= halo; ry1 -= halo; rx2 += halo; ry2 += halo;
+
+    ShapeStore local;
+    local.layers = store.layers;
+    local.byLayer.resize(local.layers.size());   // 區域內沒有 shape 的層也要在（bindRules 的 ID 依層表）
+    std::vector<long long> owned;
+    for (int id = 0; id < store.numLayers(); ++id){
+        const LayerShapes& L = store.byLayer[id];
+        for (size_t k = 0; k < L.size(); ++k){
+            Shape s = L.at(id, k);
+            bool keep = everything || isInverted(s) ||
+                        !(s.x2 < rx1 || s.x1 > rx2 || s.y2 < ry1 || s.y1 > ry2);
+            if (!keep) continue;
+            local.add(id, s.x1, s.y1, s.x2, s.y2, L.idx[k]);
+            if (ownsShape(die, core, s)) owned.push_back(L.idx[k]);
+        }
+    }
+    std::sort(owned.begin(), owned.end());
+
+    // 逐項 check，做完一項就交給 emit（各項本身已排好序，依 cat 順序串起來就是完整順序）
+    std::vector<Violation> all, V;
+    auto flush = [&]{
+        V = ownedOnly(V, owned);
+        if (emit) emit(V);
+        all.insert(all.end(), std::make_move_iterator(V.begin()), std::make_move_iterator(V.end()));
+        V.clear();
+    };
+    if (checks & CHECK_WIDTH)     { check_min_width(local, rules, V);           flush(); }
+    if (checks & CHECK_SPACING)   { check_min_spacing(local, rules, V);         flush(); }
+    if (checks & CHECK_ENCLOSURE) { check_via_enclosure_multi(local, rules, V); flush(); }
+    if (checks & CHECK_DENSITY) {
+        check_density_origins(local, rules, die.x1,die.y1,die.x2,die.y2,
+                              core.x1,core.y1,core.x2,core.y2, V);
+        flush();
+    }
+    return all;
+}
+
+
+// ---- 結果交換 ----
+
+json violationJson(const Violation& v){
+    return {
+        {"type", violationType(v)}, {"layer", v.layer ? *v.layer : ""},
+        {"object", violationObject(v)}, {"bbox", violationBBox(v)},
+        {"box", {v.x1, v.y1, v.x2, v.y2}}, {"rule", violationRule(v)},
+        {"actual", v.actual}, {"threshold", v.threshold}, {"delta", v.delta},
+        {"status", violationStatus(v)}, {"missing", v.missing},
+        {"key", {v.cat, v.a, v.b, v.sub}}
+    };
+}
+
+// type / object / bbox / rule 由 key 與 box 重組，只讀名稱與數值欄位
+Violation violationFromJson(const json& j){
+    Violation v;
+    const auto& k = j.at("key");
+    v.cat = k.at(0); v.a = k.at(1); v.b = k.at(2); v.sub = k.at(3);
+    v.layer = internName(j.at("layer").get<std::string>());
+    if (v.cat == 2) v.object = internName(j.at("object").get<std::string>());
+    const auto& box = j.at("box");
+    v.x1 = box.at(0); v.y1 = box.at(1); v.x2 = box.at(2); v.y2 = box.at(3);
+    v.actual = j.at("actual"); v.threshold = j.at("threshold"); v.delta = j.at("delta");
+    v.pass = j.at("status") == "PASS";
+    v.missing = j.at("missing");
+    return v;
+}
+
+void saveViolations(const std::string& path, const std::vector<Violation>& V){
+    std::ofstream out(path);
+    if (!out.is_open()) throw std::runtime_error("Cannot write " + path);
+    for (const auto& v : V) out << violationJson(v).dump() << "\n";
+}
+
+std::vector<Violation> loadViolations(const std::string& path){
+    std::ifstream fin(path);
+    if (!fin.is_open()) throw std::runtime_error("Cannot open " + path);
+    std::vector<Violation> V;
+    std::string line;
+    while (std::getline(fin, line)){
+        if (line.empty()) continue;
+        V.push_back(violationFromJson(json::parse(line)));
+    }
+    return V;
+}
+
+std::vector<Violation> mergeViolations(std::vector<std::vector<Violation>>& parts){
+    std::vector<Violation> V;
+    for (auto& p : parts)
+        V.insert(V.end(), std::make_move_iterator(p.begin()), std::make_move_iterator(p.end()));
+    std::stable_sort(V.begin(), V.end(), violationLess);
+    auto same = [](const Violation& l, const Violation& r){
+        return l.cat == r.cat && l.a == r.a && l.b == r.b && l.sub == r.sub;
+    };
+    V.erase(std::unique(V.begin(), V.end(), same), V.end());
+    return V;
+}
+
+
+// ---- launcher ----
+
+// 直接以 argv 啟動 worker、等它結束，回傳 exit code（無法啟動 = -1）；不經過 shell，路徑裡有什麼字元都照原樣傳
+#ifdef _WIN32
+// CommandLineToArgvW / MSVC CRT 的規則：引號前的反斜線要加倍再跳脫引號，結尾的反斜線也要加倍
+static std::string quoteArg(const std::string& s){
+    if (!s.empty() && s.find_first_of(" \t\n\v\"") == std::string::npos) return s;
+    std::string q = "\"";
+    size_t slashes = 0;
+    for (char c : s){
+        if (c == '\\') { ++slashes; continue; }
+        q.append(c == '"' ? slashes * 2 + 1 : slashes, '\\');
+        slashes = 0;
+        q.push_back(c);
+    }
+    q.append(slashes * 2, '\\');
+    q.push_back('"');
+    return q;
+}
+
+static int runProcess(const std::vector<std::string>& argv){
+    std::string cmd;
+    for (const auto& a : argv) cmd += (cmd.empty() ? "" : " ") + quoteArg(a);
+    STARTUPINFOA si{};
+    si.cb = sizeof si;
+    PROCESS_INFORMATION pi{};
+    if (!CreateProcessA(nullptr, cmd.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+        return -1;
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD rc = 1;
+    GetExitCodeProcess(pi.hProcess, &rc);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    return (int)rc;
+}
+#else
+static int runProcess(const std::vector<std::string>& argv){
+    std::vector<char*> args;
+    for (const auto& a : argv) args.push_back(const_cast<char*>(a.c_str()));
+    args.push_back(nullptr);
+    pid_t pid;
+    // argv[0] 沒有 '/' 時（從 PATH 找到的）照 PATH 找
+    const bool path = argv[0].find('/') == std::string::npos;
+    int err = path ? posix_spawnp(&pid, args[0], nullptr, nullptr, args.data(), environ)
+                   : posix_spawn(&pid, args[0], nullptr, nullptr, args.data(), environ);
+    if (err != 0) return -1;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+#endif
+
+// 這次 run 專用的暫存目錄（只有自己能讀寫）；結束時整個刪掉
+namespace {
+struct TempDir {
+    std::filesystem::path path;
+    TempDir(){
+        namespace fs = std::filesystem;
+#ifdef _WIN32
+        const std::string base = (fs::temp_directory_path() / "drc_tiles_").string();
+        for (unsigned n = GetCurrentProcessId() ^ GetTickCount();; ++n){
+            fs::path p = base + std::to_string(n);
+            std::error_code ec;
+            if (fs::create_directory(p, ec)) { path = p; break; }
+            if (ec) throw std::runtime_error("Cannot create temp directory " + p.string() + ": " + ec.message());
+        }
+#else
+        std::string tmpl = (fs::temp_directory_path() / "drc_tiles_XXXXXX").string();
+        if (!mkdtemp(tmpl.data())) throw std::runtime_error("Cannot create temp directory " + tmpl);
+        path = tmpl;
+#endif
+    }
+    ~TempDir(){ std::error_code ec; std::filesystem::remove_all(path, ec); }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+};
+}
+
+std::vector<Violation> runTiledDRC(const std::string& exe, const std::string& layoutFile,
+                                   const std::string& rulesFile, const Box& die,
+                                   int nx, int ny, int jobs, int threads)
+{
+    std::vector<Box> tiles = splitDie(die, nx, ny);
+    std::vector<std::vector<Violation>> parts(tiles.size());
+    const TempDir tmp;
+
+    ThreadPool pool(std::max(1, jobs));
+    for (size_t k = 0; k < tiles.size(); ++k){
+        pool.submit([&, k]{
+            const std::string out = (tmp.path / ("tile_" + std::to_string(k) + ".jsonl")).string();
+            const int rc = runProcess({exe, "--tile-worker", layoutFile, rulesFile, boxArg(die), boxArg(tiles[k]),
+                                       out, "--threads", std::to_string(threads)});
+            if (rc != 0){
+                std::remove(out.c_str());
+                throw std::runtime_error("tile " + std::to_string(k) + " worker failed (exit " +
+                                         std::to_string(rc) + ")");
+            }
+            parts[k] = loadViolations(out);
+            std::remove(out.c_str());
+        });
+    }
+    pool.wait();
+    return mergeViolations(parts);
+}
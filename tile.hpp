@@ -0,0 +1,46 @@
+#pragma once
+#include "common.hpp"
+#include "drc.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+// ---- Tile 模式：die 切成 nx×ny 塊，每塊由一個 worker process 跑 ----
+// 每個違規只歸一塊 tile 管（「擁有者」）：
+//   WIDTH / SPACING(i,j) 看 shape i 的左下角，ENCLOSURE 看 via 的左下角，DENSITY 看 window 左下角；
+//   左下角先 clamp 進 die，所以 die 外的 shape 也剛好歸一塊。
+// worker 只讀「core ∪ 擁有的 shape bbox ∪ 擁有的 window，外擴 halo」範圍內的 shape，
+// 所以擁有的違規需要的鄰居一定都在；合併時依 (cat,a,b,sub) 排序去重，結果與單機相同。
+
+int ruleHalo(const RuleSet& rules);                 // 最大 spacing / enclosure 距離
+// shape 左下角 clamp 進 die 後是否落在 core（core 半開區間；最後一塊的右/上邊就是 die 邊）
+bool ownsShape(const Box& die, const Box& core, const Shape& s);
+std::vector<Box> splitDie(const Box& die, int nx, int ny);
+bool parseBox(const std::string& s, Box& b);        // "x1,y1,x2,y2"
+std::string boxArg(const Box& b);
+
+// worker：回傳這塊 tile 擁有的違規，idx 都是 layout 檔裡的全域 idx
+std::vector<Violation> runTile(const std::string& layoutFile, const RuleSet& rules,
+                               const Box& die, const Box& core, int threads = 1);
+
+// 常駐 store 版的 runTile（daemon 用）：只跑 checks 指定的項目，回傳 core 擁有的違規；
+// 每做完一項就先把那一項的違規交給 emit（已排序，依 cat 順序串起來即為最終順序）
+enum : unsigned { CHECK_WIDTH = 1, CHECK_SPACING = 2, CHECK_ENCLOSURE = 4, CHECK_DENSITY = 8,
+                  CHECK_ALL = 15 };
+std::vector<Violation> checkRegion(const ShapeStore& store, const RuleSet& rules,
+                                   const Box& die, const Box& core, unsigned checks = CHECK_ALL,
+                                   const std::function<void(std::vector<Violation>&)>& emit = {});
+
+// worker 與 launcher 之間用 JSON lines 交換結果（一行一個 violationJson）
+json violationJson(const Violation& v);
+Violation violationFromJson(const json& j);
+void saveViolations(const std::string& path, const std::vector<Violation>& V);
+std::vector<Violation> loadViolations(const std::string& path);
+
+// 依 (cat,a,b,sub) 排序並去重
+std::vector<Violation> mergeViolations(std::vector<std::vector<Violation>>& parts);
+
+// launcher：每塊 tile 起一個 `exe --tile-worker ...` 子行程，最多 jobs 個同時跑
+std::vector<Violation> runTiledDRC(const std::string& exe, const std::string& layoutFile,
+                                   const std::string& rulesFile, const Box& die,
+                                   int nx, int ny, int jobs, int threads = 1);